@@ -0,0 +1,879 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 基准测试, 用法: ./bench [batch|ruleset|pool|parse|adaptive|cache|strhash|jit|image]
+ * ./bench filter [MB] 生成 NDJSON 和 CSV 文件(默认各 2048MB), 测 expr_filter 的吞吐量, 不包括在 all 中
+ */
+#define _POSIX_C_SOURCE 199309L
+#include "expr_parser.h"
+#include "expr_ruleset.h"
+#include "expr_pool.h"
+#include "expr_cache.h"
+#include "expr_jit.h"
+#include "expr_image.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static unsigned int rand_state = 2463534242u;
+
+static unsigned int next_rand(void) {
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+/*
+ * 批量执行: 标量和各级SIMD内核每秒处理的行数
+ */
+#define BATCH_ROWS (1 << 22)
+
+typedef struct row_ctx {
+	expr_column_t *columns;
+	size_t row;
+} row_ctx;
+
+static int get_row_value(int slot, expr_value_t *value, void *usrdata) {
+	row_ctx *ctx = (row_ctx *)usrdata;
+	expr_column_t *col = ctx->columns + slot;
+	if(col->type == EXPR_COLUMN_INT64) {
+		expr_value_set_int(value, col->i64[ctx->row]);
+	}
+	else {
+		expr_value_set_double(value, col->f64[ctx->row]);
+	}
+	return 0;
+}
+
+static void bench_batch(void) {
+	static const char *level_names[] = {"scalar", "sse4.2", "avx2"};
+	char *exps[] = {
+		"$i > 500",
+		"$i == $j",
+		"$d <= 0.5 && $i != 7",
+		"!($d > 0.9) || $i < 10 || $d >= $e"
+	};
+	int64_t *ints = (int64_t *)malloc(sizeof(int64_t) * BATCH_ROWS);
+	int64_t *ints2 = (int64_t *)malloc(sizeof(int64_t) * BATCH_ROWS);
+	double *doubles = (double *)malloc(sizeof(double) * BATCH_ROWS);
+	double *doubles2 = (double *)malloc(sizeof(double) * BATCH_ROWS);
+	unsigned char *bitmap = (unsigned char *)malloc((BATCH_ROWS+7)/8);
+	int max_level = expr_simd_level();
+	expr_parser *parser = expr_parser_new();
+	size_t i, k;
+
+	for(i=0; i<BATCH_ROWS; ++i) {
+		ints[i] = next_rand() % 1000;
+		ints2[i] = next_rand() % 1000;
+		doubles[i] = (double)(next_rand() % 10000) / 10000;
+		doubles2[i] = (double)(next_rand() % 10000) / 10000;
+	}
+
+	for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+		expr_column_t columns[4];
+		row_ctx ctx;
+		int level, result, rounds = 10, r;
+		size_t v, nrows;
+		double start, elapsed;
+
+		expr_parser_parse(parser, exps[k]);
+		memset(columns, 0x00, sizeof(columns));
+		for(v=0; v<expr_parser_var_count(parser); ++v) {
+			char *name = expr_parser_var_name(parser, v);
+			columns[v].type = (name[0] == 'i' || name[0] == 'j') ? \
+				EXPR_COLUMN_INT64 : EXPR_COLUMN_DOUBLE;
+			columns[v].i64 = name[0] == 'i' ? ints : ints2;
+			columns[v].f64 = name[0] == 'd' ? doubles : doubles2;
+		}
+
+		/* 逐行执行作为参照 */
+		nrows = BATCH_ROWS / 8;
+		ctx.columns = columns;
+		start = now_sec();
+		for(i=0; i<nrows; ++i) {
+			ctx.row = i;
+			expr_parser_execute_slot(parser, &result, get_row_value, &ctx);
+		}
+		elapsed = now_sec() - start;
+		printf("batch\t%-40s\t%-8s\t%12.0f rows/s\n", exps[k], "per-row", nrows / elapsed);
+
+		for(level=EXPR_SIMD_NONE; level<=max_level; ++level) {
+			expr_simd_limit(level);
+			start = now_sec();
+			for(r=0; r<rounds; ++r) {
+				expr_parser_execute_batch(parser, columns, expr_parser_var_count(parser), \
+						BATCH_ROWS, bitmap);
+			}
+			elapsed = now_sec() - start;
+			printf("batch\t%-40s\t%-8s\t%12.0f rows/s\n", exps[k], level_names[level], \
+					(double)BATCH_ROWS * rounds / elapsed);
+		}
+		expr_simd_limit(EXPR_SIMD_AVX2);
+	}
+
+	expr_parser_delete(parser);
+	free(ints);
+	free(ints2);
+	free(doubles);
+	free(doubles2);
+	free(bitmap);
+}
+
+/*
+ * 规则集: 倒排索引匹配和逐条执行全部规则的对比
+ */
+#define RULES 100000
+
+typedef struct event_t {
+	int64_t status;
+	char *method;
+} event_t;
+
+static int get_event_value(char *varname, expr_value_t *value, void *usrdata) {
+	event_t *ev = (event_t *)usrdata;
+	if(strcmp(varname, "status") == 0) {
+		expr_value_set_int(value, ev->status);
+	}
+	else if(strcmp(varname, "method") == 0) {
+		expr_value_set_str_ref(value, ev->method, strlen(ev->method));
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static void bench_ruleset(void) {
+	static char *methods[] = {"GET", "POST", "PUT", "DELETE"};
+	char exp_str[128];
+	expr_ruleset *rs = expr_ruleset_new();
+	expr_parser **parsers = (expr_parser **)malloc(sizeof(expr_parser *) * RULES);
+	array_t ids;
+	event_t ev;
+	size_t i, j, matched = 0, events;
+	int result;
+	double start, elapsed;
+
+	array_init(&ids, sizeof(int));
+	for(i=0; i<RULES; ++i) {
+		sprintf(exp_str, "$status == %lu && $method -se '%s'", (unsigned long)i, methods[i%4]);
+		expr_ruleset_add(rs, (int)i, exp_str);
+		parsers[i] = expr_parser_new();
+		expr_parser_parse(parsers[i], exp_str);
+	}
+
+	events = 100000;
+	start = now_sec();
+	for(i=0; i<events; ++i) {
+		ev.status = next_rand() % RULES;
+		ev.method = methods[next_rand() % 4];
+		expr_ruleset_match(rs, get_event_value, &ev, &ids);
+		matched += array_size(&ids);
+	}
+	elapsed = now_sec() - start;
+	printf("ruleset\t%d rules\t%-8s\t%12.0f events/s\tmatched %lu\n", RULES, "indexed", \
+			events / elapsed, (unsigned long)matched);
+
+	events = 20;
+	matched = 0;
+	start = now_sec();
+	for(i=0; i<events; ++i) {
+		ev.status = next_rand() % RULES;
+		ev.method = methods[next_rand() % 4];
+		for(j=0; j<RULES; ++j) {
+			if(expr_parser_execute(parsers[j], &result, get_event_value, &ev) == 0 && result) {
+				matched++;
+			}
+		}
+	}
+	elapsed = now_sec() - start;
+	printf("ruleset\t%d rules\t%-8s\t%12.0f events/s\tmatched %lu\n", RULES, "linear", \
+			events / elapsed, (unsigned long)matched);
+
+	for(i=0; i<RULES; ++i) {
+		expr_parser_delete(parsers[i]);
+	}
+	free(parsers);
+	array_uinit(&ids);
+	expr_ruleset_delete(rs);
+}
+
+/*
+ * 线程池: 1 到 N 个线程并行执行的吞吐
+ */
+#define POOL_ROWS (1 << 22)
+
+typedef struct pool_data {
+	const int64_t *ints;
+	const double *doubles;
+} pool_data;
+
+static int get_pool_value(int slot, size_t row, expr_value_t *value, void *usrdata) {
+	pool_data *data = (pool_data *)usrdata;
+	if(0 == slot) {
+		expr_value_set_int(value, data->ints[row]);
+	}
+	else {
+		expr_value_set_double(value, data->doubles[row]);
+	}
+	return 0;
+}
+
+static void bench_pool(void) {
+	char *exp_str = "$i > 500 && $d <= 0.5";
+	int64_t *ints = (int64_t *)malloc(sizeof(int64_t) * POOL_ROWS);
+	double *doubles = (double *)malloc(sizeof(double) * POOL_ROWS);
+	unsigned char *bitmap = (unsigned char *)malloc((POOL_ROWS+7)/8);
+	expr_program *prog = expr_program_new(exp_str);
+	expr_pool *probe = expr_pool_new(0);
+	int ncpu = expr_pool_threads(probe), n;
+	expr_column_t columns[2];
+	pool_data data;
+	size_t i;
+
+	expr_pool_delete(probe);
+	for(i=0; i<POOL_ROWS; ++i) {
+		ints[i] = next_rand() % 1000;
+		doubles[i] = (double)(next_rand() % 10000) / 10000;
+	}
+	data.ints = ints;
+	data.doubles = doubles;
+	memset(columns, 0x00, sizeof(columns));
+	columns[0].type = EXPR_COLUMN_INT64;
+	columns[0].i64 = ints;
+	columns[1].type = EXPR_COLUMN_DOUBLE;
+	columns[1].f64 = doubles;
+
+	for(n=1; n<=ncpu; n = (n*2 <= ncpu || n == ncpu) ? n*2 : ncpu) {
+		expr_pool *pool = expr_pool_new(n);
+		void **usrdatas = (void **)malloc(sizeof(void *) * n);
+		pool_data *datas = (pool_data *)malloc(sizeof(pool_data) * n);
+		double start, elapsed;
+		int k, rounds = 5;
+
+		/* 每个线程各用一份取值上下文 */
+		for(k=0; k<n; ++k) {
+			datas[k] = data;
+			usrdatas[k] = &datas[k];
+		}
+		start = now_sec();
+		expr_pool_execute(pool, prog, POOL_ROWS, get_pool_value, usrdatas, bitmap);
+		elapsed = now_sec() - start;
+		printf("pool\t%d threads\t%-8s\t%12.0f rows/s\n", n, "per-row", POOL_ROWS / elapsed);
+
+		start = now_sec();
+		for(k=0; k<rounds; ++k) {
+			expr_pool_execute_batch(pool, prog, columns, 2, POOL_ROWS, bitmap);
+		}
+		elapsed = now_sec() - start;
+		printf("pool\t%d threads\t%-8s\t%12.0f rows/s\tsteals %lu\n", n, "batch", \
+				(double)POOL_ROWS * rounds / elapsed, (unsigned long)expr_pool_steals(pool));
+
+		expr_pool_delete(pool);
+		free(usrdatas);
+		free(datas);
+	}
+
+	expr_program_delete(prog);
+	free(ints);
+	free(doubles);
+	free(bitmap);
+}
+
+/*
+ * 解析: 生成的长表达式每秒解析的词法单元数
+ */
+static size_t gen_exp(char *buf, size_t terms) {
+	size_t i, tokens = 0;
+	char *p = buf;
+	for(i=0; i<terms; ++i) {
+		if(i) {
+			p += sprintf(p, i%2 ? " && " : " || ");
+			tokens++;
+		}
+		switch(i%4) {
+		case 0: p += sprintf(p, "$v%lu == %lu", (unsigned long)i, (unsigned long)i); tokens += 3; break;
+		case 1: p += sprintf(p, "$s%lu -se 'abc'", (unsigned long)i); tokens += 3; break;
+		case 2: p += sprintf(p, "!($d%lu >= 1.5)", (unsigned long)i); tokens += 6; break;
+		default: p += sprintf(p, "$c%lu -cne [[X]]", (unsigned long)i); tokens += 3; break;
+		}
+	}
+	return tokens;
+}
+
+static void bench_parse(void) {
+	static size_t terms[] = {10, 200};
+	char *buf = (char *)malloc(64 * 200);
+	expr_parser *parser = expr_parser_new();
+	size_t k;
+
+	for(k=0; k<sizeof(terms)/sizeof(terms[0]); ++k) {
+		size_t tokens = gen_exp(buf, terms[k]);
+		size_t r, rounds = 400000 / terms[k];
+		double start, elapsed;
+
+		if(expr_parser_parse(parser, buf) < 0) {
+			printf("parse\t%lu terms\tfailed\n", (unsigned long)terms[k]);
+			continue;
+		}
+		start = now_sec();
+		for(r=0; r<rounds; ++r) {
+			expr_parser_parse(parser, buf);
+		}
+		elapsed = now_sec() - start;
+		printf("parse\t%lu terms\t%12.0f tokens/s\t%12.0f parses/s\n", (unsigned long)terms[k], \
+				(double)tokens * rounds / elapsed, rounds / elapsed);
+	}
+
+	expr_parser_delete(parser);
+	free(buf);
+}
+
+/*
+ * 解析耗时随项数的变化: 长 || 链和深层嵌套的括号
+ */
+static void bench_parse_scale(void) {
+	static size_t terms[] = {10, 1000, 100000, 1000000};
+	static const char *shapes[] = {"chain", "nested"};
+	size_t k, i;
+	int shape;
+
+	for(shape=0; shape<2; ++shape) {
+		for(k=0; k<sizeof(terms)/sizeof(terms[0]); ++k) {
+			char *buf = (char *)malloc(terms[k] * 32 + 1);
+			char *p = buf;
+			expr_parser *parser = expr_parser_new();
+			double start, elapsed;
+			int ret;
+
+			for(i=0; i<terms[k]; ++i) {
+				p += sprintf(p, "%s$id == %lu", i ? (shape ? " || (" : " || ") : "", (unsigned long)i);
+			}
+			for(i=1; shape && i<terms[k]; ++i) {
+				*p++ = ')';
+			}
+			*p = '\0';
+
+			start = now_sec();
+			ret = expr_parser_parse(parser, buf);
+			elapsed = now_sec() - start;
+			printf("parse\t%-6s\t%8lu terms\t%s\t%10.3f ms\t%8.1f ns/term\n", shapes[shape], \
+					(unsigned long)terms[k], ret == 0 ? "ok" : "failed", elapsed * 1e3, \
+					elapsed * 1e9 / terms[k]);
+			expr_parser_delete(parser);
+			free(buf);
+		}
+	}
+}
+
+/*
+ * 自适应顺序: 很少为真的便宜条件写在最后, 对比固定顺序和自适应重排
+ */
+#define ADAPT_EVALS	2000000
+
+static void bench_adaptive(void) {
+	static char *methods[] = {"GET", "POST", "PUT", "DELETE"};
+	char *exp_str = "$method -cne 'put' && $method -sne 'DELETE' && $status == 7";
+	char order[64];
+	int adaptive, result;
+	size_t i;
+
+	for(adaptive=0; adaptive<2; ++adaptive) {
+		expr_parser *parser = expr_parser_new();
+		event_t ev;
+		size_t matched = 0;
+		double start, elapsed;
+
+		expr_parser_parse(parser, exp_str);
+		expr_parser_set_adaptive(parser, adaptive ? 1000 : 0);
+		rand_state = 2463534242u;
+		start = now_sec();
+		for(i=0; i<ADAPT_EVALS; ++i) {
+			ev.status = next_rand() % 100;
+			ev.method = methods[next_rand() % 4];
+			if(expr_parser_execute(parser, &result, get_event_value, &ev) == 0 && result) {
+				matched++;
+			}
+		}
+		elapsed = now_sec() - start;
+		expr_parser_get_order(parser, order, sizeof(order));
+		printf("adaptive\t%-8s\t%12.0f evals/s\tmatched %lu\torder %s\n", adaptive ? "on" : "off", \
+				ADAPT_EVALS / elapsed, (unsigned long)matched, order);
+		expr_parser_delete(parser);
+	}
+}
+
+/*
+ * 编译缓存: 反复出现的几千个表达式, 每次请求重新编译和从缓存取出的对比.
+ * 请求的分布是偏斜的, 少数表达式出现得最多.
+ */
+#define CACHE_EXPS		4000
+#define CACHE_REQUESTS	400000
+
+static void bench_cache(void) {
+	static size_t limits[] = {CACHE_EXPS, CACHE_EXPS / 4};
+	char **exps = (char **)malloc(sizeof(char *) * CACHE_EXPS);
+	size_t *reqs = (size_t *)malloc(sizeof(size_t) * CACHE_REQUESTS);
+	size_t i, k;
+	double start, elapsed;
+
+	for(i=0; i<CACHE_EXPS; ++i) {
+		exps[i] = (char *)malloc(64 * 10 + 32);
+		gen_exp(exps[i], 10);
+		sprintf(exps[i] + strlen(exps[i]), " || $id == %lu", (unsigned long)i);
+	}
+	for(i=0; i<CACHE_REQUESTS; ++i) {
+		double u = (double)(next_rand() % 1000000) / 1000000;
+		reqs[i] = (size_t)(u * u * u * CACHE_EXPS);
+	}
+
+	start = now_sec();
+	for(i=0; i<CACHE_REQUESTS; ++i) {
+		expr_program_delete(expr_program_new(exps[reqs[i]]));
+	}
+	elapsed = now_sec() - start;
+	printf("cache\tnone\t%12.0f requests/s\n", CACHE_REQUESTS / elapsed);
+
+	for(k=0; k<sizeof(limits)/sizeof(limits[0]); ++k) {
+		expr_cache *cache = expr_cache_new(limits[k], 0);
+		expr_cache_stat_t stat;
+		start = now_sec();
+		for(i=0; i<CACHE_REQUESTS; ++i) {
+			expr_cache_release(cache, expr_cache_get(cache, exps[reqs[i]]));
+		}
+		elapsed = now_sec() - start;
+		expr_cache_stat(cache, &stat);
+		printf("cache\t%lu entries\t%12.0f requests/s\thit %.1f%%\tevictions %lu\t%lu KB\n", \
+				(unsigned long)limits[k], CACHE_REQUESTS / elapsed, \
+				100.0 * stat.hits / (stat.hits + stat.misses), \
+				(unsigned long)stat.evictions, (unsigned long)(stat.bytes / 1024));
+		expr_cache_delete(cache);
+	}
+
+	for(i=0; i<CACHE_EXPS; ++i) {
+		free(exps[i]);
+	}
+	free(exps);
+	free(reqs);
+}
+
+/*
+ * -se/-sne 的字符串比较: 一组URL和User-Agent, 和规则里的常量逐个比较.
+ * 长度相同的字符串很多, 前缀也大多相同. 对比取值时带不带预先算好的哈希,
+ * 并按各种比较方式统计要看的字节数(strcmp 是改用长度之前的做法).
+ */
+#define STR_ROWS	4096
+#define STR_RULES	8
+#define STR_EVALS	1000000
+
+typedef struct str_row_t {
+	char url[96];
+	char ua[160];
+	uint64_t url_hash;
+	uint64_t ua_hash;
+	int hashed;
+} str_row_t;
+
+static int get_str_value(char *varname, expr_value_t *value, void *usrdata) {
+	str_row_t *row = (str_row_t *)usrdata;
+	int is_url = strcmp(varname, "url") == 0;
+	char *p = is_url ? row->url : row->ua;
+	expr_value_set_str_ref(value, p, strlen(p));
+	if(row->hashed) {
+		expr_value_set_hash(value, is_url ? row->url_hash : row->ua_hash);
+	}
+	return 0;
+}
+
+static void gen_url(char *buf) {
+	static const char *paths[] = {"products", "search", "account/orders", "static/js"};
+	sprintf(buf, "https://shop.example.com/%s/%05u?ref=%s", paths[next_rand() % 4], \
+			next_rand() % 100000, next_rand() % 2 ? "home" : "mail");
+}
+
+static void gen_ua(char *buf) {
+	static const char *os[] = {"Windows NT 10.0; Win64; x64", "X11; Linux x86_64", \
+		"Macintosh; Intel Mac OS X 10_15_7"};
+	sprintf(buf, "Mozilla/5.0 (%s) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/%u.0.%u.%u Safari/537.36", \
+			os[next_rand() % 3], 100 + next_rand() % 20, 1000 + next_rand() % 9000, 10 + next_rand() % 90);
+}
+
+static size_t common_prefix(const char *a, const char *b) {
+	size_t n = 0;
+	while(a[n] && a[n] == b[n]) {
+		n++;
+	}
+	return n;
+}
+
+static void bench_strhash(void) {
+	str_row_t *rows = (str_row_t *)malloc(sizeof(str_row_t) * STR_ROWS);
+	char lits[2][STR_RULES][160];
+	char *exp_str = (char *)malloc(STR_RULES * 2 * 200);
+	char *p = exp_str;
+	double bytes_strcmp = 0, bytes_len = 0, bytes_hash = 0, compares = 0;
+	size_t i, k;
+	int side, hashed;
+
+	rand_state = 2463534242u;
+	for(i=0; i<STR_ROWS; ++i) {
+		gen_url(rows[i].url);
+		gen_ua(rows[i].ua);
+		rows[i].url_hash = expr_str_hash(rows[i].url, strlen(rows[i].url));
+		rows[i].ua_hash = expr_str_hash(rows[i].ua, strlen(rows[i].ua));
+	}
+	for(k=0; k<STR_RULES; ++k) {
+		gen_url(lits[0][k]);
+		gen_ua(lits[1][k]);
+	}
+	/* 一部分行命中规则 */
+	for(i=0; i<STR_ROWS; i+=64) {
+		strcpy(rows[i].url, lits[0][i % STR_RULES]);
+		rows[i].url_hash = expr_str_hash(rows[i].url, strlen(rows[i].url));
+	}
+	for(side=0; side<2; ++side) {
+		for(k=0; k<STR_RULES; ++k) {
+			p += sprintf(p, "%s$%s -se '%s'", p == exp_str ? "" : " || ", side ? "ua" : "url", lits[side][k]);
+		}
+	}
+
+	/* 每行都和全部常量比较时要看的字节数 */
+	for(i=0; i<STR_ROWS; ++i) {
+		for(side=0; side<2; ++side) {
+			const char *v = side ? rows[i].ua : rows[i].url;
+			uint64_t h = side ? rows[i].ua_hash : rows[i].url_hash;
+			size_t vlen = strlen(v);
+			for(k=0; k<STR_RULES; ++k) {
+				const char *l = lits[side][k];
+				size_t n = common_prefix(v, l), llen = strlen(l);
+				compares++;
+				bytes_strcmp += (double)n + 1;
+				if(vlen == llen) {
+					bytes_len += (double)(n < vlen ? n + 1 : vlen);
+					if(h == expr_str_hash(l, llen)) {
+						bytes_hash += (double)vlen;
+					}
+				}
+			}
+		}
+	}
+	printf("strhash	bytes/compare	strcmp %.2f	length %.2f	length+hash %.2f\n", \
+			bytes_strcmp / compares, bytes_len / compares, bytes_hash / compares);
+
+	for(hashed=0; hashed<2; ++hashed) {
+		expr_parser *parser = expr_parser_new();
+		size_t matched = 0;
+		double start, elapsed;
+		int result;
+
+		expr_parser_parse(parser, exp_str);
+		for(i=0; i<STR_ROWS; ++i) {
+			rows[i].hashed = hashed;
+		}
+		start = now_sec();
+		for(i=0; i<STR_EVALS; ++i) {
+			if(expr_parser_execute(parser, &result, get_str_value, rows + i % STR_ROWS) == 0 && result) {
+				matched++;
+			}
+		}
+		elapsed = now_sec() - start;
+		printf("strhash	%-8s	%12.0f evals/s	matched %lu\n", hashed ? "hashed" : "plain", \
+				STR_EVALS / elapsed, (unsigned long)matched);
+		expr_parser_delete(parser);
+	}
+	free(rows);
+	free(exp_str);
+}
+
+/*
+ * 即时编译: 同一组数值过滤条件, 解释执行和机器码每秒执行的次数
+ */
+#define JIT_EVALS	4000000
+
+typedef struct jit_row_t {
+	int64_t ints[4];
+	double score;
+} jit_row_t;
+
+static int get_jit_value(int slot, expr_value_t *value, void *usrdata) {
+	jit_row_t *row = (jit_row_t *)usrdata;
+	if(slot < 4) {
+		expr_value_set_int(value, row->ints[slot]);
+	}
+	else {
+		expr_value_set_double(value, row->score);
+	}
+	return 0;
+}
+
+static void bench_jit(void) {
+	static char *exps[] = {
+		"$user > 1000000 && $status == 200",
+		"($user >= 4611686018427387904 || $region != 3) && $score > 0.75 && !($bytes < 512)",
+		"$status >= 500 || $status == 404 && $bytes > 100000 || $score < 0.01 && $region == 7"
+	};
+	static char *names[] = {"user", "status", "region", "bytes", "score"};
+	size_t k, i, v;
+
+	for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+		expr_program *prog = expr_program_new(exps[k]);
+		expr_context *ctx = expr_context_new();
+		expr_jit *jit = 0;
+		int types[5];
+		jit_row_t row;
+		int mode;
+
+		for(v=0; v<expr_program_var_count(prog); ++v) {
+			size_t slot;
+			for(slot=0; strcmp(names[slot], expr_program_var_name(prog, v)) != 0; ++slot) {}
+			expr_program_bind_var(prog, v, (int)slot);
+			types[v] = slot < 4 ? EXPR_COLUMN_INT64 : EXPR_COLUMN_DOUBLE;
+		}
+		jit = expr_jit_new(prog, types);
+		for(mode=0; mode<2; ++mode) {
+			size_t matched = 0;
+			double start, elapsed;
+			int result;
+
+			rand_state = 2463534242u;
+			start = now_sec();
+			for(i=0; i<JIT_EVALS; ++i) {
+				row.ints[0] = ((int64_t)next_rand() << 31) ^ next_rand();
+				row.ints[1] = next_rand() % 5 ? 200 : 404 + next_rand() % 200;
+				row.ints[2] = next_rand() % 8;
+				row.ints[3] = next_rand() % 200000;
+				row.score = (double)(next_rand() % 1000) / 1000;
+				if((mode ? expr_jit_execute(jit, ctx, &result, get_jit_value, &row) \
+						: expr_program_execute_slot(prog, ctx, &result, get_jit_value, &row)) == 0 && result) {
+					matched++;
+				}
+			}
+			elapsed = now_sec() - start;
+			printf("jit\texp %lu\t%-11s\t%12.0f evals/s\tmatched %lu\n", (unsigned long)k, \
+					mode ? (expr_jit_native(jit) ? "native" : "fallback") : "interpreter", \
+					JIT_EVALS / elapsed, (unsigned long)matched);
+		}
+		expr_jit_delete(jit);
+		expr_context_delete(ctx);
+		expr_program_delete(prog);
+	}
+}
+
+/*
+ * 启动: 逐条解析规则文本, 和映射保存好的映像相比
+ */
+#define IMAGE_RULES	200000
+#define IMAGE_PATH	"bench_image.img"
+
+static size_t run_rules(expr_program **progs, size_t n) {
+	expr_context *ctx = expr_context_new();
+	event_t ev;
+	size_t i, matched = 0;
+	int result;
+
+	ev.status = 404;
+	ev.method = "GET";
+	for(i=0; i<n; ++i) {
+		if(expr_program_execute(progs[i], ctx, &result, get_event_value, &ev) == 0 && result) {
+			matched++;
+		}
+	}
+	expr_context_delete(ctx);
+	return matched;
+}
+
+static void bench_image(void) {
+	static char *methods[] = {"GET", "POST", "PUT", "DELETE"};
+	char **exps = (char **)malloc(sizeof(char *) * IMAGE_RULES);
+	expr_program **progs = (expr_program **)malloc(sizeof(expr_program *) * IMAGE_RULES);
+	expr_program **loaded = (expr_program **)malloc(sizeof(expr_program *) * IMAGE_RULES);
+	expr_image *img;
+	double start, parse_sec, save_sec, open_sec;
+	size_t i, m1, m2;
+	FILE *fp;
+	long bytes;
+
+	for(i=0; i<IMAGE_RULES; ++i) {
+		exps[i] = (char *)malloc(128);
+		sprintf(exps[i], "$status == %lu && $method -se '%s' || ($status >= %lu && !($method -ce 'put'))", \
+				(unsigned long)(i % 1000), methods[i % 4], (unsigned long)(400 + i % 200));
+	}
+	start = now_sec();
+	for(i=0; i<IMAGE_RULES; ++i) {
+		progs[i] = expr_program_new(exps[i]);
+	}
+	parse_sec = now_sec() - start;
+
+	start = now_sec();
+	expr_image_save(IMAGE_PATH, progs, IMAGE_RULES);
+	save_sec = now_sec() - start;
+
+	start = now_sec();
+	img = expr_image_open(IMAGE_PATH);
+	for(i=0; i<IMAGE_RULES; ++i) {
+		loaded[i] = expr_image_program(img, i);
+	}
+	open_sec = now_sec() - start;
+
+	fp = fopen(IMAGE_PATH, "rb");
+	fseek(fp, 0, SEEK_END);
+	bytes = ftell(fp);
+	fclose(fp);
+	m1 = run_rules(progs, IMAGE_RULES);
+	m2 = run_rules(loaded, IMAGE_RULES);
+	printf("image\t%d rules\t%-6s\t%8.1f ms\n", IMAGE_RULES, "parse", parse_sec * 1000);
+	printf("image\t%d rules\t%-6s\t%8.1f ms\t%ld bytes\n", IMAGE_RULES, "save", save_sec * 1000, bytes);
+	printf("image\t%d rules\t%-6s\t%8.1f ms\t%.1fx faster\n", IMAGE_RULES, "open", open_sec * 1000, \
+			parse_sec / open_sec);
+	printf("image\tmatched %lu/%lu\n", (unsigned long)m1, (unsigned long)m2);
+
+	expr_image_close(img);
+	remove(IMAGE_PATH);
+	for(i=0; i<IMAGE_RULES; ++i) {
+		expr_program_delete(progs[i]);
+		free(exps[i]);
+	}
+	free(exps);
+	free(progs);
+	free(loaded);
+}
+
+/*
+ * expr_filter 的吞吐量: 生成日志文件, 用 ./expr_filter 过滤, 按文件大小算 MB/s.
+ * 先读一遍文件, 让数据在页缓存中, 只测过滤本身
+ */
+#define FILTER_JSON	"bench_filter.ndjson"
+#define FILTER_CSV	"bench_filter.csv"
+
+static size_t gen_filter_file(const char *path, int csv, size_t mb) {
+	static const char *methods[] = {"GET", "POST", "PUT", "DELETE", "get", "HEAD"};
+	static const char *paths[] = {"/", "/api/v1/users", "/api/v1/orders?page=2", "/static/app.js", \
+		"/login", "/api/v1/search?q=\\\"x\\\""};
+	size_t bytes = 0, limit = mb << 20, i = 0;
+	char line[512];
+	FILE *fp = fopen(path, "wb");
+	if(!fp) {
+		return 0;
+	}
+	if(csv) {
+		bytes += fprintf(fp, "id,ts,method,path,status,latency,bytes,user\n");
+	}
+	while(bytes < limit) {
+		unsigned int r = next_rand();
+		int status = r % 10 == 0 ? 500 + r % 4 : (r % 7 == 0 ? 404 : 200);
+		double latency = (double)(next_rand() % 100000) / 1000.0;
+		if(csv) {
+			sprintf(line, "%lu,%lu,%s,\"%s\",%d,%.3f,%u,user%u\n", (unsigned long)i, \
+					(unsigned long)(1700000000 + i / 100), methods[r % 6], \
+					r % 6 == 5 ? "/search?q=\"\"x\"\"" : paths[r % 5], status, latency, \
+					next_rand() % 65536, next_rand() % 1000);
+		}
+		else {
+			sprintf(line, "{\"id\": %lu, \"ts\": %lu, \"method\": \"%s\", \"path\": \"%s\", " \
+					"\"status\": %d, \"latency\": %.3f, \"bytes\": %u, \"user\": \"user%u\", " \
+					"\"tags\": [\"a\", \"b\"]}\n", (unsigned long)i, (unsigned long)(1700000000 + i / 100), \
+					methods[r % 6], paths[r % 6], status, latency, next_rand() % 65536, next_rand() % 1000);
+		}
+		bytes += fputs(line, fp) >= 0 ? strlen(line) : 0;
+		i++;
+	}
+	fclose(fp);
+	return bytes;
+}
+
+static void run_filter(const char *path, size_t bytes, const char *exp_str) {
+	char cmd[512];
+	double start, elapsed;
+	sprintf(cmd, "./expr_filter -c '%s' %s > /dev/null", exp_str, path);
+	start = now_sec();
+	if(system(cmd) < 0) {
+		printf("filter\trun failed\n");
+		return;
+	}
+	elapsed = now_sec() - start;
+	printf("filter\t%-6s\t%-58s\t%8.2f s\t%8.1f MB/s\n", strstr(path, ".csv") ? "csv" : "ndjson", \
+			exp_str, elapsed, (double)bytes / 1e6 / elapsed);
+}
+
+static void bench_filter(size_t mb) {
+	static const char *exps[] = {
+		"status >= 500",
+		"method -ce \"get\" && latency > 50 || status == 404",
+		"path -se \"/login\" && user -sne \"user1\"",
+		"bytes > 60000 && !(method -se \"POST\") && ts >= 1700001000"
+	};
+	size_t json_bytes, csv_bytes, k;
+	char cmd[256];
+	double start, elapsed;
+
+	json_bytes = gen_filter_file(FILTER_JSON, 0, mb);
+	csv_bytes = gen_filter_file(FILTER_CSV, 1, mb);
+	if(!json_bytes || !csv_bytes) {
+		printf("filter\tgenerate failed\n");
+		return;
+	}
+	sprintf(cmd, "cat %s %s > /dev/null", FILTER_JSON, FILTER_CSV);
+	if(system(cmd) < 0) {
+		return;
+	}
+	for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+		run_filter(FILTER_JSON, json_bytes, exps[k]);
+	}
+	for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+		run_filter(FILTER_CSV, csv_bytes, exps[k]);
+	}
+	start = now_sec();
+	if(system(cmd) < 0) {
+		return;
+	}
+	elapsed = now_sec() - start;
+	printf("filter\t%-6s\t%-58s\t%8.2f s\t%8.1f MB/s\n", "cat", "(read only)", elapsed, \
+			(double)(json_bytes + csv_bytes) / 1e6 / elapsed);
+	remove(FILTER_JSON);
+	remove(FILTER_CSV);
+}
+
+int main(int argc, char *argv[]) {
+	const char *which = argc > 1 ? argv[1] : "all";
+	if(strcmp(which, "all") == 0 || strcmp(which, "batch") == 0) {
+		bench_batch();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "ruleset") == 0) {
+		bench_ruleset();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "pool") == 0) {
+		bench_pool();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "parse") == 0) {
+		bench_parse();
+		bench_parse_scale();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "adaptive") == 0) {
+		bench_adaptive();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "cache") == 0) {
+		bench_cache();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "strhash") == 0) {
+		bench_strhash();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "jit") == 0) {
+		bench_jit();
+	}
+	if(strcmp(which, "all") == 0 || strcmp(which, "image") == 0) {
+		bench_image();
+	}
+	if(strcmp(which, "filter") == 0) {
+		bench_filter(argc > 2 ? (size_t)atol(argv[2]) : 2048);
+	}
+	return 0;
+}
@@ -0,0 +1,331 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 回归基准: 解析、执行和 array_t 的热点路径.
+ * 每个用例取 SAMPLES 个样本, 报告单次操作耗时的均值和分位数, 以及每次操作申请内存的次数和字节数.
+ * 输出是制表符分隔的固定列, 用例名和顺序不变, 两个版本的结果可以直接 diff 或按列比较.
+ * 用法: ./bench_suite [用例名前缀], 比如 ./bench_suite exec/
+ */
+#define _POSIX_C_SOURCE 199309L
+#include "expr_parser.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SAMPLES	1000
+
+/*
+ * 链接时用 --wrap 统计内存申请
+ */
+static size_t alloc_count = 0;
+static size_t alloc_bytes = 0;
+
+void * __real_malloc(size_t size);
+void * __real_realloc(void *p, size_t size);
+void * __real_calloc(size_t n, size_t size);
+
+void * __wrap_malloc(size_t size) {
+	alloc_count++;
+	alloc_bytes += size;
+	return __real_malloc(size);
+}
+
+void * __wrap_realloc(void *p, size_t size) {
+	alloc_count++;
+	alloc_bytes += size;
+	return __real_realloc(p, size);
+}
+
+void * __wrap_calloc(size_t n, size_t size) {
+	alloc_count++;
+	alloc_bytes += n * size;
+	return __real_calloc(n, size);
+}
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * 执行 rounds 轮, 返回完成的操作数
+ */
+typedef size_t (*case_fn)(void *arg, size_t rounds);
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static const char *filter = "";
+
+/*
+ * 预热一次, 再取样. 每个样本执行 rounds 轮, 让单个样本的耗时远大于计时的开销
+ */
+static void run_case(const char *name, case_fn fn, void *arg, size_t rounds) {
+	static double ns[SAMPLES];
+	size_t s, ops = 0, allocs, bytes;
+	double total = 0;
+
+	if(strncmp(name, filter, strlen(filter)) != 0) {
+		return;
+	}
+	fn(arg, rounds);
+	allocs = alloc_count;
+	bytes = alloc_bytes;
+	for(s=0; s<SAMPLES; ++s) {
+		double start = now_sec();
+		size_t n = fn(arg, rounds);
+		double elapsed = (now_sec() - start) * 1e9;
+		ns[s] = elapsed / (double)n;
+		total += elapsed;
+		ops += n;
+	}
+	allocs = alloc_count - allocs;
+	bytes = alloc_bytes - bytes;
+	qsort(ns, SAMPLES, sizeof(double), cmp_double);
+	printf("%s\t%lu\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.3f\t%.1f\n", name, (unsigned long)ops, \
+			total / (double)ops, ns[SAMPLES / 2], ns[SAMPLES * 9 / 10], ns[SAMPLES * 99 / 100], \
+			ns[SAMPLES - 1], (double)allocs / (double)ops, (double)bytes / (double)ops);
+}
+
+/*
+ * 解析: 同一个解析器反复解析, 内存池和栈被复用
+ */
+typedef struct parse_arg {
+	expr_parser *parser;
+	char *exp_str;
+} parse_arg;
+
+static size_t parse_fn(void *arg, size_t rounds) {
+	parse_arg *a = (parse_arg *)arg;
+	size_t r;
+	for(r=0; r<rounds; ++r) {
+		if(expr_parser_parse(a->parser, a->exp_str) < 0) {
+			fprintf(stderr, "parse failed: %s\n", a->exp_str);
+			exit(1);
+		}
+	}
+	return rounds;
+}
+
+static char * gen_long(size_t terms) {
+	char *buf = (char *)malloc(terms * 32 + 1), *p = buf;
+	size_t i;
+	*p = '\0';
+	for(i=0; i<terms; ++i) {
+		if(i) {
+			p += sprintf(p, i%2 ? " && " : " || ");
+		}
+		switch(i%4) {
+		case 0: p += sprintf(p, "$v%lu == %lu", (unsigned long)i, (unsigned long)i); break;
+		case 1: p += sprintf(p, "$s%lu -se 'abc'", (unsigned long)i); break;
+		case 2: p += sprintf(p, "!($d%lu >= 1.5)", (unsigned long)i); break;
+		default: p += sprintf(p, "$c%lu -cne 'X'", (unsigned long)i); break;
+		}
+	}
+	return buf;
+}
+
+/*
+ * deep: 每一项都套一层括号; wide: 一条很长的 || 链, 只有一个变量
+ */
+static char * gen_shape(size_t terms, int deep) {
+	char *buf = (char *)malloc(terms * 24 + 1), *p = buf;
+	size_t i;
+	for(i=0; i<terms; ++i) {
+		p += sprintf(p, "%s$id == %lu", i ? (deep ? " || (" : " || ") : "", (unsigned long)i);
+	}
+	for(i=1; deep && i<terms; ++i) {
+		*p++ = ')';
+	}
+	*p = '\0';
+	return buf;
+}
+
+static void suite_parse(void) {
+	static const char *names[] = {"parse/short", "parse/long", "parse/deep", "parse/wide"};
+	static const size_t rounds[] = {64, 2, 2, 1};
+	char *exps[4];
+	parse_arg arg;
+	size_t k;
+
+	exps[0] = gen_long(3);
+	exps[1] = gen_long(200);
+	exps[2] = gen_shape(500, 1);
+	exps[3] = gen_shape(2000, 0);
+	arg.parser = expr_parser_new();
+	for(k=0; k<4; ++k) {
+		arg.exp_str = exps[k];
+		run_case(names[k], parse_fn, &arg, rounds[k]);
+		free(exps[k]);
+	}
+	expr_parser_delete(arg.parser);
+}
+
+/*
+ * 执行: 按变量名取值, 取值函数和一般的调用方一样逐个比较变量名
+ */
+typedef struct exec_arg {
+	expr_parser *parser;
+	expr_value_getter getter;
+	size_t row;
+} exec_arg;
+
+static const int64_t ints[8] = {5, 50, 500, 12, 99, 7, 1000, 64};
+static const double doubles[8] = {0.25, 1.5, 3.75, 0.5, 2.0, 9.5, 0.75, 1.25};
+static const char *strs[8] = {"GET", "POST", "get", "DELETE", "PUT", "Get", "HEAD", "OPTIONS"};
+
+static int get_int(char *varname, expr_value_t *value, void *usrdata) {
+	size_t row = ((exec_arg *)usrdata)->row;
+	if(strcmp(varname, "a") == 0) { expr_value_set_int(value, ints[row & 7]); return 0; }
+	if(strcmp(varname, "b") == 0) { expr_value_set_int(value, ints[(row + 3) & 7]); return 0; }
+	return -1;
+}
+
+static int get_double(char *varname, expr_value_t *value, void *usrdata) {
+	size_t row = ((exec_arg *)usrdata)->row;
+	if(strcmp(varname, "x") == 0) { expr_value_set_double(value, doubles[row & 7]); return 0; }
+	if(strcmp(varname, "y") == 0) { expr_value_set_double(value, doubles[(row + 3) & 7]); return 0; }
+	return -1;
+}
+
+static int get_str(char *varname, expr_value_t *value, void *usrdata) {
+	size_t row = ((exec_arg *)usrdata)->row;
+	const char *s;
+	if(strcmp(varname, "s") == 0) { s = strs[row & 7]; }
+	else if(strcmp(varname, "t") == 0) { s = strs[(row + 3) & 7]; }
+	else { return -1; }
+	expr_value_set_str_ref(value, s, strlen(s));
+	return 0;
+}
+
+static int get_mixed(char *varname, expr_value_t *value, void *usrdata) {
+	if(get_int(varname, value, usrdata) == 0 || get_double(varname, value, usrdata) == 0) {
+		return 0;
+	}
+	return get_str(varname, value, usrdata);
+}
+
+static size_t exec_fn(void *arg, size_t rounds) {
+	exec_arg *a = (exec_arg *)arg;
+	size_t r;
+	int result;
+	for(r=0; r<rounds; ++r) {
+		a->row++;
+		if(expr_parser_execute(a->parser, &result, a->getter, a) < 0) {
+			fprintf(stderr, "execute failed\n");
+			exit(1);
+		}
+	}
+	return rounds;
+}
+
+static void suite_exec(void) {
+	static const char *names[] = {"exec/int", "exec/double", "exec/str", "exec/mixed"};
+	static char *exps[] = {
+		"$a > 10 && $b < 100 || $a == 7",
+		"$x > 0.5 && $y <= 2.5 || $x == 9.5",
+		"$s -se 'GET' || $t -ce 'post' && $s -sne 'HEAD'",
+		"$a > 10 && $x < 2.5 || $s -ce 'get' && $b != 64"
+	};
+	static const expr_value_getter getters[] = {get_int, get_double, get_str, get_mixed};
+	exec_arg arg;
+	size_t k;
+
+	for(k=0; k<4; ++k) {
+		arg.parser = expr_parser_new();
+		arg.getter = getters[k];
+		arg.row = 0;
+		if(expr_parser_parse(arg.parser, exps[k]) < 0) {
+			fprintf(stderr, "parse failed: %s\n", exps[k]);
+			exit(1);
+		}
+		run_case(names[k], exec_fn, &arg, 256);
+		expr_parser_delete(arg.parser);
+	}
+}
+
+/*
+ * array_t: push 从空数组逐个追加到 size 个元素(含增长和释放);
+ * insert/erase 在 size 个元素的中间插入或删除, 再从末尾删除或追加, 保持大小不变
+ */
+typedef struct array_arg {
+	array_t arr;
+	size_t size;
+} array_arg;
+
+static size_t array_push_fn(void *arg, size_t rounds) {
+	array_arg *a = (array_arg *)arg;
+	size_t r, i;
+	for(r=0; r<rounds; ++r) {
+		array_t arr;
+		array_init(&arr, sizeof(int64_t));
+		for(i=0; i<a->size; ++i) {
+			int64_t v = (int64_t)i;
+			array_push_back(&arr, &v);
+		}
+		array_uinit(&arr);
+	}
+	return rounds * a->size;
+}
+
+static size_t array_insert_fn(void *arg, size_t rounds) {
+	array_arg *a = (array_arg *)arg;
+	size_t r;
+	for(r=0; r<rounds; ++r) {
+		int64_t v = (int64_t)r;
+		array_insert(&a->arr, &v, a->size / 2);
+		array_pop_back(&a->arr);
+	}
+	return rounds;
+}
+
+static size_t array_erase_fn(void *arg, size_t rounds) {
+	array_arg *a = (array_arg *)arg;
+	size_t r;
+	for(r=0; r<rounds; ++r) {
+		int64_t v = (int64_t)r;
+		array_erase(&a->arr, a->size / 2);
+		array_push_back(&a->arr, &v);
+	}
+	return rounds;
+}
+
+static void suite_array(void) {
+	static const size_t sizes[] = {16, 1024, 65536};
+	char name[64];
+	array_arg arg;
+	size_t k, i;
+
+	for(k=0; k<sizeof(sizes)/sizeof(sizes[0]); ++k) {
+		arg.size = sizes[k];
+		sprintf(name, "array/push/%lu", (unsigned long)sizes[k]);
+		run_case(name, array_push_fn, &arg, sizes[k] < 1024 ? 64 : 1);
+
+		array_init(&arg.arr, sizeof(int64_t));
+		for(i=0; i<sizes[k]; ++i) {
+			int64_t v = (int64_t)i;
+			array_push_back(&arg.arr, &v);
+		}
+		sprintf(name, "array/insert/%lu", (unsigned long)sizes[k]);
+		run_case(name, array_insert_fn, &arg, sizes[k] < 1024 ? 64 : 1);
+		sprintf(name, "array/erase/%lu", (unsigned long)sizes[k]);
+		run_case(name, array_erase_fn, &arg, sizes[k] < 1024 ? 64 : 1);
+		array_uinit(&arg.arr);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if(argc > 1) {
+		filter = argv[1];
+	}
+	printf("# case\tops\tmean_ns\tp50_ns\tp90_ns\tp99_ns\tmax_ns\tallocs_per_op\tbytes_per_op\n");
+	suite_parse();
+	suite_exec();
+	suite_array();
+	return 0;
+}
@@ -2,11 +2,51 @@
 
 if [[ $1 == clean ]] 
 then
-rm -rf *.o test test_array
+rm -rf *.o test test_array test_ruleset test_thread test_pool test_cache test_jit test_image test_metrics bench bench_suite expr_filter test_filter
+exit
+fi
+
+if [[ $1 == bench ]]
+then
+gcc -O2 -pedantic -std=c89 -pthread bench.c array.c expr_parser.c expr_batch.c expr_simd.c expr_adapt.c \
+	expr_ruleset.c expr_pool.c expr_cache.c expr_jit.c expr_image.c -o bench
+gcc -O2 -pedantic -std=c89 -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc bench_suite.c array.c expr_parser.c \
+	expr_batch.c expr_simd.c expr_adapt.c -o bench_suite
+gcc -O2 -pedantic -std=c89 expr_filter.c array.c expr_parser.c expr_batch.c expr_simd.c expr_adapt.c -o expr_filter
+exit
+fi
+
+if [[ $1 == tsan ]]
+then
+gcc -g -O1 -fsanitize=thread -pedantic -std=c89 -pthread test_thread.c array.c expr_parser.c \
+	expr_batch.c expr_simd.c expr_adapt.c -o test_thread
+gcc -g -O1 -fsanitize=thread -pedantic -std=c89 -pthread test_pool.c array.c expr_parser.c \
+	expr_batch.c expr_simd.c expr_adapt.c expr_pool.c -o test_pool
+gcc -g -O1 -fsanitize=thread -pedantic -std=c89 -pthread test_cache.c array.c expr_parser.c \
+	expr_batch.c expr_simd.c expr_adapt.c expr_cache.c -o test_cache
 exit
 fi
 
 gcc -pedantic -std=c89 -c array.c -o array.o
 gcc -pedantic -std=c89 -c expr_parser.c -o expr_parser.o			
-gcc -pedantic -std=c89 test.c array.o expr_parser.o -o test
+gcc -pedantic -std=c89 -c expr_batch.c -o expr_batch.o
+gcc -pedantic -std=c89 -c expr_simd.c -o expr_simd.o
+gcc -pedantic -std=c89 -c expr_adapt.c -o expr_adapt.o
+gcc -pedantic -std=c89 -Wl,--wrap=malloc,--wrap=realloc test.c array.o expr_parser.o expr_batch.o \
+	expr_simd.o expr_adapt.o -o test
+gcc -pedantic -std=c89 -DEXPR_METRICS -Wl,--wrap=malloc,--wrap=realloc test.c array.c expr_parser.c expr_batch.c \
+	expr_simd.c expr_adapt.c -o test_metrics
+gcc -pedantic -std=c89 -c expr_ruleset.c -o expr_ruleset.o
 gcc -pedantic -std=c89 test_array.c array.o -o test_array
+gcc -pedantic -std=c89 test_ruleset.c array.o expr_parser.o expr_batch.o expr_simd.o expr_adapt.o expr_ruleset.o -o test_ruleset
+gcc -pedantic -std=c89 -pthread test_thread.c array.o expr_parser.o expr_batch.o expr_simd.o expr_adapt.o -o test_thread
+gcc -pedantic -std=c89 -pthread -c expr_pool.c -o expr_pool.o
+gcc -pedantic -std=c89 -pthread test_pool.c array.o expr_parser.o expr_batch.o expr_simd.o expr_adapt.o expr_pool.o -o test_pool
+gcc -pedantic -std=c89 -pthread -c expr_cache.c -o expr_cache.o
+gcc -pedantic -std=c89 -pthread test_cache.c array.o expr_parser.o expr_batch.o expr_simd.o expr_adapt.o expr_cache.o -o test_cache
+gcc -pedantic -std=c89 -c expr_jit.c -o expr_jit.o
+gcc -pedantic -std=c89 test_jit.c array.o expr_parser.o expr_batch.o expr_simd.o expr_adapt.o expr_jit.o -o test_jit
+gcc -pedantic -std=c89 -c expr_image.c -o expr_image.o
+gcc -pedantic -std=c89 test_image.c array.o expr_parser.o expr_batch.o expr_simd.o expr_adapt.o expr_image.o -o test_image
+gcc -pedantic -std=c89 expr_filter.c array.o expr_parser.o expr_batch.o expr_simd.o expr_adapt.o -o expr_filter
+gcc -pedantic -std=c89 test_filter.c -o test_filter
@@ -0,0 +1,319 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 自适应求值顺序: 把连续的同一种 && 或 || 看作一条链, 按统计重排链上的操作数.
+ * 操作数用它在表达式中的偏移标识, 顺序可以导出成字符串, 下次启动时恢复.
+ */
+#include "expr_inner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <stdio.h>
+
+/*
+ * 链上的一个操作数
+ */
+typedef struct _chain_op_t {
+	expr_node_t * node;
+	size_t chain;		/* 所在链的下标 */
+	size_t pos;			/* 在链中原来的位置, 排序时保持稳定 */
+	size_t stat;		/* 挂在哪个 && 或 || 下面, 以及左右 */
+	int side;
+	double rank;
+} chain_op_t;
+
+typedef struct _chain_t {
+	size_t first_op;	/* 操作数在 ops 中的起始下标 */
+	size_t nops;
+	size_t first_inner;	/* 内部节点在 inner 中的起始下标, 共 nops-1 个, 第一个是链的根 */
+} chain_t;
+
+typedef struct _chains_t {
+	array_t chains;		/* chain_t */
+	array_t ops;		/* chain_op_t */
+	array_t inner;		/* expr_node_t * */
+	array_t todo;		/* expr_node_t *, 待查找链的子树 */
+	array_t work;		/* chain_op_t, 展开链用的栈 */
+} chains_t;
+
+ARRAY_DEFINE(chain_t, chain)
+ARRAY_DEFINE(chain_op_t, chain_op)
+ARRAY_DEFINE(expr_node_t *, node)
+
+static int _is_logic(expr_node_t *node) {
+	return _NODE_TYPE_OPER == node->type && \
+		(_OPER_AND == node->u.oper || _OPER_OR == node->u.oper);
+}
+
+static void _chains_init(chains_t *c) {
+	chain_array_init(&c->chains);
+	chain_op_array_init(&c->ops);
+	node_array_init(&c->inner);
+	node_array_init(&c->todo);
+	chain_op_array_init(&c->work);
+}
+
+static void _chains_uinit(chains_t *c) {
+	array_uinit(&c->chains);
+	array_uinit(&c->ops);
+	array_uinit(&c->inner);
+	array_uinit(&c->todo);
+	array_uinit(&c->work);
+}
+
+/*
+ * 把以 root 为根的链展开, 操作数按从左到右的顺序追加到 ops
+ */
+static int _flatten(chains_t *c, expr_node_t *root) {
+	chain_t chain;
+	chain_op_t item;
+	int oper = root->u.oper;
+
+	chain.first_op = array_size(&c->ops);
+	chain.first_inner = array_size(&c->inner);
+	memset(&item, 0x00, sizeof(item));
+	item.node = root;
+	array_clear(&c->work);
+	if(chain_op_array_push_back(&c->work, item) < 0) { return -1; }
+	while(array_size(&c->work) > 0) {
+		item = ((chain_op_t *)c->work._data)[array_size(&c->work) - 1];
+		array_pop_back(&c->work);
+		if(_NODE_TYPE_OPER == item.node->type && oper == item.node->u.oper) {
+			chain_op_t child;
+			expr_node_t *node = item.node;
+			if(node_array_push_back(&c->inner, node) < 0) { return -1; }
+			memset(&child, 0x00, sizeof(child));
+			child.stat = node->stat;
+			child.node = node->right;
+			child.side = 1;
+			if(chain_op_array_push_back(&c->work, child) < 0) { return -1; }
+			child.node = node->left;
+			child.side = 0;
+			if(chain_op_array_push_back(&c->work, child) < 0) { return -1; }
+		}
+		else {
+			item.chain = array_size(&c->chains);
+			item.pos = array_size(&c->ops) - chain.first_op;
+			if(chain_op_array_push_back(&c->ops, item) < 0) { return -1; }
+			if(node_array_push_back(&c->todo, item.node) < 0) { return -1; }
+		}
+	}
+	chain.nops = array_size(&c->ops) - chain.first_op;
+	return chain_array_push_back(&c->chains, chain);
+}
+
+/*
+ * 找出语法树中所有的链, 链的操作数里还可以有别的链
+ */
+static int _collect(chains_t *c, expr_node_t *root) {
+	array_clear(&c->todo);
+	if(node_array_push_back(&c->todo, root) < 0) { return -1; }
+	while(array_size(&c->todo) > 0) {
+		expr_node_t *node = ((expr_node_t **)c->todo._data)[array_size(&c->todo) - 1];
+		array_pop_back(&c->todo);
+		if(_is_logic(node)) {
+			if(_flatten(c, node) < 0) { return -1; }
+			continue;
+		}
+		if(node->left && node_array_push_back(&c->todo, node->left) < 0) { return -1; }
+		if(node->right && node_array_push_back(&c->todo, node->right) < 0) { return -1; }
+	}
+	return 0;
+}
+
+/*
+ * 按 ops 中的新顺序重新连接链, 链的根节点不变, 重建为左深的树
+ */
+static void _relink(chains_t *c, chain_t *chain) {
+	chain_op_t *ops = (chain_op_t *)c->ops._data + chain->first_op;
+	expr_node_t **inner = (expr_node_t **)c->inner._data + chain->first_inner;
+	size_t k, n = chain->nops;
+	for(k=0; k+1<n; ++k) {
+		inner[k]->right = ops[n-1-k].node;
+		inner[k]->left = k+2 < n ? inner[k+1] : ops[0].node;
+	}
+}
+
+static int _cmp_rank(const void *a, const void *b) {
+	const chain_op_t *x = (const chain_op_t *)a, *y = (const chain_op_t *)b;
+	if(x->rank != y->rank) {
+		return x->rank < y->rank ? -1 : 1;
+	}
+	return x->pos < y->pos ? -1 : (x->pos > y->pos ? 1 : 0);
+}
+
+static int _cmp_offset(const void *a, const void *b) {
+	const chain_op_t *x = (const chain_op_t *)a, *y = (const chain_op_t *)b;
+	return x->node->offset < y->node->offset ? -1 : (x->node->offset > y->node->offset ? 1 : 0);
+}
+
+/*
+ * 先执行 代价/单独决定结果的概率 最小的操作数. 概率做加一平滑, 没执行过的按1/2算.
+ * 右边的统计只在左边没有短路时才有, 是条件概率.
+ */
+int _reorder_chains(expr_program *prog, const logic_stat_t *stats) {
+	chains_t c;
+	size_t i;
+	int ret = -1;
+
+	if(!prog->root) {
+		return -1;
+	}
+	_chains_init(&c);
+	if(_collect(&c, prog->root) < 0) {
+		goto RET;
+	}
+	for(i=0; i<array_size(&c.ops); ++i) {
+		chain_op_t *op = (chain_op_t *)c.ops._data + i;
+		const logic_stat_t *stat = stats + op->stat;
+		double p = (double)(stat->decides[op->side] + 1) / (double)(stat->evals[op->side] + 2);
+		op->rank = (double)op->node->cost / p;
+	}
+	for(i=0; i<array_size(&c.chains); ++i) {
+		chain_t *chain = (chain_t *)c.chains._data + i;
+		qsort((chain_op_t *)c.ops._data + chain->first_op, chain->nops, sizeof(chain_op_t), _cmp_rank);
+		_relink(&c, chain);
+	}
+	ret = 0;
+RET:
+	_chains_uinit(&c);
+	return ret;
+}
+
+static void _put_str(char *buf, size_t size, size_t *len, const char *str) {
+	for( ; *str; ++str, ++*len) {
+		if(*len + 1 < size) {
+			buf[*len] = *str;
+		}
+	}
+}
+
+size_t expr_program_get_order(const expr_program *prog, char *buf, size_t size) {
+	chains_t c;
+	size_t i, k, len = 0;
+	char num[32];
+
+	_chains_init(&c);
+	if(prog && prog->root && _collect(&c, prog->root) == 0) {
+		for(i=0; i<array_size(&c.chains); ++i) {
+			chain_t *chain = (chain_t *)c.chains._data + i;
+			chain_op_t *ops = (chain_op_t *)c.ops._data + chain->first_op;
+			if(i) {
+				_put_str(buf, size, &len, ";");
+			}
+			for(k=0; k<chain->nops; ++k) {
+				sprintf(num, k ? ",%lu" : "%lu", (unsigned long)ops[k].node->offset);
+				_put_str(buf, size, &len, num);
+			}
+		}
+	}
+	if(size > 0) {
+		buf[len < size ? len : size - 1] = '\0';
+	}
+	_chains_uinit(&c);
+	return len;
+}
+
+/*
+ * 解析一组偏移, 每个都在按偏移排好序的 sorted 中查找, 必须正好是同一条链的全部操作数.
+ * apply 为0时只检查并做标记, 为1时把链的操作数按组里的顺序排列
+ */
+static int _match_group(chains_t *c, chain_op_t *sorted, const char **p, int apply) {
+	chain_t *chain = 0;
+	chain_op_t *ops = 0;
+	size_t n = 0, nops = array_size(&c->ops);
+	const char *s = *p;
+
+	for(;;) {
+		chain_op_t key, *found;
+		expr_node_t node;
+		char *end = 0;
+		unsigned long offset = strtoul(s, &end, 10);
+		if(end == s) {
+			return -1;
+		}
+		s = end;
+		node.offset = offset;
+		key.node = &node;
+		found = (chain_op_t *)bsearch(&key, sorted, nops, sizeof(chain_op_t), _cmp_offset);
+		if(!found || (chain && found->chain != (size_t)(chain - (chain_t *)c->chains._data))) {
+			return -1;
+		}
+		if(!chain) {
+			chain = (chain_t *)c->chains._data + found->chain;
+			ops = (chain_op_t *)c->ops._data + chain->first_op;
+		}
+		if(n >= chain->nops) {
+			return -1;
+		}
+		if(apply) {
+			ops[n] = *found;
+		}
+		else {
+			if(found->rank < 0) {
+				return -1;		/* 重复的偏移, 或者同一条链出现两次 */
+			}
+			found->rank = -1;
+		}
+		n++;
+		if(*s != ',') {
+			break;
+		}
+		s++;
+	}
+	if(n != chain->nops || (*s != ';' && *s != '\0')) {
+		return -1;
+	}
+	if(apply) {
+		_relink(c, chain);
+	}
+	*p = *s ? s + 1 : s;
+	return 0;
+}
+
+int expr_program_set_order(expr_program *prog, const char *order) {
+	chains_t c;
+	chain_op_t *sorted = 0;
+	const char *p;
+	size_t nops;
+	int ret = -1;
+
+	if(!prog || !prog->root || !order) {
+		return -1;
+	}
+	_chains_init(&c);
+	if(_collect(&c, prog->root) < 0) {
+		goto RET;
+	}
+	nops = array_size(&c.ops);
+	sorted = (chain_op_t *)malloc(sizeof(chain_op_t) * (nops ? nops : 1));
+	if(!sorted) {
+		goto RET;
+	}
+	memcpy(sorted, c.ops._data, sizeof(chain_op_t) * nops);
+	qsort(sorted, nops, sizeof(chain_op_t), _cmp_offset);
+
+	/* 全部检查通过后才修改语法树 */
+	for(p=order; *p; ) {
+		if(_match_group(&c, sorted, &p, 0) < 0) { goto RET; }
+	}
+	for(p=order; *p; ) {
+		_match_group(&c, sorted, &p, 1);
+	}
+	ret = _program_recompile(prog, 0);
+RET:
+	if(sorted) {
+		free(sorted);
+	}
+	_chains_uinit(&c);
+	return ret;
+}
+
+size_t expr_parser_get_order(expr_parser *parser, char *buf, size_t size) {
+	return expr_program_get_order(parser ? &parser->_prog : 0, buf, size);
+}
+
+int expr_parser_set_order(expr_parser *parser, const char *order) {
+	return parser ? expr_program_set_order(&parser->_prog, order) : -1;
+}
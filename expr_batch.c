@@ -0,0 +1,503 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 列式批量执行: 每条指令一次处理一块行, 结果是按位的掩码.
+ */
+#include "expr_inner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <assert.h>
+
+#define _CHUNK_ROWS		1024				/* 每块的行数, 必须是64的倍数 */
+#define _CHUNK_WORDS	(_CHUNK_ROWS/64)
+#define _EXACT_I64		((int64_t)1 << 53)	/* 绝对值不超过它的整数可以精确转成浮点 */
+
+/*
+ * 批量值的种类
+ */
+#define _BV_CONST	0	/* 常量, 对整块相同 */
+#define _BV_COLUMN	1	/* 输入列 */
+#define _BV_MASK	2	/* 运算结果, 每行一位 */
+
+typedef struct _batch_value_t {
+	int kind;
+	expr_value_t value;			/* _BV_CONST */
+	const expr_column_t * col;	/* _BV_COLUMN */
+	uint64_t * mask;			/* _BV_MASK, 指向该栈位自带的缓冲 */
+} batch_value_t;
+
+/*
+ * 数值参数的统一视图, 数组为0时表示常量
+ */
+typedef struct _num_view_t {
+	int is_double;
+	const int64_t * i;
+	const double * d;
+	int64_t ci;
+	double cd;
+} num_view_t;
+
+/*
+ * 字符串参数的统一视图, offsets为0时表示常量
+ */
+typedef struct _str_view_t {
+	const size_t * offsets;
+	const char * data;
+	const char * p;
+	size_t len;
+} str_view_t;
+
+typedef struct _batch_ctx_t {
+	const expr_column_t * columns;
+	size_t ncolumns;
+	size_t row0;			/* 当前块的起始行 */
+	size_t n;				/* 当前块的行数 */
+	int simd;				/* 使用的SIMD级别 */
+	int64_t * itmp[2];		/* 左右参数的转换缓冲 */
+	expr_error_t * err;		/* 出错时记到这里, 可以为空 */
+} batch_ctx_t;
+
+#define _CMP_LOOP(EXPR) \
+	for(w=0; w*64<n; ++w) { \
+		uint64_t bits = 0; \
+		size_t j, base = w*64, cnt = n-base < 64 ? n-base : 64; \
+		for(j=0; j<cnt; ++j) { bits |= (uint64_t)(EXPR) << j; } \
+		mask[w] = bits; \
+	}
+
+#define _CMP_SWITCH(LV, RV) \
+	switch(op) { \
+	case _OPER_EQ: _CMP_LOOP(LV == RV) break; \
+	case _OPER_NE: _CMP_LOOP(LV != RV) break; \
+	case _OPER_LT: _CMP_LOOP(LV < RV) break; \
+	case _OPER_LE: _CMP_LOOP(LV <= RV) break; \
+	case _OPER_GT: _CMP_LOOP(LV > RV) break; \
+	case _OPER_GE: _CMP_LOOP(LV >= RV) break; \
+	}
+
+static void _cmp_i64_aa(int op, const int64_t *l, const int64_t *r, size_t n, uint64_t *mask) {
+	size_t w;
+	_CMP_SWITCH(l[base+j], r[base+j])
+}
+
+static void _cmp_i64_ac(int op, const int64_t *l, int64_t c, size_t n, uint64_t *mask) {
+	size_t w;
+	_CMP_SWITCH(l[base+j], c)
+}
+
+static void _cmp_f64_aa(int op, const double *l, const double *r, size_t n, uint64_t *mask) {
+	size_t w;
+	_CMP_SWITCH(l[base+j], r[base+j])
+}
+
+static void _cmp_f64_ac(int op, const double *l, double c, size_t n, uint64_t *mask) {
+	size_t w;
+	_CMP_SWITCH(l[base+j], c)
+}
+
+static void _fill_mask(uint64_t *mask, size_t n, int bit) {
+	memset(mask, bit ? 0xff : 0x00, sizeof(uint64_t) * ((n+63)/64));
+}
+
+/*
+ * 常量在左边时交换左右参数
+ */
+static int _flip_oper(int op) {
+	switch(op) {
+	case _OPER_LT: return _OPER_GT;
+	case _OPER_LE: return _OPER_GE;
+	case _OPER_GT: return _OPER_LT;
+	case _OPER_GE: return _OPER_LE;
+	}
+	return op;
+}
+
+static int _cmp_const(int op, num_view_t *l, num_view_t *r) {
+	if(l->is_double) {
+		switch(op) {
+		case _OPER_EQ: return l->cd == r->cd;
+		case _OPER_NE: return l->cd != r->cd;
+		case _OPER_LT: return l->cd < r->cd;
+		case _OPER_LE: return l->cd <= r->cd;
+		case _OPER_GT: return l->cd > r->cd;
+		case _OPER_GE: return l->cd >= r->cd;
+		}
+	}
+	else {
+		switch(op) {
+		case _OPER_EQ: return l->ci == r->ci;
+		case _OPER_NE: return l->ci != r->ci;
+		case _OPER_LT: return l->ci < r->ci;
+		case _OPER_LE: return l->ci <= r->ci;
+		case _OPER_GT: return l->ci > r->ci;
+		case _OPER_GE: return l->ci >= r->ci;
+		}
+	}
+	return 0;
+}
+
+static void _compare(int simd, int op, num_view_t *l, num_view_t *r, size_t n, uint64_t *mask) {
+	size_t done = 0;
+	num_view_t *t = 0;
+	int is_const_l = l->is_double ? !l->d : !l->i;
+	int is_const_r = r->is_double ? !r->d : !r->i;
+	if(is_const_l && is_const_r) {
+		_fill_mask(mask, n, _cmp_const(op, l, r));
+		return;
+	}
+	if(is_const_l) {
+		t = l; l = r; r = t;
+		op = _flip_oper(op);
+		is_const_r = 1;
+	}
+	/* 先用向量内核处理整字部分, 剩余的行走标量 */
+	if(l->is_double) {
+		if(is_const_r) {
+			done = _simd_cmp_f64_ac(simd, op, l->d, r->cd, n, mask);
+			_cmp_f64_ac(op, l->d + done, r->cd, n - done, mask + done/64);
+		}
+		else {
+			done = _simd_cmp_f64_aa(simd, op, l->d, r->d, n, mask);
+			_cmp_f64_aa(op, l->d + done, r->d + done, n - done, mask + done/64);
+		}
+	}
+	else {
+		if(is_const_r) {
+			done = _simd_cmp_i64_ac(simd, op, l->i, r->ci, n, mask);
+			_cmp_i64_ac(op, l->i + done, r->ci, n - done, mask + done/64);
+		}
+		else {
+			done = _simd_cmp_i64_aa(simd, op, l->i, r->i, n, mask);
+			_cmp_i64_aa(op, l->i + done, r->i + done, n - done, mask + done/64);
+		}
+	}
+}
+
+/*
+ * 取数值视图, side 为 0/1 表示左/右参数, 用于选择转换缓冲
+ */
+static int _num_view(batch_ctx_t *ctx, batch_value_t *bv, int side, num_view_t *view) {
+	size_t i;
+	memset(view, 0x00, sizeof(*view));
+	if(_BV_CONST == bv->kind) {
+		if(_DATA_TYPE_INT == bv->value.type) {
+			view->ci = bv->value.u.n;
+		}
+		else if(_DATA_TYPE_DOUBLE == bv->value.type) {
+			view->is_double = 1;
+			view->cd = bv->value.u.d;
+		}
+		else {
+			return -1;
+		}
+	}
+	else if(_BV_COLUMN == bv->kind) {
+		if(EXPR_COLUMN_INT64 == bv->col->type) {
+			view->i = bv->col->i64 + ctx->row0;
+		}
+		else if(EXPR_COLUMN_DOUBLE == bv->col->type) {
+			view->is_double = 1;
+			view->d = bv->col->f64 + ctx->row0;
+		}
+		else {
+			return -1;
+		}
+	}
+	else {
+		int64_t *tmp = ctx->itmp[side];
+		for(i=0; i<ctx->n; ++i) {
+			tmp[i] = (int64_t)((bv->mask[i>>6] >> (i&63)) & 1);
+		}
+		view->i = tmp;
+	}
+	return 0;
+}
+
+/*
+ * 整数和浮点数混合比较, 不把整数转成浮点.
+ * 浮点常量化成整数比较仍走向量内核, 能精确表示的整数常量转成浮点, 其余逐行比较.
+ */
+static void _compare_mixed(batch_ctx_t *ctx, int op, num_view_t *l, num_view_t *r, uint64_t *mask) {
+	num_view_t *t = 0;
+	size_t i;
+	if(l->is_double) {
+		t = l; l = r; r = t;
+		op = _flip_oper(op);
+	}
+	if(!r->d) {
+		num_view_t c;
+		int op2 = op, k;
+		memset(&c, 0x00, sizeof(c));
+		k = _i64_f64_bound(op, r->cd, &op2, &c.ci);
+		if(k) {
+			_fill_mask(mask, ctx->n, 1 == k);
+			return;
+		}
+		_compare(ctx->simd, op2, l, &c, ctx->n, mask);
+		return;
+	}
+	if(!l->i && l->ci >= -_EXACT_I64 && l->ci <= _EXACT_I64) {
+		l->is_double = 1;
+		l->cd = (double)l->ci;
+		_compare(ctx->simd, op, l, r, ctx->n, mask);
+		return;
+	}
+	memset(mask, 0x00, sizeof(uint64_t) * ((ctx->n+63)/64));
+	for(i=0; i<ctx->n; ++i) {
+		if(_cmp_result(op, _cmp_i64_f64(l->i ? l->i[i] : l->ci, r->d[i]))) {
+			mask[i>>6] |= (uint64_t)1 << (i&63);
+		}
+	}
+}
+
+/*
+ * 把栈上的值转换成真值掩码, 写入该栈位自带的缓冲
+ */
+static int _to_mask(batch_ctx_t *ctx, batch_value_t *bv) {
+	num_view_t val, zero;
+	if(_BV_MASK == bv->kind) {
+		return 0;
+	}
+	if(_num_view(ctx, bv, 0, &val) < 0) {
+		return -1;
+	}
+	memset(&zero, 0x00, sizeof(zero));
+	zero.is_double = val.is_double;
+	_compare(ctx->simd, _OPER_NE, &val, &zero, ctx->n, bv->mask);
+	bv->kind = _BV_MASK;
+	return 0;
+}
+
+static int _str_view(batch_ctx_t *ctx, batch_value_t *bv, str_view_t *view) {
+	memset(view, 0x00, sizeof(*view));
+	if(_BV_CONST == bv->kind && _DATA_TYPE_STR == bv->value.type) {
+		view->p = bv->value.u.p;
+		view->len = bv->value.len;
+		return 0;
+	}
+	if(_BV_COLUMN == bv->kind && EXPR_COLUMN_STR == bv->col->type) {
+		view->offsets = bv->col->offsets + ctx->row0;
+		view->data = bv->col->data;
+		return 0;
+	}
+	return -1;
+}
+
+static void _compare_str(expr_inst_t *inst, str_view_t *l, str_view_t *r, size_t n, uint64_t *mask) {
+	size_t i;
+	int op = inst->op;
+	int mode = (_OPER_CE == op || _OPER_CNE == op) ? (_STR_NOCASE | inst->folded) : _STR_CASE;
+	int negate = (_OPER_SNE == op || _OPER_CNE == op);
+	if(!l->offsets && !r->offsets) {
+		_fill_mask(mask, n, _str_equal(l->p, l->len, r->p, r->len, mode) != negate);
+		return;
+	}
+	memset(mask, 0x00, sizeof(uint64_t) * ((n+63)/64));
+	for(i=0; i<n; ++i) {
+		const char *lp = l->p, *rp = r->p;
+		size_t ll = l->len, rl = r->len;
+		if(l->offsets) {
+			lp = l->data + l->offsets[i];
+			ll = l->offsets[i+1] - l->offsets[i];
+		}
+		if(r->offsets) {
+			rp = r->data + r->offsets[i];
+			rl = r->offsets[i+1] - r->offsets[i];
+		}
+		if(_str_equal(lp, ll, rp, rl, mode) != negate) {
+			mask[i>>6] |= (uint64_t)1 << (i&63);
+		}
+	}
+}
+
+/*
+ * 对一块行执行全部指令, 结果留在栈底的掩码中
+ */
+static int _execute_chunk(const expr_program *prog, batch_ctx_t *ctx, batch_value_t *base) {
+	const int *slots = (const int *)prog->slots._data;
+	expr_inst_t *inst = (expr_inst_t *)prog->code._data;
+	expr_inst_t *end = inst + prog->code._size;
+	batch_value_t *sp = base;
+	size_t w, nwords = (ctx->n+63)/64;
+
+	for( ; inst < end; ++inst) {
+		opercfg_t *cfg = 0;
+		if(_INST_CONST == inst->op) {
+			sp->kind = _BV_CONST;
+			sp->value = inst->value;
+			sp++;
+			continue;
+		}
+		if(_INST_VAR == inst->op) {
+			int slot = slots[inst->var];
+			if(slot < 0 || (size_t)slot >= ctx->ncolumns) {
+				_expr_error(ctx->err, EXPR_ERR_COLUMN, inst->offset, 0, inst->varname);
+				return -1;
+			}
+			sp->kind = _BV_COLUMN;
+			sp->col = ctx->columns + slot;
+			sp++;
+			continue;
+		}
+		if(_INST_JMP_FALSE == inst->op || _INST_JMP_TRUE == inst->op) {
+			/* 批量时不跳转, 左值留在栈上等 && 或 || 合并 */
+			if(_to_mask(ctx, sp-1) < 0) {
+				_expr_error(ctx->err, EXPR_ERR_LEFT_TYPE, inst->offset, \
+						_INST_JMP_FALSE == inst->op ? _TEXT_AND : _TEXT_OR, 0);
+				return -1;
+			}
+			continue;
+		}
+
+		cfg = _opercfg_of(inst->op);
+		switch(inst->op) {
+		case _OPER_AND:
+		case _OPER_OR:
+			if(_to_mask(ctx, sp-1) < 0) goto ERROR_RET_R;
+			for(w=0; w<nwords; ++w) {
+				if(_OPER_AND == inst->op) { sp[-2].mask[w] &= sp[-1].mask[w]; }
+				else { sp[-2].mask[w] |= sp[-1].mask[w]; }
+			}
+			sp--;
+			break;
+		case _OPER_NOT:
+			if(_to_mask(ctx, sp-1) < 0) goto ERROR_RET_R;
+			for(w=0; w<nwords; ++w) {
+				sp[-1].mask[w] = ~sp[-1].mask[w];
+			}
+			break;
+		case _OPER_EQ:
+		case _OPER_NE:
+		case _OPER_LT:
+		case _OPER_LE:
+		case _OPER_GT:
+		case _OPER_GE: {
+			num_view_t l, r;
+			if(_num_view(ctx, sp-2, 0, &l) < 0) goto ERROR_RET_L;
+			if(_num_view(ctx, sp-1, 1, &r) < 0) goto ERROR_RET_R;
+			if(l.is_double != r.is_double) {
+				_compare_mixed(ctx, inst->op, &l, &r, sp[-2].mask);
+			}
+			else {
+				_compare(ctx->simd, inst->op, &l, &r, ctx->n, sp[-2].mask);
+			}
+			sp[-2].kind = _BV_MASK;
+			sp--;
+			break;
+		}
+		case _OPER_SE:
+		case _OPER_SNE:
+		case _OPER_CE:
+		case _OPER_CNE: {
+			str_view_t l, r;
+			if(_str_view(ctx, sp-2, &l) < 0) goto ERROR_RET_L;
+			if(_str_view(ctx, sp-1, &r) < 0) goto ERROR_RET_R;
+			_compare_str(inst, &l, &r, ctx->n, sp[-2].mask);
+			sp[-2].kind = _BV_MASK;
+			sp--;
+			break;
+		}
+		default:
+			_expr_error(ctx->err, EXPR_ERR_OPER, inst->offset, cfg ? cfg->text : 0, 0);
+			return -1;
+		}
+		continue;
+
+	ERROR_RET_L:
+		_expr_error(ctx->err, EXPR_ERR_LEFT_TYPE, inst->offset, cfg->text, 0);
+		return -1;
+	ERROR_RET_R:
+		_expr_error(ctx->err, EXPR_ERR_RIGHT_TYPE, inst->offset, cfg->text, 0);
+		return -1;
+	}
+
+	assert(sp == base+1);
+	if(_BV_CONST == base->kind && _DATA_TYPE_INT == base->value.type) {
+		/* 整个表达式折叠成了常量 */
+		return _to_mask(ctx, base);
+	}
+	if(_BV_MASK != base->kind) {
+		_expr_error(ctx->err, EXPR_ERR_RESULT_TYPE, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * 把块的结果掩码写到输出位图, row0 是8的倍数
+ */
+static void _store_bits(unsigned char *bitmap, size_t row0, const uint64_t *mask, size_t n) {
+	size_t i, nbytes = (n+7)/8;
+	unsigned char *out = bitmap + row0/8;
+	for(i=0; i<nbytes; ++i) {
+		out[i] = (unsigned char)(mask[i>>3] >> ((i&7)*8));
+	}
+	if(n & 7) {
+		out[nbytes-1] &= (unsigned char)((1u << (n&7)) - 1);
+	}
+}
+
+static int _execute_batch(const expr_program *prog, const expr_column_t *columns, \
+		size_t ncolumns, size_t nrows, unsigned char *bitmap, expr_error_t *err) {
+	int ret = -1;
+	size_t i, depth;
+	char *buf = 0;
+	batch_value_t *stack = 0;
+	batch_ctx_t ctx;
+
+	assert(prog);
+	assert(bitmap);
+	if(!_program_compiled(prog) || !prog->executable) {
+		_expr_error(err, EXPR_ERR_UNEXECUTABLE, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+
+	/* 一次分配栈、每个栈位的掩码和转换缓冲 */
+	depth = prog->bstack_size;
+	buf = (char *)malloc(sizeof(batch_value_t) * depth \
+			+ sizeof(uint64_t) * _CHUNK_WORDS * depth \
+			+ sizeof(int64_t) * _CHUNK_ROWS * 2);
+	if(!buf) {
+		_expr_error(err, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	memset(&ctx, 0x00, sizeof(ctx));
+	ctx.itmp[0] = (int64_t *)buf;
+	ctx.itmp[1] = ctx.itmp[0] + _CHUNK_ROWS;
+	stack = (batch_value_t *)(ctx.itmp[1] + _CHUNK_ROWS);
+	for(i=0; i<depth; ++i) {
+		stack[i].mask = (uint64_t *)(stack + depth) + i * _CHUNK_WORDS;
+	}
+	ctx.columns = columns;
+	ctx.ncolumns = ncolumns;
+	ctx.simd = expr_simd_level();
+	ctx.err = err;
+
+	for(ctx.row0 = 0; ctx.row0 < nrows; ctx.row0 += _CHUNK_ROWS) {
+		ctx.n = nrows - ctx.row0 < _CHUNK_ROWS ? nrows - ctx.row0 : _CHUNK_ROWS;
+		if(_execute_chunk(prog, &ctx, stack) < 0) {
+			goto RET;
+		}
+		_store_bits(bitmap, ctx.row0, stack[0].mask, ctx.n);
+	}
+	ret = 0;
+
+RET:
+	free(buf);
+	return ret;
+}
+
+int expr_program_execute_batch(const expr_program *prog, const expr_column_t *columns, \
+		size_t ncolumns, size_t nrows, unsigned char *bitmap) {
+	return _execute_batch(prog, columns, ncolumns, nrows, bitmap, 0);
+}
+
+int expr_parser_execute_batch(expr_parser *parser, const expr_column_t *columns, \
+		size_t ncolumns, size_t nrows, unsigned char *bitmap) {
+	assert(parser);
+	return _execute_batch(&parser->_prog, columns, ncolumns, nrows, bitmap, &parser->_ctx.err);
+}
@@ -0,0 +1,267 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ */
+#define _POSIX_C_SOURCE 200112L
+#include "expr_cache.h"
+#include "expr_inner.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#define _ORI_BUCKETS	64
+
+/*
+ * 缓存项, 程序和表达式文本跟缓存项一起申请
+ */
+typedef struct _cache_entry_t {
+	struct expr_program prog;		/* 必须在最前, 归还时由程序指针找回缓存项 */
+	uint64_t hash;
+	size_t len;
+	size_t bytes;
+	int refs;						/* 使用者的个数, 在缓存中时另加1, 由 lock 保护 */
+	struct _cache_entry_t * prev;	/* LRU链表, 表头是最近使用的 */
+	struct _cache_entry_t * next;
+	struct _cache_entry_t * chain;	/* 同一个桶中的下一项, 淘汰后串成待释放链表 */
+	char key[1];
+} cache_entry_t;
+
+struct expr_cache {
+	pthread_mutex_t lock;
+	size_t max_entries;
+	size_t max_bytes;
+	cache_entry_t ** buckets;
+	size_t nbuckets;				/* 2的幂 */
+	cache_entry_t * head;
+	cache_entry_t * tail;
+	size_t entries;
+	size_t bytes;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+static void _entry_free(cache_entry_t *e) {
+	_program_uinit(&e->prog);
+	free(e);
+}
+
+static void _free_chain(cache_entry_t *e) {
+	while(e) {
+		cache_entry_t *next = e->chain;
+		_entry_free(e);
+		e = next;
+	}
+}
+
+static cache_entry_t * _lookup(expr_cache *cache, const char *key, size_t len, uint64_t hash) {
+	cache_entry_t *e = cache->buckets[hash & (cache->nbuckets - 1)];
+	for( ; e; e = e->chain) {
+		if(e->hash == hash && e->len == len && memcmp(e->key, key, len) == 0) {
+			return e;
+		}
+	}
+	return 0;
+}
+
+static void _lru_unlink(expr_cache *cache, cache_entry_t *e) {
+	if(e->prev) { e->prev->next = e->next; } else { cache->head = e->next; }
+	if(e->next) { e->next->prev = e->prev; } else { cache->tail = e->prev; }
+	e->prev = 0;
+	e->next = 0;
+}
+
+static void _lru_push_front(expr_cache *cache, cache_entry_t *e) {
+	e->prev = 0;
+	e->next = cache->head;
+	if(cache->head) { cache->head->prev = e; } else { cache->tail = e; }
+	cache->head = e;
+}
+
+static void _bucket_unlink(expr_cache *cache, cache_entry_t *e) {
+	cache_entry_t **pp = &cache->buckets[e->hash & (cache->nbuckets - 1)];
+	while(*pp != e) {
+		pp = &(*pp)->chain;
+	}
+	*pp = e->chain;
+	e->chain = 0;
+}
+
+/*
+ * 桶数翻倍, 申请失败时保持原样, 只是链变长
+ */
+static void _grow(expr_cache *cache) {
+	size_t n = cache->nbuckets * 2, i;
+	cache_entry_t **buckets = (cache_entry_t **)calloc(n, sizeof(cache_entry_t *));
+	if(!buckets) {
+		return;
+	}
+	for(i=0; i<cache->nbuckets; ++i) {
+		cache_entry_t *e = cache->buckets[i];
+		while(e) {
+			cache_entry_t *next = e->chain;
+			e->chain = buckets[e->hash & (n - 1)];
+			buckets[e->hash & (n - 1)] = e;
+			e = next;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->nbuckets = n;
+}
+
+static int _over_limit(expr_cache *cache) {
+	return (cache->max_entries && cache->entries > cache->max_entries) || \
+		(cache->max_bytes && cache->bytes > cache->max_bytes);
+}
+
+/*
+ * 从LRU表尾淘汰到不超限为止, keep 不淘汰. 没有使用者的项串到 *dead, 解锁后释放
+ */
+static void _evict(expr_cache *cache, cache_entry_t *keep, cache_entry_t **dead) {
+	while(_over_limit(cache) && cache->tail && cache->tail != keep) {
+		cache_entry_t *e = cache->tail;
+		_lru_unlink(cache, e);
+		_bucket_unlink(cache, e);
+		cache->entries--;
+		cache->bytes -= e->bytes;
+		cache->evictions++;
+		if(--e->refs == 0) {
+			e->chain = *dead;
+			*dead = e;
+		}
+	}
+}
+
+expr_cache * expr_cache_new(size_t max_entries, size_t max_bytes) {
+	expr_cache *cache = (expr_cache *)malloc(sizeof(expr_cache));
+	if(cache) {
+		memset(cache, 0x00, sizeof(expr_cache));
+		cache->max_entries = max_entries;
+		cache->max_bytes = max_bytes;
+		cache->buckets = (cache_entry_t **)calloc(_ORI_BUCKETS, sizeof(cache_entry_t *));
+		cache->nbuckets = _ORI_BUCKETS;
+		if(!cache->buckets) {
+			free(cache);
+			return 0;
+		}
+		pthread_mutex_init(&cache->lock, 0);
+	}
+	return cache;
+}
+
+void expr_cache_delete(expr_cache *cache) {
+	if(cache) {
+		cache_entry_t *e = cache->head;
+		while(e) {
+			cache_entry_t *next = e->next;
+			_entry_free(e);
+			e = next;
+		}
+		free(cache->buckets);
+		pthread_mutex_destroy(&cache->lock);
+		free(cache);
+	}
+}
+
+const expr_program * expr_cache_get(expr_cache *cache, const char *exp_str) {
+	cache_entry_t *e, *old, *dead = 0;
+	size_t len;
+	uint64_t hash;
+
+	if(!cache || !exp_str) {
+		return 0;
+	}
+	len = strlen(exp_str);
+	hash = expr_str_hash(exp_str, len);
+
+	pthread_mutex_lock(&cache->lock);
+	e = _lookup(cache, exp_str, len, hash);
+	if(e) {
+		e->refs++;
+		cache->hits++;
+		_lru_unlink(cache, e);
+		_lru_push_front(cache, e);
+		pthread_mutex_unlock(&cache->lock);
+		return &e->prog;
+	}
+	cache->misses++;
+	pthread_mutex_unlock(&cache->lock);
+
+	/* 解析不持锁, 其他线程的命中不用等待 */
+	e = (cache_entry_t *)malloc(sizeof(cache_entry_t) + len);
+	if(!e) {
+		return 0;
+	}
+	memcpy(e->key, exp_str, len + 1);
+	if(_program_build(&e->prog, e->key) < 0) {
+		free(e);
+		return 0;
+	}
+	e->hash = hash;
+	e->len = len;
+	e->bytes = _program_bytes(&e->prog) + sizeof(cache_entry_t) - sizeof(expr_program) + len;
+	e->prev = 0;
+	e->next = 0;
+	e->chain = 0;
+
+	pthread_mutex_lock(&cache->lock);
+	old = _lookup(cache, exp_str, len, hash);
+	if(old) {
+		/* 其他线程已经放入了同一个表达式, 用它的 */
+		old->refs++;
+		_lru_unlink(cache, old);
+		_lru_push_front(cache, old);
+		pthread_mutex_unlock(&cache->lock);
+		_entry_free(e);
+		return &old->prog;
+	}
+	if(cache->max_bytes && e->bytes > cache->max_bytes) {
+		/* 单个程序超过字节上限, 不进缓存, 归还时释放 */
+		e->refs = 1;
+		pthread_mutex_unlock(&cache->lock);
+		return &e->prog;
+	}
+	e->refs = 2;
+	e->chain = cache->buckets[hash & (cache->nbuckets - 1)];
+	cache->buckets[hash & (cache->nbuckets - 1)] = e;
+	_lru_push_front(cache, e);
+	cache->entries++;
+	cache->bytes += e->bytes;
+	_evict(cache, e, &dead);
+	if(cache->entries > cache->nbuckets) {
+		_grow(cache);
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	_free_chain(dead);
+	return &e->prog;
+}
+
+void expr_cache_release(expr_cache *cache, const expr_program *prog) {
+	cache_entry_t *e = (cache_entry_t *)prog;
+	int refs;
+	if(!cache || !prog) {
+		return;
+	}
+	pthread_mutex_lock(&cache->lock);
+	refs = --e->refs;
+	pthread_mutex_unlock(&cache->lock);
+	if(0 == refs) {
+		_entry_free(e);
+	}
+}
+
+void expr_cache_stat(expr_cache *cache, expr_cache_stat_t *stat) {
+	if(cache && stat) {
+		pthread_mutex_lock(&cache->lock);
+		stat->hits = cache->hits;
+		stat->misses = cache->misses;
+		stat->evictions = cache->evictions;
+		stat->entries = cache->entries;
+		stat->bytes = cache->bytes;
+		pthread_mutex_unlock(&cache->lock);
+	}
+}
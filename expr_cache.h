@@ -0,0 +1,51 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 编译结果缓存: 按表达式文本缓存编译好的程序, 超过条数或字节上限时淘汰最久未用的.
+ * 取出的程序带引用计数, 用完调用 expr_cache_release 归还.
+ * 被淘汰的程序在最后一个使用者归还后才释放, 执行中的线程不受其他线程插入和淘汰的影响.
+ */
+#ifndef _EXPR_CACHE_H_
+#define _EXPR_CACHE_H_
+
+#include "expr_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct expr_cache expr_cache;
+
+typedef struct expr_cache_stat_t {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t entries;		/* 当前缓存的条数 */
+	size_t bytes;		/* 当前缓存的程序占用的字节数 */
+} expr_cache_stat_t;
+
+/*
+ * max_entries 和 max_bytes 为0表示不限制
+ */
+extern expr_cache * expr_cache_new(size_t max_entries, size_t max_bytes);
+
+/*
+ * 删除前所有取出的程序都要已经归还
+ */
+extern void expr_cache_delete(expr_cache *cache);
+
+/*
+ * 取出 exp_str 编译好的程序, 没有则解析编译后放入缓存, 解析失败返回空.
+ * 程序被多个线程共享, 只能用默认槽位(变量的下标)或按变量名执行, 不能再绑定槽位.
+ */
+extern const expr_program * expr_cache_get(expr_cache *cache, const char *exp_str);
+extern void expr_cache_release(expr_cache *cache, const expr_program *prog);
+
+extern void expr_cache_stat(expr_cache *cache, expr_cache_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,886 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 按表达式过滤 NDJSON 或 CSV 记录, 输出匹配的记录.
+ * 用法: ./expr_filter [-f json|csv] [-d 分隔符] [-b 字节数] [-v] [-c] [-s] 表达式 [文件...]
+ *   -f  输入格式, 默认按第一个非空白字符判断, '{' 开头是 NDJSON, 否则是 CSV
+ *   -d  CSV 的分隔符, 默认 ','
+ *   -b  读入缓冲的初始大小, 默认4MB
+ *   -v  输出不匹配的记录(包括取值或类型出错的记录)
+ *   -c  只输出匹配的记录数
+ *   -s  结束时在 stderr 输出记录数和吞吐量
+ * 没有文件时读 stdin. 表达式中的变量对应 NDJSON 顶层的键(键中的转义先还原)或 CSV 表头的列名.
+ * JSON 的数字按整数或浮点数取值, true/false 是 1/0, null 和缺少的键取值失败,
+ * 嵌套的对象和数组按原文作为字符串. CSV 不带引号、能完整解析成数字的格按数字取值,
+ * 其余按字符串. 取值失败或类型不符的记录算不匹配.
+ * 表达式只解析一次. 输入按大块读入同一个缓冲区, 记录和字段都在缓冲区中原地取出,
+ * 只有带转义的字符串复制到按变量复用的缓冲, 内存只和最长的记录有关.
+ * 退出码和 grep 一致: 有匹配为0, 没有匹配为1, 出错(包括内存不足)为2.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include "expr_parser.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define _BUF_SIZE		(4 << 20)	/* 读入缓冲的初始大小, 放不下一条记录时加倍 */
+#define _OUT_BUF_SIZE	(1 << 20)
+#define _NUM_MAX		64			/* 数字的最大长度, 更长的不当作数字 */
+
+#define _FORMAT_AUTO	0
+#define _FORMAT_JSON	1
+#define _FORMAT_CSV		2
+
+#define _FIELD_NONE		0			/* 本条记录没有这个字段 */
+#define _FIELD_INT		1
+#define _FIELD_DOUBLE	2
+#define _FIELD_STR		3
+#define _FIELD_NUM		4			/* JSON 的数字, 取值时才解析 */
+#define _FIELD_CELL		5			/* CSV 不带引号的格, 取值时才判断是不是数字 */
+
+/*
+ * 取字段出错: 记录格式不对时算不匹配, 内存不足时停止
+ */
+#define _ERR_BAD		(-1)
+#define _ERR_NOMEM		(-2)
+
+/*
+ * 只增长的缓冲, 反转义后的字符串放在这里
+ */
+typedef struct scratch_t {
+	char * p;
+	size_t size;
+} scratch_t;
+
+/*
+ * 当前记录中一个变量的值, 字符串指向输入缓冲或 scratch.
+ * 数字先记下原文, 短路没有用到的字段不做转换
+ */
+typedef struct field_t {
+	int kind;
+	int64_t i;
+	double d;
+	const char * p;
+	size_t len;
+	scratch_t scratch;
+} field_t;
+
+typedef struct filter_t {
+	expr_parser * parser;
+	size_t nvars;
+	char ** names;
+	size_t * name_lens;
+	field_t * fields;			/* 按变量下标, 也就是默认的槽位 */
+	size_t found;				/* 本条记录已经找到的变量数 */
+	scratch_t key;				/* 带转义的键还原到这里再查找 */
+
+	int format;					/* 命令行指定的格式 */
+	char delim;
+	int invert;
+	int count_only;
+
+	/* CSV 表头: 列号到变量下标, 没有对应变量的列为-1, 每个文件各读一次 */
+	int * col_var;
+	size_t ncols;
+	size_t max_col;				/* 对应变量的最大列号加1, 后面的列不再切分 */
+	scratch_t header;
+	int header_printed;
+
+	char * buf;
+	size_t cap;
+
+	uint64_t records;
+	uint64_t selected;
+	uint64_t errors;
+	uint64_t bytes;
+} filter_t;
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int _scratch_reserve(scratch_t *s, size_t size) {
+	if(size > s->size) {
+		char *p = (char *)realloc(s->p, size);
+		if(!p) {
+			return -1;
+		}
+		s->p = p;
+		s->size = size;
+	}
+	return 0;
+}
+
+static int _is_num_char(char c) {
+	return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+/*
+ * 把整段文本解析成整数或浮点数, 不是数字时返回-1.
+ * 整数超出 int64 时按浮点数, 和表达式中的常量一致
+ */
+static int _set_number(field_t *fld, const char *p, size_t len) {
+	char tmp[_NUM_MAX];
+	char *end = 0;
+	size_t k = 0;
+	uint64_t n = 0, limit;
+	int neg = 0, integral = 1;
+
+	if(len == 0 || len >= _NUM_MAX) {
+		return -1;
+	}
+	if(!((p[0] >= '0' && p[0] <= '9') || p[0] == '-' || p[0] == '+' || p[0] == '.')) {
+		return -1;
+	}
+	for(k=0; k<len; ++k) {
+		if(!_is_num_char(p[k])) {
+			return -1;
+		}
+		if(p[k] == '.' || p[k] == 'e' || p[k] == 'E') {
+			integral = 0;
+		}
+	}
+	if(integral) {
+		k = 0;
+		if(p[0] == '-' || p[0] == '+') {
+			neg = p[0] == '-';
+			k = 1;
+		}
+		limit = neg ? ((uint64_t)1 << 63) : ((uint64_t)1 << 63) - 1;
+		if(k == len) {
+			return -1;
+		}
+		for( ; k<len; ++k) {
+			unsigned int digit = (unsigned int)(p[k] - '0');
+			if(digit > 9) {
+				return -1;
+			}
+			if(n > (limit - digit) / 10) {
+				integral = 0;
+				break;
+			}
+			n = n * 10 + digit;
+		}
+		if(integral) {
+			fld->kind = _FIELD_INT;
+			fld->i = neg ? (int64_t)(0 - n) : (int64_t)n;
+			return 0;
+		}
+	}
+	memcpy(tmp, p, len);
+	tmp[len] = '\0';
+	fld->d = strtod(tmp, &end);
+	if(end != tmp + len) {
+		return -1;
+	}
+	fld->kind = _FIELD_DOUBLE;
+	return 0;
+}
+
+static void _set_str(field_t *fld, const char *p, size_t len) {
+	fld->kind = _FIELD_STR;
+	fld->p = p;
+	fld->len = len;
+}
+
+static int _find_var(filter_t *f, const char *name, size_t len) {
+	size_t i;
+	for(i=0; i<f->nvars; ++i) {
+		if(f->name_lens[i] == len && memcmp(f->names[i], name, len) == 0) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * NDJSON
+ */
+static const char * _json_ws(const char *p, const char *end) {
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+		p++;
+	}
+	return p;
+}
+
+/*
+ * p 指向开头引号之后, 返回结尾的引号, 没有时返回0. 有转义时 *escaped 置1
+ */
+static const char * _json_str_end(const char *p, const char *end, int *escaped) {
+	*escaped = 0;
+	while(p < end) {
+		const char *q = (const char *)memchr(p, '"', end - p);
+		const char *b = (const char *)memchr(p, '\\', (q ? q : end) - p);
+		if(!b) {
+			return q;
+		}
+		*escaped = 1;
+		p = b + 2;
+	}
+	return 0;
+}
+
+/*
+ * 跳过嵌套的对象或数组, 返回结尾之后的位置, 不完整时返回0
+ */
+static const char * _json_skip_nested(const char *p, const char *end) {
+	int depth = 0, escaped;
+	while(p < end) {
+		switch(*p) {
+		case '{': case '[':
+			depth++;
+			break;
+		case '}': case ']':
+			if(--depth == 0) {
+				return p + 1;
+			}
+			break;
+		case '"':
+			p = _json_str_end(p + 1, end, &escaped);
+			if(!p) {
+				return 0;
+			}
+			break;
+		}
+		p++;
+	}
+	return 0;
+}
+
+static unsigned int _hex4(const char *p, const char *end) {
+	unsigned int v = 0;
+	int k;
+	if(end - p < 4) {
+		return 0xffffffffu;
+	}
+	for(k=0; k<4; ++k) {
+		char c = p[k];
+		v <<= 4;
+		if(c >= '0' && c <= '9') { v |= (unsigned int)(c - '0'); }
+		else if(c >= 'a' && c <= 'f') { v |= (unsigned int)(c - 'a' + 10); }
+		else if(c >= 'A' && c <= 'F') { v |= (unsigned int)(c - 'A' + 10); }
+		else { return 0xffffffffu; }
+	}
+	return v;
+}
+
+/*
+ * 反转义 [p, end) 到 out, 返回长度. \u 按 UTF-8 编码, 不合法的转义保留原样.
+ * 结果不会比原文长
+ */
+static size_t _json_unescape(const char *p, const char *end, char *out) {
+	char *o = out;
+	while(p < end) {
+		unsigned int u;
+		if(*p != '\\' || p + 1 >= end) {
+			*o++ = *p++;
+			continue;
+		}
+		switch(p[1]) {
+		case 'b': *o++ = '\b'; p += 2; continue;
+		case 'f': *o++ = '\f'; p += 2; continue;
+		case 'n': *o++ = '\n'; p += 2; continue;
+		case 'r': *o++ = '\r'; p += 2; continue;
+		case 't': *o++ = '\t'; p += 2; continue;
+		case 'u': break;
+		default: *o++ = p[1]; p += 2; continue;
+		}
+		u = _hex4(p + 2, end);
+		if(u == 0xffffffffu) {
+			*o++ = *p++;
+			continue;
+		}
+		p += 6;
+		if(u >= 0xd800 && u < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+			unsigned int lo = _hex4(p + 2, end);
+			if(lo >= 0xdc00 && lo < 0xe000) {
+				u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+				p += 6;
+			}
+		}
+		if(u < 0x80) {
+			*o++ = (char)u;
+		}
+		else if(u < 0x800) {
+			*o++ = (char)(0xc0 | (u >> 6));
+			*o++ = (char)(0x80 | (u & 0x3f));
+		}
+		else if(u < 0x10000) {
+			*o++ = (char)(0xe0 | (u >> 12));
+			*o++ = (char)(0x80 | ((u >> 6) & 0x3f));
+			*o++ = (char)(0x80 | (u & 0x3f));
+		}
+		else {
+			*o++ = (char)(0xf0 | (u >> 18));
+			*o++ = (char)(0x80 | ((u >> 12) & 0x3f));
+			*o++ = (char)(0x80 | ((u >> 6) & 0x3f));
+			*o++ = (char)(0x80 | (u & 0x3f));
+		}
+	}
+	return (size_t)(o - out);
+}
+
+/*
+ * 取出一条 NDJSON 记录中表达式用到的顶层字段, 都找到后不再往后解析.
+ * 不是合法的对象时返回 _ERR_BAD
+ */
+static int _json_fields(filter_t *f, const char *p, const char *end) {
+	int escaped;
+	p = _json_ws(p, end);
+	if(p >= end || *p != '{') {
+		return _ERR_BAD;
+	}
+	p = _json_ws(p + 1, end);
+	if(p < end && *p == '}') {
+		return 0;
+	}
+	while(f->found < f->nvars) {
+		const char *key, *key_end, *val;
+		field_t *fld = 0;
+		int var;
+
+		if(p >= end || *p != '"') {
+			return _ERR_BAD;
+		}
+		key = p + 1;
+		key_end = _json_str_end(key, end, &escaped);
+		if(!key_end) {
+			return _ERR_BAD;
+		}
+		if(escaped) {
+			if(_scratch_reserve(&f->key, key_end - key) < 0) {
+				return _ERR_NOMEM;
+			}
+			var = _find_var(f, f->key.p, _json_unescape(key, key_end, f->key.p));
+		}
+		else {
+			var = _find_var(f, key, key_end - key);
+		}
+		if(var >= 0 && f->fields[var].kind == _FIELD_NONE) {
+			fld = f->fields + var;
+		}
+		p = _json_ws(key_end + 1, end);
+		if(p >= end || *p != ':') {
+			return _ERR_BAD;
+		}
+		p = _json_ws(p + 1, end);
+		if(p >= end) {
+			return _ERR_BAD;
+		}
+
+		val = p;
+		if(*p == '"') {
+			const char *s = p + 1, *s_end = _json_str_end(s, end, &escaped);
+			if(!s_end) {
+				return _ERR_BAD;
+			}
+			if(fld && escaped) {
+				if(_scratch_reserve(&fld->scratch, s_end - s + 1) < 0) {
+					return _ERR_NOMEM;
+				}
+				_set_str(fld, fld->scratch.p, _json_unescape(s, s_end, fld->scratch.p));
+			}
+			else if(fld) {
+				_set_str(fld, s, s_end - s);
+			}
+			p = s_end + 1;
+		}
+		else if(*p == '{' || *p == '[') {
+			p = _json_skip_nested(p, end);
+			if(!p) {
+				return _ERR_BAD;
+			}
+			if(fld) {
+				_set_str(fld, val, p - val);
+			}
+		}
+		else {
+			while(p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\r') {
+				p++;
+			}
+			if(fld) {
+				if(p - val == 4 && memcmp(val, "true", 4) == 0) {
+					fld->kind = _FIELD_INT;
+					fld->i = 1;
+				}
+				else if(p - val == 5 && memcmp(val, "false", 5) == 0) {
+					fld->kind = _FIELD_INT;
+					fld->i = 0;
+				}
+				else if(p - val == 4 && memcmp(val, "null", 4) == 0) {
+					fld = 0;
+				}
+				else {
+					_set_str(fld, val, p - val);
+					fld->kind = _FIELD_NUM;
+				}
+			}
+		}
+		if(fld) {
+			f->found++;
+		}
+
+		p = _json_ws(p, end);
+		if(p < end && *p == ',') {
+			p = _json_ws(p + 1, end);
+			continue;
+		}
+		if(p < end && *p == '}') {
+			return 0;
+		}
+		return _ERR_BAD;
+	}
+	return 0;
+}
+
+/*
+ * CSV
+ */
+
+/*
+ * 取出 *pp 开始的一格放到 *cell, 移到下一格的开头. 带引号且有转义时反转义到 s,
+ * s 为空时只跳过. 返回1表示后面还有格, 0表示是最后一格, 内存不足时返回 _ERR_NOMEM
+ */
+static int _csv_cell(const char **pp, const char *end, char delim, scratch_t *s, \
+		const char **cell, size_t *len, int *quoted) {
+	const char *p = *pp, *q;
+	*quoted = 0;
+	if(p < end && *p == '"') {
+		int escaped = 0;
+		*quoted = 1;
+		q = ++p;
+		while(1) {
+			q = (const char *)memchr(q, '"', end - q);
+			if(!q) {
+				q = end;
+				break;
+			}
+			if(q + 1 < end && q[1] == '"') {
+				escaped = 1;
+				q += 2;
+				continue;
+			}
+			break;
+		}
+		*cell = p;
+		*len = q - p;
+		if(escaped && s) {
+			char *o;
+			const char *r = p;
+			if(_scratch_reserve(s, q - p + 1) < 0) {
+				return _ERR_NOMEM;
+			}
+			for(o = s->p; r < q; ++r) {
+				*o++ = *r;
+				if(*r == '"') {
+					r++;
+				}
+			}
+			*cell = s->p;
+			*len = o - s->p;
+		}
+		p = q < end ? q + 1 : end;
+		q = (const char *)memchr(p, delim, end - p);
+	}
+	else {
+		q = (const char *)memchr(p, delim, end - p);
+		*cell = p;
+		*len = (q ? q : end) - p;
+	}
+	if(!q) {
+		*pp = end;
+		return 0;
+	}
+	*pp = q + 1;
+	return 1;
+}
+
+static int _csv_header(filter_t *f, const char *p, const char *end) {
+	size_t i;
+	int more = 1;
+	f->ncols = 0;
+	f->max_col = 0;
+	while(more) {
+		const char *cell;
+		size_t len;
+		int quoted, var;
+		more = _csv_cell(&p, end, f->delim, &f->header, &cell, &len, &quoted);
+		if(more < 0) {
+			return -1;
+		}
+		if(f->ncols % 64 == 0) {
+			int *col_var = (int *)realloc(f->col_var, sizeof(int) * (f->ncols + 64));
+			if(!col_var) {
+				return -1;
+			}
+			f->col_var = col_var;
+		}
+		var = _find_var(f, cell, len);
+		for(i=0; var >= 0 && i<f->ncols; ++i) {
+			if(f->col_var[i] == var) {
+				var = -1;
+			}
+		}
+		f->col_var[f->ncols++] = var;
+		if(var >= 0) {
+			f->max_col = f->ncols;
+		}
+	}
+	for(i=0; i<f->nvars; ++i) {
+		size_t k;
+		for(k=0; k<f->ncols && f->col_var[k] != (int)i; ++k) {}
+		if(k == f->ncols) {
+			fprintf(stderr, "expr_filter: warning: no column '%s'\n", f->names[i]);
+		}
+	}
+	return 0;
+}
+
+static int _csv_fields(filter_t *f, const char *p, const char *end) {
+	size_t col;
+	int more = 1;
+	for(col=0; more && col<f->max_col; ++col) {
+		const char *cell;
+		size_t len;
+		int quoted, var = f->col_var[col];
+		field_t *fld = var >= 0 ? f->fields + var : 0;
+		more = _csv_cell(&p, end, f->delim, fld ? &fld->scratch : 0, &cell, &len, &quoted);
+		if(more < 0) {
+			return more;
+		}
+		if(fld) {
+			_set_str(fld, cell, len);
+			if(!quoted) {
+				fld->kind = _FIELD_CELL;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * 记录的长度(含换行). CSV 带引号的格中可以有换行.
+ * 没有结尾的换行且还没读完时返回0, 等读入更多数据
+ */
+static size_t _record_len(int format, const char *p, size_t size, int eof) {
+	const char *end = p + size, *cur = p, *nl, *q;
+	if(_FORMAT_CSV != format) {
+		nl = (const char *)memchr(p, '\n', size);
+		return nl ? (size_t)(nl - p + 1) : (eof ? size : 0);
+	}
+	nl = (const char *)memchr(cur, '\n', end - cur);
+	while(1) {
+		if(nl && nl < cur) {
+			nl = (const char *)memchr(cur, '\n', end - cur);
+		}
+		q = (const char *)memchr(cur, '"', (nl ? nl : end) - cur);
+		if(!q) {
+			return nl ? (size_t)(nl - p + 1) : (eof ? size : 0);
+		}
+		/* 跳过引号中的内容, 连续两个引号相当于出了引号又进去 */
+		q = (const char *)memchr(q + 1, '"', end - q - 1);
+		if(!q) {
+			return eof ? size : 0;
+		}
+		cur = q + 1;
+	}
+}
+
+static int _get_field(int slot, expr_value_t *value, void *usrdata) {
+	field_t *fld = ((filter_t *)usrdata)->fields + slot;
+	if(_FIELD_NUM == fld->kind && _set_number(fld, fld->p, fld->len) < 0) {
+		return -1;
+	}
+	if(_FIELD_CELL == fld->kind && _set_number(fld, fld->p, fld->len) < 0) {
+		fld->kind = _FIELD_STR;
+	}
+	switch(fld->kind) {
+	case _FIELD_INT:
+		expr_value_set_int(value, fld->i);
+		return 0;
+	case _FIELD_DOUBLE:
+		expr_value_set_double(value, fld->d);
+		return 0;
+	case _FIELD_STR:
+		expr_value_set_str_ref(value, fld->p, fld->len);
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static void _output(const char *rec, size_t len) {
+	fwrite(rec, 1, len, stdout);
+	if(len == 0 || rec[len-1] != '\n') {
+		fputc('\n', stdout);
+	}
+}
+
+/*
+ * 处理一条记录, format 是当前文件的格式, *need_header 表示这是 CSV 的表头.
+ * 格式不对或执行出错的记录算不匹配, 只有内存不足时返回-1
+ */
+static int _handle(filter_t *f, int format, int *need_header, const char *rec, size_t len) {
+	const char *end = rec + len;
+	size_t i;
+	int ret, result = 0;
+
+	while(end > rec && (end[-1] == '\n' || end[-1] == '\r')) {
+		end--;
+	}
+	if(end == rec) {
+		return 0;
+	}
+	if(*need_header) {
+		*need_header = 0;
+		if(_csv_header(f, rec, end) < 0) {
+			return -1;
+		}
+		if(!f->header_printed && !f->count_only) {
+			_output(rec, len);
+		}
+		f->header_printed = 1;
+		return 0;
+	}
+
+	f->records++;
+	for(i=0; i<f->nvars; ++i) {
+		f->fields[i].kind = _FIELD_NONE;
+	}
+	f->found = 0;
+	ret = _FORMAT_JSON == format ? _json_fields(f, rec, end) : _csv_fields(f, rec, end);
+	if(_ERR_NOMEM == ret) {
+		return -1;
+	}
+	if(ret == 0 && expr_parser_execute_slot(f->parser, &result, _get_field, f) < 0) {
+		expr_error_t err;
+		expr_parser_error(f->parser, &err);
+		if(EXPR_ERR_NOMEM == err.code) {
+			return -1;
+		}
+		ret = -1;
+	}
+	if(ret < 0) {
+		f->errors++;
+		result = 0;
+	}
+	if((result != 0) != f->invert) {
+		f->selected++;
+		if(!f->count_only) {
+			_output(rec, len);
+		}
+	}
+	return 0;
+}
+
+/*
+ * 按第一个非空白字符判断格式, 还没读到时返回 _FORMAT_AUTO, 读完了都是空白按 NDJSON
+ */
+static int _detect_format(const char *p, size_t size, int eof) {
+	size_t i;
+	for(i=0; i<size; ++i) {
+		if(p[i] != ' ' && p[i] != '\t' && p[i] != '\r' && p[i] != '\n') {
+			return p[i] == '{' ? _FORMAT_JSON : _FORMAT_CSV;
+		}
+	}
+	return eof ? _FORMAT_JSON : _FORMAT_AUTO;
+}
+
+/*
+ * 按大块读入, 处理完整的记录, 剩下的半条移到缓冲区开头
+ */
+static int _filter_stream(filter_t *f, FILE *fp, const char *name) {
+	size_t len = 0, pos, n, rec;
+	int eof = 0, format = f->format, need_header = -1;
+
+	setvbuf(fp, 0, _IONBF, 0);
+	while(!eof) {
+		n = fread(f->buf + len, 1, f->cap - len, fp);
+		if(n < f->cap - len) {
+			if(ferror(fp)) {
+				fprintf(stderr, "expr_filter: read %s failed\n", name);
+				return -1;
+			}
+			eof = 1;
+		}
+		len += n;
+		f->bytes += n;
+		if(_FORMAT_AUTO == format) {
+			format = _detect_format(f->buf, len, eof);
+		}
+		if(need_header < 0 && _FORMAT_AUTO != format) {
+			need_header = _FORMAT_CSV == format;
+		}
+
+		pos = 0;
+		while(_FORMAT_AUTO != format && pos < len && \
+				(rec = _record_len(format, f->buf + pos, len - pos, eof)) > 0) {
+			if(_handle(f, format, &need_header, f->buf + pos, rec) < 0) {
+				fprintf(stderr, "expr_filter: out of memory\n");
+				return -1;
+			}
+			pos += rec;
+		}
+		len -= pos;
+		memmove(f->buf, f->buf + pos, len);
+		if(len == f->cap) {
+			char *buf = (char *)realloc(f->buf, f->cap * 2);
+			if(!buf) {
+				fprintf(stderr, "expr_filter: record too long in %s\n", name);
+				return -1;
+			}
+			f->buf = buf;
+			f->cap *= 2;
+		}
+	}
+	return 0;
+}
+
+static int _get_none(int slot, expr_value_t *value, void *usrdata) {
+	return -1;
+}
+
+static void _print_error(expr_parser *parser) {
+	expr_error_t err;
+	expr_parser_error(parser, &err);
+	fprintf(stderr, "expr_filter: %s", expr_strerror(err.code));
+	if(err.oper) {
+		fprintf(stderr, " '%s'", err.oper);
+	}
+	if(err.offset != EXPR_NO_OFFSET) {
+		fprintf(stderr, " at offset %lu", (unsigned long)err.offset);
+	}
+	fprintf(stderr, "\n");
+}
+
+static int _filter_init(filter_t *f, char *exp_str) {
+	expr_error_t err;
+	size_t i;
+	int result;
+	f->parser = expr_parser_new();
+	if(!f->parser) {
+		return -1;
+	}
+	if(expr_parser_parse(f->parser, exp_str) < 0) {
+		_print_error(f->parser);
+		return -1;
+	}
+	/* 只有一个值的表达式不能执行, 不取值先试一次, 不用等到读入数据 */
+	if(expr_parser_execute_slot(f->parser, &result, _get_none, 0) < 0) {
+		expr_parser_error(f->parser, &err);
+		if(EXPR_ERR_UNEXECUTABLE == err.code) {
+			_print_error(f->parser);
+			return -1;
+		}
+	}
+	f->nvars = expr_parser_var_count(f->parser);
+	f->names = (char **)malloc(sizeof(char *) * (f->nvars + 1));
+	f->name_lens = (size_t *)malloc(sizeof(size_t) * (f->nvars + 1));
+	f->fields = (field_t *)calloc(f->nvars + 1, sizeof(field_t));
+	f->buf = (char *)malloc(f->cap);
+	if(!f->names || !f->name_lens || !f->fields || !f->buf) {
+		fprintf(stderr, "expr_filter: out of memory\n");
+		return -1;
+	}
+	for(i=0; i<f->nvars; ++i) {
+		f->names[i] = expr_parser_var_name(f->parser, i);
+		f->name_lens[i] = strlen(f->names[i]);
+	}
+	return 0;
+}
+
+static void _filter_uinit(filter_t *f) {
+	size_t i;
+	for(i=0; f->fields && i<f->nvars; ++i) {
+		free(f->fields[i].scratch.p);
+	}
+	free(f->fields);
+	free(f->names);
+	free(f->name_lens);
+	free(f->col_var);
+	free(f->header.p);
+	free(f->key.p);
+	free(f->buf);
+	expr_parser_delete(f->parser);
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: expr_filter [-f json|csv] [-d delim] [-b bytes] [-v] [-c] [-s] expression [file...]\n");
+}
+
+int main(int argc, char *argv[]) {
+	filter_t f;
+	int i, stats = 0, ret = 0;
+	double start;
+
+	memset(&f, 0x00, sizeof(f));
+	f.delim = ',';
+	f.cap = _BUF_SIZE;
+	for(i=1; i<argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i) {
+		if(strcmp(argv[i], "-f") == 0 && i+1 < argc) {
+			++i;
+			if(strcmp(argv[i], "json") == 0 || strcmp(argv[i], "ndjson") == 0) { f.format = _FORMAT_JSON; }
+			else if(strcmp(argv[i], "csv") == 0) { f.format = _FORMAT_CSV; }
+			else { usage(); return 2; }
+		}
+		else if(strcmp(argv[i], "-d") == 0 && i+1 < argc && strlen(argv[i+1]) == 1) {
+			f.delim = argv[++i][0];
+		}
+		else if(strcmp(argv[i], "-b") == 0 && i+1 < argc) {
+			char *end = 0;
+			unsigned long cap = strtoul(argv[++i], &end, 10);
+			if(cap == 0 || *end != '\0') { usage(); return 2; }
+			f.cap = (size_t)cap;
+		}
+		else if(strcmp(argv[i], "-v") == 0) { f.invert = 1; }
+		else if(strcmp(argv[i], "-c") == 0) { f.count_only = 1; }
+		else if(strcmp(argv[i], "-s") == 0) { stats = 1; }
+		else if(strcmp(argv[i], "--") == 0) { ++i; break; }
+		else { usage(); return 2; }
+	}
+	if(i >= argc) {
+		usage();
+		return 2;
+	}
+	if(_filter_init(&f, argv[i++]) < 0) {
+		_filter_uinit(&f);
+		return 2;
+	}
+
+	setvbuf(stdout, 0, _IOFBF, _OUT_BUF_SIZE);
+	start = now_sec();
+	if(i >= argc) {
+		ret = _filter_stream(&f, stdin, "stdin");
+	}
+	for( ; i<argc && ret == 0; ++i) {
+		FILE *fp = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "rb");
+		if(!fp) {
+			fprintf(stderr, "expr_filter: open %s failed\n", argv[i]);
+			ret = -1;
+			break;
+		}
+		ret = _filter_stream(&f, fp, argv[i]);
+		if(fp != stdin) {
+			fclose(fp);
+		}
+	}
+	if(f.count_only) {
+		printf("%lu\n", (unsigned long)f.selected);
+	}
+	fflush(stdout);
+	if(stats) {
+		double elapsed = now_sec() - start;
+		fprintf(stderr, "records %lu, selected %lu, errors %lu, %.1f MB in %.3f s, %.1f MB/s\n", \
+				(unsigned long)f.records, (unsigned long)f.selected, (unsigned long)f.errors, \
+				(double)f.bytes / 1e6, elapsed, elapsed > 0 ? (double)f.bytes / 1e6 / elapsed : 0);
+	}
+	_filter_uinit(&f);
+	if(ret < 0) {
+		return 2;
+	}
+	return f.selected ? 0 : 1;
+}
@@ -0,0 +1,571 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 二进制映像的写入和加载. 加载时先整体校验, 再按映像一次分配全部程序的指令、
+ * 变量名指针和槽位, 指令中的字符串常量和变量名直接指向映像.
+ */
+#define _DEFAULT_SOURCE
+#include "expr_image.h"
+#include "expr_inner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <stdio.h>
+#include <limits.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _EXPR_IMAGE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct expr_image {
+	const unsigned char * data;
+	size_t size;
+	void * owned;			/* open 时映射或读入的内存, load 时为空 */
+	size_t nprogs;
+	expr_program * progs;	/* 和指令、变量名、槽位在同一块内存里 */
+};
+
+/*
+ * 映像中各段的起始位置
+ */
+typedef struct _image_view_t {
+	const expr_image_header_t * hdr;
+	const expr_image_prog_t * progs;
+	const expr_image_inst_t * insts;
+	const expr_image_var_t * vars;
+	char * strs;
+} image_view_t;
+
+static void _view(const expr_image_header_t *hdr, image_view_t *v) {
+	v->hdr = hdr;
+	v->progs = (const expr_image_prog_t *)(hdr + 1);
+	v->insts = (const expr_image_inst_t *)(v->progs + hdr->nprogs);
+	v->vars = (const expr_image_var_t *)(v->insts + hdr->ninsts);
+	v->strs = (char *)(v->vars + hdr->nvars);
+}
+
+static size_t _align8(size_t n) {
+	return (n + 7) & ~(size_t)7;
+}
+
+#define _FNV_OFFSET	(((uint64_t)0xcbf29ce4 << 32) | 0x84222325)
+#define _FNV_PRIME	(((uint64_t)0x100 << 32) | 0x1b3)
+
+uint64_t expr_image_checksum(const void *data, size_t size) {
+	const unsigned char *p = (const unsigned char *)data;
+	uint64_t h = _FNV_OFFSET, w;
+	size_t i;
+	for(i=0; i+8<=size; i+=8) {
+		memcpy(&w, p + i, sizeof(w));
+		h = (h ^ w) * _FNV_PRIME;
+	}
+	for( ; i<size; ++i) {
+		h = (h ^ p[i]) * _FNV_PRIME;
+	}
+	return h;
+}
+
+/*
+ * 字符串区中一项占的字节数, 字符串常量带 expr_image_str_t 头
+ */
+static size_t _str_bytes(size_t len, int is_const) {
+	return _align8((is_const ? sizeof(expr_image_str_t) : 0) + len + 1);
+}
+
+/*
+ * 把字符串连同结尾的'\0'复制到字符串区, 返回它的偏移. 写入前字符串区已清零
+ */
+static uint64_t _put_str(char *strs, size_t *used, const char *p, size_t len, const expr_image_str_t *head) {
+	uint64_t off = *used;
+	char *dst = strs + *used;
+	if(head) {
+		memcpy(dst, head, sizeof(expr_image_str_t));
+		dst += sizeof(expr_image_str_t);
+	}
+	memcpy(dst, p, len);
+	*used += _str_bytes(len, head != 0);
+	return off;
+}
+
+int expr_image_build(expr_program * const *progs, size_t n, void **data, size_t *size) {
+	expr_image_header_t *hdr;
+	expr_image_prog_t *iprog;
+	expr_image_inst_t *iinst;
+	expr_image_var_t *ivar;
+	char *buf, *strs;
+	size_t i, k, ninsts = 0, nvars = 0, nstrs = 0, used = 0, bytes;
+
+	if(!progs || !data || !size) {
+		return -1;
+	}
+	for(i=0; i<n; ++i) {
+		const expr_program *prog = progs[i];
+		const expr_inst_t *code;
+		if(!prog || !_program_compiled(prog)) {
+			_expr_error(0, EXPR_ERR_UNEXECUTABLE, EXPR_NO_OFFSET, 0, 0);
+			return -1;
+		}
+		code = (const expr_inst_t *)prog->code._data;
+		for(k=0; k<prog->code._size; ++k) {
+			if(code[k].offset > 0xffffffffu || code[k].var > 0xffffffffu || code[k].target > 0xffffffffu) {
+				_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+				return -1;
+			}
+			if(_INST_CONST == code[k].op && _DATA_TYPE_STR == code[k].value.type) {
+				nstrs += _str_bytes(code[k].value.len, 1);
+			}
+		}
+		for(k=0; k<prog->vars._size; ++k) {
+			nstrs += _str_bytes(strlen(((char **)prog->vars._data)[k]), 0);
+		}
+		ninsts += prog->code._size;
+		nvars += prog->vars._size;
+	}
+
+	bytes = sizeof(expr_image_header_t) + sizeof(expr_image_prog_t) * n \
+		+ sizeof(expr_image_inst_t) * ninsts + sizeof(expr_image_var_t) * nvars + nstrs;
+	buf = (char *)malloc(bytes);
+	if(!buf) {
+		_expr_error(0, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	memset(buf, 0x00, bytes);
+	hdr = (expr_image_header_t *)buf;
+	iprog = (expr_image_prog_t *)(hdr + 1);
+	iinst = (expr_image_inst_t *)(iprog + n);
+	ivar = (expr_image_var_t *)(iinst + ninsts);
+	strs = (char *)(ivar + nvars);
+
+	ninsts = 0;
+	nvars = 0;
+	for(i=0; i<n; ++i) {
+		const expr_program *prog = progs[i];
+		const expr_inst_t *code = (const expr_inst_t *)prog->code._data;
+		iprog[i].first_inst = ninsts;
+		iprog[i].ninsts = prog->code._size;
+		iprog[i].first_var = nvars;
+		iprog[i].nvars = prog->vars._size;
+		iprog[i].executable = (uint32_t)prog->executable;
+		for(k=0; k<prog->code._size; ++k, ++ninsts) {
+			expr_image_inst_t *dst = iinst + ninsts;
+			dst->op = (uint8_t)code[k].op;
+			dst->folded = (uint8_t)code[k].folded;
+			dst->offset = (uint32_t)code[k].offset;
+			if(_INST_CONST != code[k].op) {
+				dst->u.ref.var = (uint32_t)code[k].var;
+				dst->u.ref.target = (uint32_t)code[k].target;
+				continue;
+			}
+			dst->type = (uint8_t)code[k].value.type;
+			if(_DATA_TYPE_INT == dst->type) {
+				dst->u.value = (uint64_t)code[k].value.u.n;
+			}
+			else if(_DATA_TYPE_DOUBLE == dst->type) {
+				memcpy(&dst->u.value, &code[k].value.u.d, sizeof(dst->u.value));
+			}
+			else {
+				expr_image_str_t head;
+				head.hash = code[k].value.hash;
+				head.len = code[k].value.len;
+				dst->u.value = _put_str(strs, &used, code[k].value.u.p, code[k].value.len, &head);
+			}
+		}
+		for(k=0; k<prog->vars._size; ++k, ++nvars) {
+			const char *name = ((char **)prog->vars._data)[k];
+			ivar[nvars].name = _put_str(strs, &used, name, strlen(name), 0);
+			ivar[nvars].slot = ((int *)prog->slots._data)[k];
+		}
+	}
+
+	memcpy(hdr->magic, EXPR_IMAGE_MAGIC, sizeof(EXPR_IMAGE_MAGIC));
+	hdr->version = EXPR_IMAGE_VERSION;
+	hdr->endian = EXPR_IMAGE_ENDIAN;
+	hdr->size = bytes;
+	hdr->nprogs = n;
+	hdr->ninsts = ninsts;
+	hdr->nvars = nvars;
+	hdr->nstrs = nstrs;
+	hdr->checksum = expr_image_checksum(buf + sizeof(expr_image_header_t), bytes - sizeof(expr_image_header_t));
+	*data = buf;
+	*size = bytes;
+	return 0;
+}
+
+int expr_image_save(const char *path, expr_program * const *progs, size_t n) {
+	void *data = 0;
+	size_t size = 0;
+	FILE *fp;
+	int ret = -1;
+
+	if(!path || expr_image_build(progs, n, &data, &size) < 0) {
+		return -1;
+	}
+	fp = fopen(path, "wb");
+	if(!fp) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		goto RET;
+	}
+	if(fwrite(data, 1, size, fp) != size) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		fclose(fp);
+		goto RET;
+	}
+	if(fclose(fp) != 0) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		goto RET;
+	}
+	ret = 0;
+RET:
+	free(data);
+	return ret;
+}
+
+/*
+ * 头部和各段的长度, 各段的起始位置由长度依次算出
+ */
+static int _check_header(const unsigned char *data, size_t size) {
+	const expr_image_header_t *hdr = (const expr_image_header_t *)data;
+	size_t rest;
+
+	if(size < sizeof(expr_image_header_t) || ((size_t)data & 7) != 0) {
+		_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	if(memcmp(hdr->magic, EXPR_IMAGE_MAGIC, sizeof(EXPR_IMAGE_MAGIC)) != 0) {
+		_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	if(hdr->version != EXPR_IMAGE_VERSION || hdr->endian != EXPR_IMAGE_ENDIAN) {
+		_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	if(hdr->size != size) {
+		_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	rest = size - sizeof(expr_image_header_t);
+	if(hdr->nprogs > rest / sizeof(expr_image_prog_t)) { goto ERR_SIZE; }
+	rest -= (size_t)hdr->nprogs * sizeof(expr_image_prog_t);
+	if(hdr->ninsts > rest / sizeof(expr_image_inst_t)) { goto ERR_SIZE; }
+	rest -= (size_t)hdr->ninsts * sizeof(expr_image_inst_t);
+	if(hdr->nvars > rest / sizeof(expr_image_var_t)) { goto ERR_SIZE; }
+	rest -= (size_t)hdr->nvars * sizeof(expr_image_var_t);
+	if(hdr->nstrs != rest || rest % 8 != 0) { goto ERR_SIZE; }
+	if(expr_image_checksum(hdr + 1, size - sizeof(expr_image_header_t)) != hdr->checksum) {
+		_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+		return -1;
+	}
+	return 0;
+ERR_SIZE:
+	_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+	return -1;
+}
+
+/*
+ * 字符串常量在字符串区的界内, 从8字节边界开始, 并且以'\0'结尾
+ */
+static int _check_str(const image_view_t *v, uint64_t off) {
+	const expr_image_str_t *head = (const expr_image_str_t *)(v->strs + off);
+	uint64_t nstrs = v->hdr->nstrs;
+	if(off % 8 != 0 || off >= nstrs || nstrs - off < sizeof(expr_image_str_t)) {
+		return 0;
+	}
+	off += sizeof(expr_image_str_t);
+	return head->len < nstrs - off && '\0' == v->strs[off + head->len];
+}
+
+/*
+ * 按解释器的规则模拟值栈: 操作数足够, 跳转和它的 && 或 || 互相对应并且正确嵌套,
+ * 跳过右边时栈深度和执行右边后相同, 最后只剩一个值.
+ * depths 记录跳转时的栈深度, opens 是还没遇到 && 或 || 的跳转, 都至少 ninsts 项
+ */
+static int _check_prog(const image_view_t *v, const expr_image_prog_t *p, size_t *depths, size_t *opens) {
+	const expr_image_header_t *hdr = v->hdr;
+	const expr_image_inst_t *code;
+	const expr_image_var_t *vars;
+	size_t i, depth = 0, njmps = 0, nopens = 0;
+
+	if(p->ninsts == 0 || p->first_inst > hdr->ninsts || p->ninsts > hdr->ninsts - p->first_inst \
+			|| p->first_var > hdr->nvars || p->nvars > hdr->nvars - p->first_var) {
+		return -1;
+	}
+	code = v->insts + p->first_inst;
+	vars = v->vars + p->first_var;
+	for(i=0; i<p->nvars; ++i) {
+		if(vars[i].name >= hdr->nstrs || !memchr(v->strs + vars[i].name, '\0', hdr->nstrs - vars[i].name) \
+				|| vars[i].slot < INT_MIN || vars[i].slot > INT_MAX) {
+			return -1;
+		}
+	}
+	for(i=0; i<p->ninsts; ++i) {
+		if(_INST_JMP_FALSE == code[i].op || _INST_JMP_TRUE == code[i].op) {
+			njmps++;
+		}
+	}
+	for(i=0; i<p->ninsts; ++i) {
+		const expr_image_inst_t *inst = code + i;
+		int op = inst->op;
+		if((inst->folded & ~(_STR_FOLDED_A | _STR_FOLDED_B)) != 0) {
+			return -1;
+		}
+		if(_INST_CONST == op || _INST_VAR == op) {
+			if(_INST_VAR == op && inst->u.ref.var >= p->nvars) { return -1; }
+			if(_INST_CONST == op && (inst->type > _DATA_TYPE_STR \
+					|| (_DATA_TYPE_STR == inst->type && !_check_str(v, inst->u.value)))) {
+				return -1;
+			}
+			depth++;
+		}
+		else if(_INST_JMP_FALSE == op || _INST_JMP_TRUE == op) {
+			int logic = _INST_JMP_FALSE == op ? _OPER_AND : _OPER_OR;
+			size_t target = inst->u.ref.target;
+			if(depth < 1 || inst->u.ref.var >= njmps || target <= i + 1 || target > p->ninsts \
+					|| code[target - 1].op != logic || code[target - 1].u.ref.target != i) {
+				return -1;
+			}
+			depths[i] = depth;
+			opens[nopens++] = i;
+			depth--;
+		}
+		else if(_OPER_AND == op || _OPER_OR == op) {
+			int jmp = _OPER_AND == op ? _INST_JMP_FALSE : _INST_JMP_TRUE;
+			if(depth < 1 || nopens == 0 || opens[nopens - 1] != inst->u.ref.target \
+					|| code[opens[nopens - 1]].op != jmp || depths[opens[nopens - 1]] != depth) {
+				return -1;
+			}
+			nopens--;
+		}
+		else if(_OPER_NOT == op) {
+			if(depth < 1) { return -1; }
+		}
+		else if(op >= _OPER_EQ && op <= _OPER_CNE) {
+			if(depth < 2) { return -1; }
+			depth--;
+		}
+		else {
+			return -1;
+		}
+	}
+	return 1 == depth && 0 == nopens ? 0 : -1;
+}
+
+/*
+ * 由映像中的记录生成程序, 数组直接指向预先分配的内存, 不归程序所有
+ */
+static void _setup_prog(const image_view_t *v, const expr_image_prog_t *p, \
+		expr_program *prog, expr_inst_t *code, char **names, int *slots) {
+	const expr_image_inst_t *icode = v->insts + p->first_inst;
+	const expr_image_var_t *ivars = v->vars + p->first_var;
+	char *strs = v->strs;
+	size_t i;
+
+	memset(prog, 0x00, sizeof(expr_program));
+	for(i=0; i<p->nvars; ++i) {
+		names[i] = strs + ivars[i].name;
+		slots[i] = (int)ivars[i].slot;
+	}
+	for(i=0; i<p->ninsts; ++i) {
+		expr_inst_t *inst = code + i;
+		memset(inst, 0x00, sizeof(expr_inst_t));
+		inst->op = icode[i].op;
+		inst->folded = icode[i].folded;
+		inst->offset = icode[i].offset;
+		if(_INST_CONST != inst->op) {
+			inst->var = icode[i].u.ref.var;
+			inst->target = icode[i].u.ref.target;
+		}
+		if(_INST_VAR == inst->op) {
+			inst->varname = names[inst->var];
+		}
+		else if(_INST_JMP_FALSE == inst->op || _INST_JMP_TRUE == inst->op) {
+			prog->nlogic++;
+		}
+		else if(_INST_CONST == inst->op) {
+			inst->value.type = icode[i].type;
+			inst->value.borrowed = 1;
+			if(_DATA_TYPE_INT == inst->value.type) {
+				inst->value.u.n = (int64_t)icode[i].u.value;
+			}
+			else if(_DATA_TYPE_DOUBLE == inst->value.type) {
+				memcpy(&inst->value.u.d, &icode[i].u.value, sizeof(double));
+			}
+			else {
+				const expr_image_str_t *head = (const expr_image_str_t *)(strs + icode[i].u.value);
+				inst->value.u.p = (char *)(head + 1);
+				inst->value.len = (size_t)head->len;
+				inst->value.hash = head->hash;
+			}
+		}
+	}
+	prog->executable = (int)p->executable;
+	prog->code._data = code;
+	prog->code._size = prog->code._capacity = (size_t)p->ninsts;
+	prog->code._element_size = sizeof(expr_inst_t);
+	prog->vars._data = names;
+	prog->vars._size = prog->vars._capacity = (size_t)p->nvars;
+	prog->vars._element_size = sizeof(char *);
+	prog->slots._data = slots;
+	prog->slots._size = prog->slots._capacity = (size_t)p->nvars;
+	prog->slots._element_size = sizeof(int);
+	_program_stack_size(prog);
+}
+
+expr_image * expr_image_load(const void *data, size_t size) {
+	const expr_image_header_t *hdr = (const expr_image_header_t *)data;
+	const expr_image_prog_t *iprogs;
+	image_view_t v;
+	expr_image *img = 0;
+	expr_inst_t *code;
+	char **names;
+	int *slots;
+	size_t i, max_insts = 0, *depths = 0;
+
+	if(!data || _check_header((const unsigned char *)data, size) < 0) {
+		return 0;
+	}
+	_view(hdr, &v);
+	iprogs = v.progs;
+	for(i=0; i<hdr->nprogs; ++i) {
+		if(iprogs[i].ninsts > max_insts && iprogs[i].ninsts <= hdr->ninsts) {
+			max_insts = (size_t)iprogs[i].ninsts;
+		}
+	}
+	depths = (size_t *)malloc(sizeof(size_t) * (max_insts + 1) * 2);
+	if(!depths) {
+		_expr_error(0, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		return 0;
+	}
+	for(i=0; i<hdr->nprogs; ++i) {
+		if(_check_prog(&v, iprogs + i, depths, depths + max_insts + 1) < 0) {
+			_expr_error(0, EXPR_ERR_IMAGE, EXPR_NO_OFFSET, 0, 0);
+			free(depths);
+			return 0;
+		}
+	}
+	free(depths);
+
+	img = (expr_image *)malloc(sizeof(expr_image));
+	if(!img) {
+		_expr_error(0, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		return 0;
+	}
+	memset(img, 0x00, sizeof(expr_image));
+	img->data = (const unsigned char *)data;
+	img->size = size;
+	img->nprogs = (size_t)hdr->nprogs;
+	img->progs = (expr_program *)malloc(sizeof(expr_program) * img->nprogs \
+			+ sizeof(expr_inst_t) * (size_t)hdr->ninsts + (sizeof(char *) + sizeof(int)) * (size_t)hdr->nvars + 1);
+	if(!img->progs) {
+		_expr_error(0, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		free(img);
+		return 0;
+	}
+	code = (expr_inst_t *)(img->progs + img->nprogs);
+	names = (char **)(code + hdr->ninsts);
+	slots = (int *)(names + hdr->nvars);
+	for(i=0; i<img->nprogs; ++i) {
+		_setup_prog(&v, iprogs + i, img->progs + i, code + iprogs[i].first_inst, \
+				names + iprogs[i].first_var, slots + iprogs[i].first_var);
+	}
+	return img;
+}
+
+expr_image * expr_image_open(const char *path) {
+	expr_image *img = 0;
+	void *mem = 0;
+	size_t size = 0;
+#ifdef _EXPR_IMAGE_MMAP
+	struct stat st;
+	int fd;
+
+	if(!path) {
+		return 0;
+	}
+	fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		return 0;
+	}
+	if(fstat(fd, &st) < 0 || st.st_size <= 0) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		close(fd);
+		return 0;
+	}
+	size = (size_t)st.st_size;
+	mem = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(MAP_FAILED == mem) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		return 0;
+	}
+	img = expr_image_load(mem, size);
+	if(!img) {
+		munmap(mem, size);
+		return 0;
+	}
+#else
+	FILE *fp;
+	long len;
+
+	if(!path) {
+		return 0;
+	}
+	fp = fopen(path, "rb");
+	if(!fp) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		return 0;
+	}
+	if(fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+		size = (size_t)len;
+		mem = malloc(size);
+		if(mem && fread(mem, 1, size, fp) != size) {
+			free(mem);
+			mem = 0;
+		}
+	}
+	fclose(fp);
+	if(!mem) {
+		_expr_error(0, EXPR_ERR_SYSTEM, EXPR_NO_OFFSET, 0, path);
+		return 0;
+	}
+	img = expr_image_load(mem, size);
+	if(!img) {
+		free(mem);
+		return 0;
+	}
+#endif
+	img->owned = mem;
+	return img;
+}
+
+void expr_image_close(expr_image *img) {
+	if(!img) {
+		return;
+	}
+	free(img->progs);
+	if(img->owned) {
+#ifdef _EXPR_IMAGE_MMAP
+		munmap(img->owned, img->size);
+#else
+		free(img->owned);
+#endif
+	}
+	free(img);
+}
+
+size_t expr_image_count(const expr_image *img) {
+	return img ? img->nprogs : 0;
+}
+
+expr_program * expr_image_program(expr_image *img, size_t idx) {
+	if(!img || idx >= img->nprogs) {
+		return 0;
+	}
+	return img->progs + idx;
+}
@@ -0,0 +1,111 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 编译结果的二进制映像: 把一批编译好的程序存成文件, 启动时 mmap 只读映射后直接使用,
+ * 不再解析文本, 也不为每个节点申请内存. 多个进程映射同一个文件时共享这些页面.
+ * 映像中只有下标和偏移, 不含指针, 可以映射到任意地址.
+ */
+#ifndef _EXPR_IMAGE_H_
+#define _EXPR_IMAGE_H_
+
+#include "expr_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 文件格式, 按本机字节序, 各段依次紧接在头部后面:
+ * 头部, 程序表[nprogs], 指令表[ninsts], 变量表[nvars], 字符串区[nstrs].
+ * 字符串区的每一项从8字节边界开始, 变量名以'\0'结尾, 字符串常量是 expr_image_str_t
+ * 后面跟着内容和'\0'. 版本不同、字节序不同、长度或校验和不符, 以及下标越界、
+ * 指令序列不合法时拒绝加载.
+ */
+#define EXPR_IMAGE_MAGIC	"EXPRIMG"
+#define EXPR_IMAGE_VERSION	1
+#define EXPR_IMAGE_ENDIAN	0x01020304u
+
+typedef struct expr_image_header_t {
+	char magic[8];			/* EXPR_IMAGE_MAGIC, 以'\0'结尾 */
+	uint32_t version;
+	uint32_t endian;		/* EXPR_IMAGE_ENDIAN, 读出不同说明字节序不同 */
+	uint64_t size;			/* 整个映像的字节数 */
+	uint64_t checksum;		/* 头部之后全部字节的 expr_image_checksum */
+	uint64_t nprogs;
+	uint64_t ninsts;
+	uint64_t nvars;
+	uint64_t nstrs;			/* 字符串区的字节数 */
+} expr_image_header_t;
+
+typedef struct expr_image_prog_t {
+	uint64_t first_inst;	/* 在指令表中的起始下标 */
+	uint64_t ninsts;
+	uint64_t first_var;		/* 在变量表中的起始下标 */
+	uint64_t nvars;
+	uint32_t executable;
+	uint32_t reserved;
+} expr_image_prog_t;
+
+/*
+ * 指令的字段同编译结果, 变量名由 var 在本程序的变量表中找到
+ */
+typedef struct expr_image_inst_t {
+	uint8_t op;
+	uint8_t folded;
+	uint8_t type;				/* 常量的类型 */
+	uint8_t reserved;
+	uint32_t offset;			/* 在表达式中的偏移 */
+	union {
+		uint64_t value;			/* 常量: 整数, 浮点数的各位, 或字符串在字符串区的偏移 */
+		struct {
+			uint32_t var;		/* 变量的下标, 跳转指令的统计下标 */
+			uint32_t target;	/* 跳转的目标, && 和 || 对应的跳转指令 */
+		} ref;
+	} u;
+} expr_image_inst_t;
+
+typedef struct expr_image_str_t {
+	uint64_t hash;				/* expr_str_hash */
+	uint64_t len;
+} expr_image_str_t;
+
+typedef struct expr_image_var_t {
+	uint64_t name;			/* 变量名在字符串区的偏移, 以'\0'结尾 */
+	int64_t slot;
+} expr_image_var_t;
+
+typedef struct expr_image expr_image;
+
+/*
+ * 按8字节一组的 FNV-1a, 长度不是8的倍数时剩余的字节逐个计入
+ */
+extern uint64_t expr_image_checksum(const void *data, size_t size);
+
+/*
+ * 把 n 个程序连同变量绑定的槽位写成映像. build 的结果由调用方 free.
+ */
+extern int expr_image_build(expr_program * const *progs, size_t n, void **data, size_t *size);
+extern int expr_image_save(const char *path, expr_program * const *progs, size_t n);
+
+/*
+ * open 只读映射文件, 不支持 mmap 的平台读入内存.
+ * load 使用调用方的内存, 须按8字节对齐, 在 close 之前保持有效.
+ * 校验通过后一次分配全部程序的指令和槽位, 字符串常量和变量名留在映像中.
+ */
+extern expr_image * expr_image_open(const char *path);
+extern expr_image * expr_image_load(const void *data, size_t size);
+extern void expr_image_close(expr_image *img);
+
+/*
+ * 取出的程序归映像所有, 不能 expr_program_delete, 在 close 之前有效.
+ * 可以执行、批量执行、重新绑定槽位; 没有语法树, 不能打印和设置求值顺序.
+ */
+extern size_t expr_image_count(const expr_image *img);
+extern expr_program * expr_image_program(expr_image *img, size_t idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
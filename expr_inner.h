@@ -0,0 +1,311 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 解析器内部的数据结构, 只供本库的各个模块使用.
+ */
+#ifndef _EXPR_INNER_H_
+#define _EXPR_INNER_H_
+
+#include "array.h"
+#include "expr_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 运算符枚举
+ */
+#define _OPER_EQ	0	/* ==	, 数字相等 */
+#define _OPER_NE	1	/* !=	, 数字不等 */
+#define _OPER_LT	2	/* <	, 数字小于 */
+#define _OPER_LE	3	/* >=	, 数字小于等于 */
+#define _OPER_GT	4	/* >	, 数字大于 */
+#define _OPER_GE	5	/* >=	, 数字大于等于 */
+#define _OPER_SE	6	/* -se	, 字符串相等 */
+#define _OPER_SNE	7	/* -sne	, 字符串不等 */
+#define _OPER_CE	8	/* -ce	, 字符串相等（忽略大小写）*/
+#define _OPER_CNE	9	/* -cne	, 字符串不等（忽略大小写）*/
+#define _OPER_AND	10	/* &&	, 逻辑与 */
+#define _OPER_OR	11	/* ||	, 逻辑或 */
+#define _OPER_NOT	12	/* !	, 逻辑非 */
+#define _OPER_BRK_L	13	/* (	, 左括号 */
+#define _OPER_BRK_R	14	/* )	, 右括号 */
+
+/*
+ * 运算符
+ */
+#define _TEXT_EQ	"=="
+#define _TEXT_NE	"!="
+#define _TEXT_LT	"<"
+#define _TEXT_LE	"<="
+#define _TEXT_GT	">"
+#define _TEXT_GE	">="
+#define _TEXT_SE	"-se"
+#define _TEXT_SNE	"-sne"
+#define _TEXT_CE	"-ce"
+#define _TEXT_CNE	"-cne"
+#define _TEXT_AND	"&&"
+#define _TEXT_OR	"||"
+#define _TEXT_NOT	"!"
+#define _TEXT_BRK_L	"("
+#define _TEXT_BRK_R	")"
+
+/*
+ * 数据类型
+ */
+#define _DATA_TYPE_INT 0
+#define _DATA_TYPE_DOUBLE 1
+#define _DATA_TYPE_STR 2
+
+/*
+ * 节点类型
+ */
+#define _NODE_TYPE_OPER	0
+#define _NODE_TYPE_DATA	1
+
+/*
+ * 数据节点的种类, 解析时确定
+ */
+#define _DATA_KIND_INT		0	/* 整数常量 */
+#define _DATA_KIND_DOUBLE	1	/* 浮点常量 */
+#define _DATA_KIND_STR		2	/* 字符串常量 */
+#define _DATA_KIND_BOOL		3	/* true/false */
+#define _DATA_KIND_VAR		4	/* 变量引用 */
+
+/*
+ * 运算符配置
+ */
+typedef struct _opercfg_t {
+	int oper;			/* 运算符枚举 */
+	char * text;		/* 运算符文本 */
+	int need_left;		/* 需要左参数 */
+	int need_right;		/* 需要右参数 */
+	int priority_l;		/* 在左边时优先级 */
+	int priority_r;		/* 在右边时优先级 */
+} opercfg_t ;
+
+struct expr_value_t{
+	int type;
+	int borrowed;		/* 1-字符串不归本值所有, clear时不释放 */
+	union {
+		int64_t n;
+		double d;
+		char * p;
+	} u;
+	size_t len;			/* 字符串长度, 可以包含'\0' */
+	uint64_t hash;		/* 字符串的 expr_str_hash, 0表示没有计算 */
+};
+
+/*
+ * 语法树节点
+ */
+typedef struct _expr_node_t {
+	int type;			/* 0-运算符, 1-数据 */
+	union {
+		int oper;
+		char * data;
+	}u;
+	int kind;			/* 数据节点的种类 */
+	expr_value_t value;	/* 常量的值 */
+	char * varname;		/* 变量名, 指向data内部 */
+	size_t offset;
+	struct _expr_node_t * left;
+	struct _expr_node_t * right;
+	size_t stat;		/* && 和 || 在统计表中的下标, 编译时分配 */
+	size_t cost;		/* 子树的估计代价, 编译时计算 */
+} expr_node_t;
+
+/*
+ * 指令操作码, 运算符指令直接使用 _OPER_* 的值
+ */
+#define _INST_CONST	32	/* 常量入栈 */
+#define _INST_VAR	33	/* 取变量入栈 */
+#define _INST_JMP_FALSE	34	/* && 左值为假时跳过右边, 否则出栈 */
+#define _INST_JMP_TRUE	35	/* || 左值为真时跳过右边, 否则出栈 */
+
+/*
+ * 后缀指令
+ */
+typedef struct _expr_inst_t {
+	int op;				/* 操作码 */
+	size_t offset;		/* 在表达式中的偏移, 用于报错 */
+	expr_value_t value;	/* _INST_CONST 的值, 字符串借用语法树节点的内存 */
+	char * varname;		/* _INST_VAR 的变量名 */
+	size_t var;			/* _INST_VAR 在变量表中的下标, 跳转指令的统计下标 */
+	size_t target;		/* 跳转指令的目标下标, && 和 || 指向自己的跳转指令 */
+	int folded;			/* -ce/-cne 预先转成小写的参数, _STR_FOLDED_A/_STR_FOLDED_B */
+} expr_inst_t;
+
+/*
+ * 自适应顺序的统计, 每个 && 和 || 一项, 下标0是左边, 1是右边
+ */
+typedef struct _logic_stat_t {
+	uint64_t evals[2];		/* 执行的次数 */
+	uint64_t decides[2];	/* 单独决定了结果的次数: && 为假, || 为真 */
+} logic_stat_t;
+
+/*
+ * 语法树的内存池, 块头后面紧跟数据
+ */
+typedef struct _arena_block_t {
+	struct _arena_block_t * next;
+	size_t size;
+	size_t used;
+} arena_block_t;
+
+typedef struct _expr_arena_t {
+	arena_block_t * head;
+	arena_block_t * cur;		/* 当前分配的块 */
+} expr_arena_t;
+
+/*
+ * 编译好的表达式, 编译完成后只读, 多个线程可以同时执行同一个程序
+ */
+struct expr_program {
+	struct _expr_node_t * root;		/* 化简后的语法树, 从映像加载时为空 */
+	int executable;					/* 解析出的根是运算符, 化简成常量后仍可执行 */
+	expr_arena_t arena;				/* 语法树节点和文本都从这里分配 */
+	array_t code;					/* 后缀指令序列 */
+	array_t vars;					/* 去重后的变量名 */
+	array_t slots;					/* 变量绑定的槽位, 与vars一一对应 */
+	size_t vstack_size;				/* 执行需要的值栈深度 */
+	size_t bstack_size;				/* 批量执行的栈深度, 跳转指令不出栈 */
+	size_t nlogic;					/* && 和 || 的个数 */
+};
+
+/*
+ * 执行上下文, 保存执行时会修改的状态, 每个线程各用一个
+ */
+struct expr_context {
+	struct expr_value_t * vstack;	/* 执行时的值栈, 按程序需要增长 */
+	size_t vstack_size;
+	uint64_t skips;					/* 短路次数 */
+	uint64_t skipped_insts;			/* 短路跳过的指令数 */
+	expr_error_t err;				/* 最近一次出错的原因 */
+#ifdef EXPR_METRICS
+	expr_metrics_t metrics;
+	unsigned int sample;			/* 每执行多少次测一次耗时, 0表示不测 */
+	unsigned int sample_count;
+#endif
+};
+
+/*
+ * 运行时统计的计数, 没有定义 EXPR_METRICS 时什么也不做
+ */
+#ifdef EXPR_METRICS
+#define _METRIC_INC(ctx, field)	((ctx)->metrics.field++)
+#else
+#define _METRIC_INC(ctx, field)	((void)0)
+#endif
+
+/*
+ * 解析和编译用的栈, 解析器里复用, 重新解析时不再申请内存
+ */
+typedef struct _parse_stack_t {
+	array_t values;		/* expr_node_t *, 数据和已完成的运算符 */
+	array_t opers;		/* 还缺右参数的运算符和左括号 */
+	array_t frames;		/* 编译时遍历语法树的栈 */
+	expr_error_t *err;	/* 解析出错时记到这里, 为空时只交给日志回调 */
+} parse_stack_t;
+
+struct expr_parser {
+	parse_stack_t _stack;
+	struct expr_program _prog;
+	struct expr_context _ctx;
+	logic_stat_t * _stats;			/* 自适应顺序的统计, 按 _prog.nlogic 增长 */
+	size_t _nstats;
+	uint64_t _adapt_interval;		/* 每执行这么多次重排一次, 0表示关闭 */
+	uint64_t _adapt_count;
+};
+
+/*
+ * 记下错误并交给日志回调, err 为空时只交给回调. 只在出错时调用, 不在正常路径上
+ */
+void _expr_error(expr_error_t *err, int code, size_t offset, const char *oper, const char *name);
+
+opercfg_t * _opercfg_of(int oper);
+
+/*
+ * 字符串比较的方式, 可以组合
+ */
+#define _STR_CASE		0	/* 区分大小写 */
+#define _STR_NOCASE		1	/* 忽略大小写 */
+#define _STR_FOLDED_A	2	/* a 已经预先转成小写(-ce/-cne 的常量参数) */
+#define _STR_FOLDED_B	4	/* b 已经预先转成小写 */
+
+/*
+ * 按长度比较两个字符串是否相等, 长度不同直接返回.
+ * 忽略大小写时ASCII字母置0x20位折叠, 不查 locale, 只有非ASCII字节交给 tolower.
+ * 不短于一个向量的先交给SIMD比较
+ */
+int _str_equal(const char *a, size_t alen, const char *b, size_t blen, int mode);
+
+/*
+ * 把常量原地转成小写, 和 _str_equal 的折叠规则一致
+ */
+void _str_fold(char *p, size_t len);
+
+/*
+ * 整数和浮点数的精确比较, 不把整数转成浮点. 返回 -1/0/1, 有NaN时返回 _CMP_UNORDERED.
+ * _i64_f64_bound 把 i op d 化成整数比较 i op2 c, 返回0; 结果和 i 无关时返回1(恒真)或2(恒假).
+ * _cmp_result 把比较结果换成运算符 op 的真值.
+ */
+#define _CMP_UNORDERED	2
+
+int _cmp_i64_f64(int64_t i, double d);
+int _i64_f64_bound(int op, double d, int *op2, int64_t *c);
+int _cmp_result(int op, int cmp);
+
+/*
+ * 值栈不够时按需要的深度增长, expr_jit.c 也用它做取值的缓冲
+ */
+int _context_reserve(struct expr_context *ctx, size_t size);
+
+/*
+ * 在调用方给出的内存里解析编译, 失败时已经释放(expr_cache.c 把程序嵌在缓存项里).
+ * _program_bytes 返回程序自身和它申请的堆内存的字节数.
+ */
+int _program_build(struct expr_program *prog, char *exp_str);
+void _program_uinit(struct expr_program *prog);
+size_t _program_bytes(const struct expr_program *prog);
+
+/*
+ * 有指令就可以执行: 解析成功, 或者从二进制映像加载(expr_image.c, 没有语法树).
+ * _program_stack_size 按指令计算两种执行方式需要的栈深度
+ */
+#define _program_compiled(prog)	((prog)->code._size > 0)
+
+void _program_stack_size(struct expr_program *prog);
+
+/*
+ * 语法树改动后重新生成指令, 变量表和槽位保持不变. frames 为空时使用临时的栈.
+ * 失败时程序被清空.
+ */
+int _program_recompile(struct expr_program *prog, array_t *frames);
+
+/*
+ * 按统计重排 && 和 || 链上的操作数(expr_adapt.c), 之后需要重新编译
+ */
+int _reorder_chains(struct expr_program *prog, const logic_stat_t *stats);
+
+/*
+ * 向量化比较内核(expr_simd.c), 返回已处理的行数
+ */
+size_t _simd_cmp_i64_ac(int level, int op, const int64_t *l, int64_t c, size_t n, uint64_t *mask);
+size_t _simd_cmp_i64_aa(int level, int op, const int64_t *l, const int64_t *r, size_t n, uint64_t *mask);
+size_t _simd_cmp_f64_ac(int level, int op, const double *l, double c, size_t n, uint64_t *mask);
+size_t _simd_cmp_f64_aa(int level, int op, const double *l, const double *r, size_t n, uint64_t *mask);
+
+/*
+ * 忽略大小写比较等长的两段内存, 返回确认相等的前缀长度.
+ * 遇到不同或者含非ASCII字节的块就停下, 剩余部分由调用方逐字节比较
+ */
+size_t _simd_str_nocase(int level, const char *a, const char *b, size_t len, int mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
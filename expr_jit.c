@@ -0,0 +1,622 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 按后缀指令的顺序生成代码, 编译时模拟值栈: 栈顶在 rax/xmm0 中, 下面的值压在机器栈上,
+ * 常量到用的时候才生成. 比较和逻辑运算的结果是 eax 中的 0/1.
+ * 生成的函数: int fn(expr_value_t *vals, expr_value_slot_getter getter, void *usrdata),
+ * 返回结果, 或者 _JIT_BAIL 表示交给解释器.
+ */
+#define _DEFAULT_SOURCE
+#include "expr_jit.h"
+#include "expr_inner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <stddef.h>
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__unix__)
+#define _EXPR_JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define _JIT_BAIL	2
+
+typedef int (*jit_fn_t)(expr_value_t *vals, expr_value_slot_getter getter, void *usrdata);
+
+struct expr_jit {
+	const expr_program * prog;
+	jit_fn_t fn;		/* 为空时只用解释器 */
+	void * mem;
+	size_t size;
+	size_t nvars;
+};
+
+#ifdef _EXPR_JIT_X64
+
+/*
+ * 编译时值栈中值的位置, 最多一个值在寄存器里, 它上面只能是常量
+ */
+#define _LOC_REG	0	/* 整数在 rax, 浮点在 xmm0 */
+#define _LOC_SPILL	1	/* 压在机器栈上 */
+#define _LOC_CONST	2	/* 常量, 还没有生成代码 */
+
+typedef struct _jit_item_t {
+	int loc;
+	int is_double;
+	int64_t n;
+	double d;
+} jit_item_t;
+
+/*
+ * 跳到退出的目标
+ */
+#define _JIT_TO_BAIL	((size_t)-1)
+
+typedef struct _jit_gen_t {
+	array_t code;		/* unsigned char */
+	array_t items;		/* jit_item_t */
+	array_t bails;		/* size_t, 跳到退出的 rel32 的位置 */
+	size_t * jumps;		/* 按目标指令下标, 跳转的 rel32 的位置+1. 每条 && 或 || 只有一个跳转指向它后面 */
+	size_t depth;		/* 机器栈上压了几个8字节, 调用前据此对齐 */
+	int error;
+} jit_gen_t;
+
+ARRAY_DEFINE(unsigned char, byte)
+ARRAY_DEFINE(jit_item_t, item)
+ARRAY_DEFINE(size_t, pos)
+
+/* setcc 的第二个字节 */
+#define _CC_E	0x94
+#define _CC_NE	0x95
+#define _CC_A	0x97
+#define _CC_AE	0x93
+#define _CC_BE	0x96
+#define _CC_L	0x9c
+#define _CC_LE	0x9e
+#define _CC_G	0x9f
+#define _CC_GE	0x9d
+#define _CC_P	0x9a
+#define _CC_NP	0x9b
+
+static void _emit(jit_gen_t *g, const char *bytes, size_t n) {
+	size_t i;
+	for(i=0; i<n; ++i) {
+		if(byte_array_push_back(&g->code, (unsigned char)bytes[i]) < 0) {
+			g->error = 1;
+		}
+	}
+}
+
+static void _emit_u32(jit_gen_t *g, uint32_t v) {
+	char b[4];
+	int i;
+	for(i=0; i<4; ++i) {
+		b[i] = (char)((v >> (i*8)) & 0xff);
+	}
+	_emit(g, b, 4);
+}
+
+static void _emit_u64(jit_gen_t *g, uint64_t v) {
+	_emit_u32(g, (uint32_t)(v & 0xffffffffu));
+	_emit_u32(g, (uint32_t)(v >> 32));
+}
+
+static uint64_t _double_bits(double d) {
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits;
+}
+
+/*
+ * 条件跳转或 jmp, 目标以后回填
+ */
+static void _emit_jump(jit_gen_t *g, const char *op, size_t n, size_t target) {
+	_emit(g, op, n);
+	if(_JIT_TO_BAIL == target) {
+		if(pos_array_push_back(&g->bails, array_size(&g->code)) < 0) {
+			g->error = 1;
+		}
+	}
+	else {
+		g->jumps[target] = array_size(&g->code) + 1;
+	}
+	_emit_u32(g, 0);
+}
+
+static void _patch_at(jit_gen_t *g, size_t pos) {
+	unsigned char *code = (unsigned char *)g->code._data;
+	uint32_t rel = (uint32_t)(array_size(&g->code) - (pos + 4));
+	int k;
+	for(k=0; k<4; ++k) {
+		code[pos + k] = (unsigned char)((rel >> (k*8)) & 0xff);
+	}
+}
+
+/*
+ * 把跳到 target 的跳转指向当前位置
+ */
+static void _patch(jit_gen_t *g, size_t target) {
+	size_t i;
+	if(_JIT_TO_BAIL == target) {
+		for(i=0; i<array_size(&g->bails); ++i) {
+			_patch_at(g, ((size_t *)g->bails._data)[i]);
+		}
+	}
+	else if(g->jumps[target]) {
+		_patch_at(g, g->jumps[target] - 1);
+	}
+}
+
+static jit_item_t * _top(jit_gen_t *g, size_t k) {
+	return (jit_item_t *)g->items._data + array_size(&g->items) - 1 - k;
+}
+
+static void _push_item(jit_gen_t *g, int loc, int is_double, int64_t n, double d) {
+	jit_item_t item;
+	item.loc = loc;
+	item.is_double = is_double;
+	item.n = n;
+	item.d = d;
+	if(item_array_push_back(&g->items, item) < 0) {
+		g->error = 1;
+	}
+}
+
+/*
+ * 要生成新值前, 把寄存器里的值压到机器栈上. 它上面可能还有没生成代码的常量
+ */
+static void _spill_top(jit_gen_t *g) {
+	size_t k;
+	for(k=0; k<array_size(&g->items); ++k) {
+		jit_item_t *item = _top(g, k);
+		if(_LOC_CONST == item->loc) {
+			continue;
+		}
+		if(_LOC_REG == item->loc) {
+			if(item->is_double) {
+				_emit(g, "\x66\x48\x0f\x7e\xc0", 5);	/* movq rax, xmm0 */
+			}
+			_emit(g, "\x50", 1);					/* push rax */
+			item->loc = _LOC_SPILL;
+			g->depth++;
+		}
+		break;
+	}
+}
+
+/*
+ * 常量装入 rax/xmm0 (right 为1) 或 rcx/xmm1
+ */
+static void _load_const(jit_gen_t *g, jit_item_t *item, int right) {
+	_emit(g, right ? "\x48\xb8" : "\x48\xb9", 2);	/* mov rax/rcx, imm64 */
+	_emit_u64(g, item->is_double ? _double_bits(item->d) : (uint64_t)item->n);
+	if(item->is_double) {
+		_emit(g, right ? "\x66\x48\x0f\x6e\xc0" : "\x66\x48\x0f\x6e\xc9", 5);	/* movq xmm0/xmm1 */
+	}
+}
+
+static void _setcc(jit_gen_t *g, int cc) {
+	char b[3];
+	b[0] = 0x0f;
+	b[1] = (char)cc;
+	b[2] = (char)0xc0;
+	_emit(g, b, 3);
+}
+
+/*
+ * 栈顶换成它的布尔值, 放在 eax
+ */
+static void _truth(jit_gen_t *g) {
+	jit_item_t *top = _top(g, 0);
+	if(_LOC_CONST == top->loc) {
+		int truth = top->is_double ? top->d != 0 : top->n != 0;
+		_spill_top(g);								/* 下面的值可能还在 rax 里 */
+		_emit(g, "\xb8", 1);						/* mov eax, imm32 */
+		_emit_u32(g, (uint32_t)truth);
+	}
+	else if(top->is_double) {
+		_emit(g, "\x66\x0f\x57\xc9", 4);			/* xorpd xmm1, xmm1 */
+		_emit(g, "\x66\x0f\x2e\xc1", 4);			/* ucomisd xmm0, xmm1 */
+		_setcc(g, _CC_NE);
+		_emit(g, "\x0f\x9a\xc1", 3);				/* setp cl */
+		_emit(g, "\x08\xc8", 2);					/* or al, cl */
+		_emit(g, "\x0f\xb6\xc0", 3);				/* movzx eax, al */
+	}
+	else {
+		_emit(g, "\x48\x85\xc0", 3);				/* test rax, rax */
+		_setcc(g, _CC_NE);
+		_emit(g, "\x0f\xb6\xc0", 3);
+	}
+	top->loc = _LOC_REG;
+	top->is_double = 0;
+}
+
+static void _emit_var(jit_gen_t *g, size_t var, int slot, int is_double) {
+	uint32_t disp = (uint32_t)(var * sizeof(expr_value_t));
+	_spill_top(g);
+	_emit(g, "\xbf", 1);							/* mov edi, slot */
+	_emit_u32(g, (uint32_t)slot);
+	_emit(g, "\x49\x8d\xb6", 3);					/* lea rsi, [r14+disp] */
+	_emit_u32(g, disp);
+	_emit(g, "\x4c\x89\xea", 3);					/* mov rdx, r13 */
+	if(g->depth % 2) {
+		_emit(g, "\x48\x83\xec\x08", 4);			/* sub rsp, 8 */
+	}
+	_emit(g, "\x41\xff\xd4", 3);					/* call r12 */
+	if(g->depth % 2) {
+		_emit(g, "\x48\x83\xc4\x08", 4);			/* add rsp, 8 */
+	}
+	_emit(g, "\x85\xc0", 2);						/* test eax, eax */
+	_emit_jump(g, "\x0f\x88", 2, _JIT_TO_BAIL);		/* js bail */
+	_emit(g, "\x41\x81\xbe", 3);					/* cmp dword [r14+disp], type */
+	_emit_u32(g, disp + (uint32_t)offsetof(expr_value_t, type));
+	_emit_u32(g, (uint32_t)(is_double ? _DATA_TYPE_DOUBLE : _DATA_TYPE_INT));
+	_emit_jump(g, "\x0f\x85", 2, _JIT_TO_BAIL);		/* jne bail */
+	if(is_double) {
+		_emit(g, "\xf2\x41\x0f\x10\x86", 5);		/* movsd xmm0, [r14+disp] */
+	}
+	else {
+		_emit(g, "\x49\x8b\x86", 3);				/* mov rax, [r14+disp] */
+	}
+	_emit_u32(g, disp + (uint32_t)offsetof(expr_value_t, u));
+	_push_item(g, _LOC_REG, is_double, 0, 0);
+}
+
+static int _flip(int op) {
+	switch(op) {
+	case _OPER_LT: return _OPER_GT;
+	case _OPER_LE: return _OPER_GE;
+	case _OPER_GT: return _OPER_LT;
+	case _OPER_GE: return _OPER_LE;
+	}
+	return op;
+}
+
+static void _cmp_int(jit_gen_t *g, int op) {
+	static const int ccs[] = {_CC_E, _CC_NE, _CC_L, _CC_LE, _CC_G, _CC_GE};
+	_emit(g, "\x48\x39\xc1", 3);					/* cmp rcx, rax */
+	_setcc(g, ccs[op - _OPER_EQ]);
+}
+
+static void _cmp_double(jit_gen_t *g, int op) {
+	switch(op) {
+	case _OPER_EQ:
+		_emit(g, "\x66\x0f\x2e\xc8", 4);			/* ucomisd xmm1, xmm0 */
+		_setcc(g, _CC_E);
+		_emit(g, "\x0f\x9b\xc1", 3);				/* setnp cl */
+		_emit(g, "\x20\xc8", 2);					/* and al, cl */
+		break;
+	case _OPER_NE:
+		_emit(g, "\x66\x0f\x2e\xc8", 4);
+		_setcc(g, _CC_NE);
+		_emit(g, "\x0f\x9a\xc1", 3);				/* setp cl */
+		_emit(g, "\x08\xc8", 2);					/* or al, cl */
+		break;
+	case _OPER_LT:
+	case _OPER_LE:
+		_emit(g, "\x66\x0f\x2e\xc1", 4);			/* ucomisd xmm0, xmm1 */
+		_setcc(g, _OPER_LT == op ? _CC_A : _CC_AE);
+		break;
+	default:
+		_emit(g, "\x66\x0f\x2e\xc8", 4);
+		_setcc(g, _OPER_GT == op ? _CC_A : _CC_AE);
+		break;
+	}
+}
+
+/*
+ * 整数(rdi)和浮点数(xmm0)混合比较, 调用 _cmp_i64_f64 后按 op 取真值
+ */
+static void _cmp_mixed_call(jit_gen_t *g, int op) {
+	int (*fn)(int64_t, double) = _cmp_i64_f64;
+	uint64_t addr;
+	memcpy(&addr, &fn, sizeof(addr));
+	_emit(g, "\x48\xb8", 2);						/* mov rax, imm64 */
+	_emit_u64(g, addr);
+	if(g->depth % 2) {
+		_emit(g, "\x48\x83\xec\x08", 4);
+	}
+	_emit(g, "\xff\xd0", 2);						/* call rax */
+	if(g->depth % 2) {
+		_emit(g, "\x48\x83\xc4\x08", 4);
+	}
+	switch(op) {
+	case _OPER_EQ: _emit(g, "\x85\xc0", 2); _setcc(g, _CC_E); break;
+	case _OPER_NE: _emit(g, "\x85\xc0", 2); _setcc(g, _CC_NE); break;
+	case _OPER_LT: _emit(g, "\x83\xf8\xff", 3); _setcc(g, _CC_E); break;
+	case _OPER_GT: _emit(g, "\x83\xf8\x01", 3); _setcc(g, _CC_E); break;
+	case _OPER_LE: _emit(g, "\x83\xc0\x01\x83\xf8\x01", 6); _setcc(g, _CC_BE); break;
+	default: _emit(g, "\x83\xf8\x01", 3); _setcc(g, _CC_BE); break;
+	}
+}
+
+static int _exact_double(int64_t n) {
+	return n >= -((int64_t)1 << 53) && n <= ((int64_t)1 << 53);
+}
+
+/*
+ * 比较栈顶两项, 结果 0/1 放在 eax.
+ * 整数和浮点常量比较时化成整数比较, 能精确表示的整数常量转成浮点, 其余调用精确比较.
+ */
+static void _emit_compare(jit_gen_t *g, int op) {
+	jit_item_t r = *_top(g, 0), l = *_top(g, 1);
+	array_pop_back(&g->items);
+	array_pop_back(&g->items);
+
+	if(_LOC_CONST == l.loc && _LOC_CONST == r.loc) {
+		int cmp;
+		if(!l.is_double && !r.is_double) { cmp = l.n < r.n ? -1 : (l.n > r.n ? 1 : 0); }
+		else if(!l.is_double) { cmp = _cmp_i64_f64(l.n, r.d); }
+		else if(!r.is_double) { cmp = _cmp_i64_f64(r.n, l.d); cmp = _CMP_UNORDERED == cmp ? cmp : -cmp; }
+		else { cmp = l.d < r.d ? -1 : (l.d > r.d ? 1 : (l.d == r.d ? 0 : _CMP_UNORDERED)); }
+		_push_item(g, _LOC_CONST, 0, _cmp_result(op, cmp), 0);
+		return;
+	}
+	/* 左值放到 rcx/xmm1, 右值留在 rax/xmm0 */
+	if(_LOC_SPILL == l.loc) {
+		_emit(g, "\x59", 1);						/* pop rcx */
+		g->depth--;
+		if(l.is_double) {
+			_emit(g, "\x66\x48\x0f\x6e\xc9", 5);	/* movq xmm1, rcx */
+		}
+	}
+	else if(_LOC_REG == l.loc) {
+		_emit(g, l.is_double ? "\x66\x0f\x28\xc8" : "\x48\x89\xc1", l.is_double ? 4 : 3);
+	}
+
+	/* 整数和浮点常量: 在编译时化简 */
+	if(l.is_double != r.is_double) {
+		jit_item_t *c = _LOC_CONST == r.loc ? &r : (_LOC_CONST == l.loc ? &l : 0);
+		if(c && c->is_double) {
+			int op2 = c == &r ? op : _flip(op), k;
+			int64_t n = 0;
+			k = _i64_f64_bound(op2, c->d, &op2, &n);
+			if(k) {
+				_push_item(g, _LOC_CONST, 0, 1 == k, 0);
+				return;
+			}
+			c->is_double = 0;
+			c->n = n;
+			if(c == &l) {
+				op = _flip(op2);
+			}
+			else {
+				op = op2;
+			}
+		}
+		else if(c && _exact_double(c->n)) {
+			c->is_double = 1;
+			c->d = (double)c->n;
+		}
+	}
+
+	if(l.is_double == r.is_double) {
+		if(_LOC_CONST == r.loc) { _load_const(g, &r, 1); }
+		if(_LOC_CONST == l.loc) { _load_const(g, &l, 0); }
+		if(l.is_double) { _cmp_double(g, op); } else { _cmp_int(g, op); }
+	}
+	else {
+		/* 整数一边放到 rdi, 浮点一边放到 xmm0 */
+		if(!l.is_double) {
+			if(_LOC_CONST == l.loc) {
+				_emit(g, "\x48\xbf", 2);			/* mov rdi, imm64 */
+				_emit_u64(g, (uint64_t)l.n);
+			}
+			else {
+				_emit(g, "\x48\x89\xcf", 3);		/* mov rdi, rcx */
+			}
+			if(_LOC_CONST == r.loc) { _load_const(g, &r, 1); }
+		}
+		else {
+			if(_LOC_CONST == r.loc) {
+				_emit(g, "\x48\xbf", 2);
+				_emit_u64(g, (uint64_t)r.n);
+			}
+			else {
+				_emit(g, "\x48\x89\xc7", 3);		/* mov rdi, rax */
+			}
+			if(_LOC_CONST == l.loc) {
+				_load_const(g, &l, 1);
+			}
+			else {
+				_emit(g, "\x66\x0f\x28\xc1", 4);	/* movapd xmm0, xmm1 */
+			}
+			op = _flip(op);
+		}
+		_cmp_mixed_call(g, op);
+	}
+	_emit(g, "\x0f\xb6\xc0", 3);					/* movzx eax, al */
+	_push_item(g, _LOC_REG, 0, 0, 0);
+}
+
+static int _emit_inst(jit_gen_t *g, const expr_program *prog, const int *types, size_t idx) {
+	expr_inst_t *inst = (expr_inst_t *)prog->code._data + idx;
+	switch(inst->op) {
+	case _INST_CONST:
+		if(_DATA_TYPE_INT == inst->value.type) {
+			_push_item(g, _LOC_CONST, 0, inst->value.u.n, 0);
+		}
+		else if(_DATA_TYPE_DOUBLE == inst->value.type) {
+			_push_item(g, _LOC_CONST, 1, 0, inst->value.u.d);
+		}
+		else {
+			return -1;
+		}
+		break;
+	case _INST_VAR:
+		_emit_var(g, inst->var, ((const int *)prog->slots._data)[inst->var], \
+				types && EXPR_COLUMN_DOUBLE == types[inst->var]);
+		break;
+	case _INST_JMP_FALSE:
+	case _INST_JMP_TRUE:
+		/* 跳过去时 eax 是左值的布尔值, 和 && 或 || 算完后一样 */
+		_truth(g);
+		_emit(g, "\x85\xc0", 2);					/* test eax, eax */
+		_emit_jump(g, _INST_JMP_FALSE == inst->op ? "\x0f\x84" : "\x0f\x85", 2, inst->target);
+		array_pop_back(&g->items);
+		break;
+	case _OPER_AND:
+	case _OPER_OR:
+		_truth(g);
+		break;
+	case _OPER_NOT:
+		_truth(g);
+		_emit(g, "\x83\xf0\x01", 3);				/* xor eax, 1 */
+		break;
+	case _OPER_EQ:
+	case _OPER_NE:
+	case _OPER_LT:
+	case _OPER_LE:
+	case _OPER_GT:
+	case _OPER_GE:
+		_emit_compare(g, inst->op);
+		break;
+	default:
+		/* 字符串比较等交给解释器 */
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * 生成整个函数, 失败返回-1
+ */
+static int _generate(jit_gen_t *g, const expr_program *prog, const int *types) {
+	size_t i, n = array_size((array_t *)&prog->code);
+	jit_item_t *top;
+
+	_emit(g, "\x53\x41\x54\x41\x55\x41\x56\x41\x57", 9);	/* push rbx, r12-r15 */
+	_emit(g, "\x49\x89\xfe", 3);					/* mov r14, rdi */
+	_emit(g, "\x49\x89\xf4", 3);					/* mov r12, rsi */
+	_emit(g, "\x49\x89\xd5", 3);					/* mov r13, rdx */
+	_emit(g, "\x48\x89\xe3", 3);					/* mov rbx, rsp */
+	for(i=0; i<n; ++i) {
+		_patch(g, i);
+		if(_emit_inst(g, prog, types, i) < 0) {
+			return -1;
+		}
+	}
+	_patch(g, n);
+	if(array_size(&g->items) != 1) {
+		return -1;
+	}
+	top = _top(g, 0);
+	if(top->is_double) {
+		return -1;
+	}
+	if(_LOC_CONST == top->loc) {
+		_emit(g, "\xb8", 1);
+		_emit_u32(g, (uint32_t)(int)top->n);
+	}
+	_emit(g, "\xeb\x05", 2);						/* jmp 跳过 bail */
+	_patch(g, _JIT_TO_BAIL);
+	_emit(g, "\xb8", 1);							/* bail: mov eax, _JIT_BAIL */
+	_emit_u32(g, _JIT_BAIL);
+	_emit(g, "\x48\x89\xdc", 3);					/* mov rsp, rbx */
+	_emit(g, "\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5b\xc3", 10);	/* pop r15-r12, rbx; ret */
+	return g->error ? -1 : 0;
+}
+
+static int _compile(expr_jit *jit, const int *types) {
+	jit_gen_t g;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	int ret = -1;
+	void *mem;
+
+	memset(&g, 0x00, sizeof(g));
+	byte_array_init(&g.code);
+	item_array_init(&g.items);
+	pos_array_init(&g.bails);
+	g.jumps = (size_t *)calloc(array_size((array_t *)&jit->prog->code) + 1, sizeof(size_t));
+	if(!g.jumps || _generate(&g, jit->prog, types) < 0) {
+		goto RET;
+	}
+	jit->size = (array_size(&g.code) + page - 1) / page * page;
+	mem = mmap(0, jit->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(MAP_FAILED == mem) {
+		goto RET;
+	}
+	memcpy(mem, g.code._data, array_size(&g.code));
+	if(mprotect(mem, jit->size, PROT_READ | PROT_EXEC) < 0) {
+		munmap(mem, jit->size);
+		goto RET;
+	}
+	jit->mem = mem;
+	memcpy(&jit->fn, &mem, sizeof(jit->fn));
+	ret = 0;
+RET:
+	array_uinit(&g.code);
+	array_uinit(&g.items);
+	array_uinit(&g.bails);
+	free(g.jumps);
+	return ret;
+}
+
+#endif
+
+expr_jit * expr_jit_new(const expr_program *prog, const int *var_types) {
+	expr_jit *jit = 0;
+	if(!prog || !_program_compiled(prog)) {
+		return 0;
+	}
+	jit = (expr_jit *)malloc(sizeof(expr_jit));
+	if(!jit) {
+		return 0;
+	}
+	memset(jit, 0x00, sizeof(expr_jit));
+	jit->prog = prog;
+	jit->nvars = array_size((array_t *)&prog->vars);
+#ifdef _EXPR_JIT_X64
+	if(prog->executable) {
+		_compile(jit, var_types);
+	}
+#else
+	(void)var_types;
+#endif
+	return jit;
+}
+
+void expr_jit_delete(expr_jit *jit) {
+	if(jit) {
+#ifdef _EXPR_JIT_X64
+		if(jit->mem) {
+			munmap(jit->mem, jit->size);
+		}
+#endif
+		free(jit);
+	}
+}
+
+int expr_jit_native(const expr_jit *jit) {
+	return jit && jit->fn ? 1 : 0;
+}
+
+int expr_jit_execute(const expr_jit *jit, expr_context *ctx, int *result, \
+		expr_value_slot_getter getter, void *usrdata) {
+	int ret;
+	size_t i;
+	if(!jit || !ctx || !result || !getter) {
+		return -1;
+	}
+	if(jit->fn) {
+		/* 没有变量时上下文可能还没有值栈 */
+		if(jit->nvars) {
+			if(_context_reserve(ctx, jit->nvars) < 0) {
+				return -1;
+			}
+			memset(ctx->vstack, 0x00, sizeof(expr_value_t) * jit->nvars);
+		}
+		ret = jit->fn(ctx->vstack, getter, usrdata);
+		if(_JIT_BAIL != ret) {
+			*result = ret;
+			return 0;
+		}
+		/* 可能取到了字符串, 释放后由解释器重新执行 */
+		for(i=0; i<jit->nvars; ++i) {
+			expr_value_clear(ctx->vstack + i);
+		}
+	}
+	return expr_program_execute_slot(jit->prog, ctx, result, getter, usrdata);
+}
@@ -0,0 +1,45 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * x86-64 即时编译: 把编译好的程序翻译成机器码, 执行时不再解释指令.
+ * 支持数值比较、&&、||、!、整数和浮点常量; 含有字符串比较等其他指令的程序只用解释器.
+ * 变量按创建时给定的类型编译, 执行时取到的类型不符、取值失败时, 这一次改由解释器执行,
+ * 结果和 expr_program_execute_slot 一致.
+ * 其他平台上 expr_jit_new 照常成功, 全部走解释器.
+ */
+#ifndef _EXPR_JIT_H_
+#define _EXPR_JIT_H_
+
+#include "expr_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct expr_jit expr_jit;
+
+/*
+ * var_types 按程序的变量下标给出类型, EXPR_COLUMN_INT64 或 EXPR_COLUMN_DOUBLE,
+ * 为空时都按 EXPR_COLUMN_INT64. 变量的槽位在编译时取定, 之后再绑定不影响机器码.
+ * 程序要比 jit 活得久, 编译后不能再修改(比如 expr_program_set_order).
+ */
+extern expr_jit * expr_jit_new(const expr_program *prog, const int *var_types);
+extern void expr_jit_delete(expr_jit *jit);
+
+/*
+ * 1 表示生成了机器码, 0 表示只用解释器
+ */
+extern int expr_jit_native(const expr_jit *jit);
+
+/*
+ * ctx 提供取值的缓冲和解释器的值栈, 多个线程可以各用一个 ctx 同时执行同一个 jit
+ */
+extern int expr_jit_execute(const expr_jit *jit, expr_context *ctx, int *result, \
+		expr_value_slot_getter getter, void *usrdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
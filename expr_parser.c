@@ -1,976 +1,1956 @@
-/**
- * author: jason886
- * link: https://github.com/Jason886/expr_parser.git
- *
- */
-#include "array.h"
-#include "expr_parser.h"
-#include <stdlib.h>
-#include <string.h>
-#include <memory.h>
-#include <stdio.h>
-#include <ctype.h>
-#include <assert.h>
-#include <stdarg.h>
-
-/* #define __EXPR_LOG */
-#ifdef __EXPR_LOG
-static void __expr_log_info(char *fmt, ...) {
-	va_list args;
-	va_start(args, fmt);
-	vprintf(fmt, args);
-	va_end(args);
-}
-#else
-static void __expr_log_info(char *fmt, ...) {
-}
-#endif
-
-static void __expr_log_err(size_t line, char *fmt, ...) {
-	va_list args;
-	printf("[error] %s:%lu, ", __FILE__, line);
-	va_start(args, fmt);
-	vprintf(fmt, args);
-	va_end(args);
-	printf("\n");
-}
-
-static int strcasecmp(const char* s1, const char* s2) {
-	char c1, c2;
-	do { c1 = *s1++; c2 = *s2++; }
-	while (c1 && c2 && (tolower(c1) == tolower(c2)));
-	return tolower(c1) - tolower(c2);
-}
-
-static int strncasecmp(const char* s1, const char* s2, size_t n) {
-	char c1, c2;
-	if (!n) return 0;
-	do { c1 = *s1++; c2 = *s2++; }
-	while (--n && c1 && c2 && (tolower(c1) == tolower(c2)));
-	return tolower(c1) - tolower(c2);
-}
-
-/*
- * 运算符枚举
- */
-#define _OPER_EQ	0	/* ==	, 数字相等 */
-#define _OPER_NE	1	/* !=	, 数字不等 */
-#define _OPER_LT	2	/* <	, 数字小于 */
-#define _OPER_LE	3	/* >=	, 数字小于等于 */
-#define _OPER_GT	4	/* >	, 数字大于 */
-#define _OPER_GE	5	/* >=	, 数字大于等于 */
-#define _OPER_SE	6	/* -se	, 字符串相等 */
-#define _OPER_SNE	7	/* -sne	, 字符串不等 */
-#define _OPER_CE	8	/* -ce	, 字符串相等（忽略大小写）*/
-#define _OPER_CNE	9	/* -cne	, 字符串不等（忽略大小写）*/
-#define _OPER_AND	10	/* &&	, 逻辑与 */
-#define _OPER_OR	11	/* ||	, 逻辑或 */
-#define _OPER_NOT	12	/* !	, 逻辑非 */
-#define _OPER_BRK_L	13	/* (	, 左括号 */
-#define _OPER_BRK_R	14	/* )	, 右括号 */
-
-/*
- * 运算符
- */
-#define _TEXT_EQ	"=="
-#define _TEXT_NE	"!="
-#define _TEXT_LT	"<"
-#define _TEXT_LE	"<="
-#define _TEXT_GT	">"
-#define _TEXT_GE	">="
-#define _TEXT_SE	"-se"
-#define _TEXT_SNE	"-sne"
-#define _TEXT_CE	"-ce"
-#define _TEXT_CNE	"-cne"
-#define _TEXT_AND	"&&"
-#define _TEXT_OR	"||"
-#define _TEXT_NOT	"!"
-#define _TEXT_BRK_L	"("
-#define _TEXT_BRK_R	")"
-
-/*
- * 数据类型
- */
-#define _DATA_TYPE_INT 0
-#define _DATA_TYPE_DOUBLE 1
-#define _DATA_TYPE_STR 2
-
-/*
- * 节点类型
- */
-#define _NODE_TYPE_OPER	0
-#define _NODE_TYPE_DATA	1
-
-/*
- * 运算符配置
- */
-typedef struct _opercfg_t {
-	int oper;			/* 运算符枚举 */
-	char * text;		/* 运算符文本 */
-	int need_left;		/* 需要左参数 */
-	int need_right;		/* 需要右参数 */
-	int priority_l;		/* 在左边时优先级 */
-	int priority_r;		/* 在右边时优先级 */
-} opercfg_t ;
-
-/*
- * 语法树节点
- */
-typedef struct _expr_node_t {
-	int type;			/* 0-运算符, 1-数据 */
-	union {
-		int oper;
-		char * data;
-	}u;
-	size_t offset;
-	struct _expr_node_t * left;
-	struct _expr_node_t * right;
-} expr_node_t;
-
-struct expr_parser {
-	struct _expr_node_t * root;
-	array_t _ndstack;
-	/*
-	char err_text[256];
-	*/
-};
-
-struct expr_value_t{
-	int type;
-	union {
-		int64_t n;
-		double d;
-		char * p;
-	} u;
-};
-
-
-ARRAY_DEFINE(opercfg_t, opercfg)
-ARRAY_DEFINE(expr_node_t *, node)
-
-static array_t _opercfgs;
-
-static opercfg_t _new_opercfg(int oper, char * text, int need_left, int need_right, \
-		int priority_l, int priority_r) {
-	opercfg_t cfg = {0};
-	cfg.oper = oper;
-	cfg.text = text;
-	cfg.need_left = need_left;
-	cfg.need_right = need_right;
-	cfg.priority_l = priority_l;
-	cfg.priority_r = priority_r;
-	return cfg;
-}
-
-static opercfg_t * _opercfg_of(int oper) {
-	size_t size = array_size(&_opercfgs);
-	size_t i = 0;
-	for( ; i<size; ++i) {
-		opercfg_t *cfg = 0;
-		array_ref_at(&_opercfgs, i, (void **)&cfg);
-		if(oper == cfg->oper) {
-			return cfg;
-		}
-	}
-	return 0;
-}
-
-static int _cmp_oper_len(const void *a, const void *b) {
-	const opercfg_t * aa = (const opercfg_t *)a;
-	const opercfg_t * bb = (const opercfg_t *)b;
-	int alen = aa->text != 0 ? strlen(aa->text) : 0;
-	int blen = bb->text != 0 ? strlen(bb->text) : 0;
-	return alen > blen ? -1 : (alen < blen ? 1 : 0);
-}
-
-static expr_node_t * _new_node(int type) {
-	expr_node_t * node = (expr_node_t *) malloc(sizeof(expr_node_t));
-	if(node) {
-		memset(node, 0x00, sizeof(expr_node_t));
-		node->type = type;
-	}
-	return node;
-}
-
-static void _free_node(expr_node_t *node) {
-	if(0 != node) {
-		if(_NODE_TYPE_DATA == node->type) {
-			if(0 != node->u.data) {
-				free(node->u.data);
-			}
-		}
-		if(0 != node->left) {
-			_free_node(node->left);
-		}
-		if(0 != node->right) {
-			_free_node(node->right);
-		}
-
-		free(node);
-	}
-}
-
-static void _output_node(expr_node_t * node) {
-	if(0 != node->left) {
-		_output_node(node->left);
-	}
-	if(0 != node->right) {
-		_output_node(node->right);
-	}
-
-	if(node->type == _NODE_TYPE_OPER) {
-		opercfg_t * cfg = _opercfg_of(node->u.oper);
-		printf("%s, ", cfg->text);
-	}
-	else {
-		printf("%s, ", node->u.data);
-	}
-}
-
-static void _clear_stack(array_t * stack) {
-	if(stack) {
-		size_t i = 0;
-		size_t size = array_size(stack);
-		for( ;i<size; ++i) {
-			expr_node_t * node = 0;
-			array_at(stack, i, &node);
-			_free_node(node);
-		}
-		array_clear(stack);
-	}
-}
-
-expr_parser * expr_parser_new() {
-	static int _opercfgs_inited = 0;
-	expr_parser * parser = 0;
-	if(!_opercfgs_inited) {
-		opercfg_array_init(&_opercfgs);
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_EQ, (char *)_TEXT_EQ, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_NE, (char *)_TEXT_NE, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_LT, (char *)_TEXT_LT, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_LE, (char *)_TEXT_LE, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_GT, (char *)_TEXT_GT, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_GE, (char *)_TEXT_GE, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_SE, (char *)_TEXT_SE, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_SNE, (char *)_TEXT_SNE, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_CE, (char *)_TEXT_CE, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_CNE, (char *)_TEXT_CNE, 1, 1, 4, 4));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_AND, (char *)_TEXT_AND, 1, 1, 3, 3));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_OR, (char *)_TEXT_OR, 1, 1, 2, 2));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_NOT, (char *)_TEXT_NOT, 0, 1, 1, 7));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_BRK_L, (char *)_TEXT_BRK_L, 0, 1, 0, 0));
-		opercfg_array_push_back(&_opercfgs, _new_opercfg(_OPER_BRK_R, (char *)_TEXT_BRK_R, 0, 0, 0, 0));
-		array_shrink(&_opercfgs);
-
-		qsort(_opercfgs._data, _opercfgs._size, _opercfgs._element_size, _cmp_oper_len);
-		
-		_opercfgs_inited = 1;
-	}
-
-	parser = (expr_parser*) malloc(sizeof(expr_parser));
-	if(parser) {
-		memset(parser, 0x00, sizeof(expr_parser));
-		node_array_init(&(parser->_ndstack));
-	}
-
-	return parser;
-}
-
-void expr_parser_delete(expr_parser *parser) {
-	if(parser) {
-		_clear_stack(&(parser->_ndstack));
-		free(parser);
-	}
-}
-
-expr_node_t * _pick_oper(char * exp_str, size_t * cursor) {
-	int len = 0;
-	size_t i=0;
-	if(exp_str[*cursor] == '\0') {
-		return 0;
-	}
-	for(; i< array_size(&_opercfgs); ++i) {
-		opercfg_t cfg;
-		array_at(&_opercfgs, i, (void *)&cfg); 
-		len = strlen(cfg.text);
-		if(strncmp(exp_str + (*cursor), cfg.text, len) == 0) {
-			expr_node_t *node = _new_node(_NODE_TYPE_OPER);
-			if(node) {
-				node->u.oper = cfg.oper;
-				node->left=0;
-				node->right=0;
-				node->offset = *cursor;
-			}
-			(*cursor) += len;
-			__expr_log_info("oper:%s, end:%lu.\n", cfg.text, (*cursor));
-			return node;
-		}
-	}
-
-	return 0;
-}
-
-static  int _is_varname_char(char c) {
-	return ( isalpha(c) || isdigit(c) || c == '_' || c == '.' || c == '[' || c == ']');
-}
-
-static int _is_number_start(char c) {
-	return isdigit(c) || c == '.' || c == '-' || c == '+';
-}
-
-static int _is_number_char(char c) {
-	return isdigit(c) || c == '.';
-}
-
-static int _is_number_str(char *str) {
-	int i = 1;
-	if(!_is_number_start(str[0])) { return 0; }
-	while(i<strlen(str)) {
-		if(!_is_number_char(str[i])) { return 0; }
-		i++;
-	}
-	return 1;
-}
-
-static expr_node_t * _pick_data(char *exp_str, size_t *cursor) {
-	expr_node_t * node = 0;
-	char *data = 0;
-	int start = -1;
-	int end = -1;
-
-	if(exp_str[*cursor] == '\0') {
-		return 0;
-	}
-	if(exp_str[*cursor] == '\"' || exp_str[*cursor] == '\'') {	/* "字符串开始 */
-		start = *cursor;
-		end = *cursor+1;
-		while(exp_str[end] != 0 && exp_str[end] != exp_str[*cursor])	{ end++;}
-		if(exp_str[end] == exp_str[*cursor]) end++;
-	}
-	else if(strncmp(exp_str+*cursor, "[[", 2) == 0) {	/* [[字符串开始 */
-		start = *cursor;
-		end = *cursor+2;
-		while(exp_str[end] != '\0' && (exp_str[end] != ']' || exp_str[end-1] != ']'))
-			{end++;}
-		if(exp_str[end] == ']') end++;
-	}
-	else if(strncmp(exp_str+*cursor, "$", 1) == 0) {	/* $引用变量 */
-		start = *cursor;
-		end = *cursor+1;
-		while(_is_varname_char(exp_str[end])) {end++;}
-	}
-	else if(_is_number_start(exp_str[*cursor])) {
-		start = *cursor;
-		end = *cursor + 1;
-		while(_is_number_char(exp_str[end])) {end++;}
-	}
-	else if(_is_varname_char(exp_str[*cursor])) {
-		start = *cursor;
-		end = *cursor + 1;
-		while(_is_varname_char(exp_str[end])) {end++;}
-	}
-	else {
-		return 0;
-	}
-
-	data = (char *)malloc(end-start+1);
-	if(data) {
-		memset(data, 0x00, end-start+1);
-		memcpy(data, exp_str+start, end-start);
-	}
-
-	node = _new_node(_NODE_TYPE_DATA);
-	if(node) {
-		node->u.data = data;
-		node->left = 0;
-		node->right = 0;
-		node->offset = *cursor;
-	}
-	
-	__expr_log_info("data:%s ,end:%d.\n", data, end);
-
-	*cursor = end;
-	return node;
-}
-
-static void _slip_space(char *exp_str, size_t *cursor) {
-	if(exp_str[*cursor] == '\0') {
-		return;
-	}
-	while(isspace(exp_str[*cursor])) {
-		(*cursor)++;
-	}
-}
-
-static expr_node_t * _get_next_node(char *exp_str, size_t *cursor) {
-	expr_node_t * node = 0;
-	_slip_space(exp_str, cursor);
-	node = _pick_oper(exp_str, cursor);
-	if(node) { return node; }
-	_slip_space(exp_str, cursor);
-	node = _pick_data(exp_str, cursor);
-	return node;
-}
-
-static void _get_pre_oper(array_t * ndstack, expr_node_t ** pre_oper, size_t *oper_idx) {
-	expr_node_t *node = 0;
-	opercfg_t * cfg = 0;
-	size_t idx;
-	idx = array_size(ndstack);
-	while(idx > 0) {
-		idx --;
-		node = 0;
-		array_at(ndstack, idx, &node);
-		if(node) {
-			if(_NODE_TYPE_OPER == node->type) {
-				if(_OPER_BRK_L == node->u.oper) {
-					*pre_oper = node;
-					*oper_idx = idx;
-					return;
-				}
-				cfg = _opercfg_of(node->u.oper);
-				if(cfg->need_right && 0 == node->right) {
-					*pre_oper = node;
-					*oper_idx = idx;
-					return;
-				}
-			}
-		}
-	}
-	return;
-}
-
-static int _deal_brk_r(array_t * ndstack, expr_node_t * brk_node) {
-	expr_node_t * pre_oper = 0;
-	size_t pre_oper_idx = 0;
-	expr_node_t * right = 0;
-	while(1) {
-		pre_oper = 0;
-		pre_oper_idx = 0;
-		_get_pre_oper(ndstack, &pre_oper, &pre_oper_idx);
-		if(0 == pre_oper) {
-			if(array_size(ndstack) > 1) {
-				/* error */
-				__expr_log_err(__LINE__, "exp_str:%lu, unmatch with ')'.", \
-						brk_node->offset);
-				return -1;
-			}
-			return 0;
-		}
-		if(_OPER_BRK_L == pre_oper->u.oper) {
-			if(array_size(ndstack)-pre_oper_idx > 2) {
-				/* error */
-				__expr_log_err(__LINE__, "exp_str:%lu, more than 1 param in '()'.", \
-						pre_oper->offset);
-				return -1;
-			}
-			_free_node(pre_oper);
-			array_erase(ndstack, pre_oper_idx);
-			return 0;
-		}
-
-		if(array_size(ndstack)-pre_oper_idx<=1) {
-			/* error */
-			opercfg_t * cfg = _opercfg_of(pre_oper->u.oper);
-			__expr_log_err(__LINE__, "exp_str:%lu, need param after '%s'.", \
-					pre_oper->offset, cfg->text);
-			return -1;
-		}
-		right = 0;
-		array_at(ndstack, pre_oper_idx +1, &right);
-		pre_oper->right = right;
-		array_erase(ndstack, pre_oper_idx+1);
-		continue;
-	}
-}
-
-static int _link_left(array_t* ndstack, expr_node_t * link_node, size_t idx) {
-	expr_node_t *left = 0;
-	opercfg_t * cfg = 0;
-	cfg = _opercfg_of(link_node->u.oper);
-	if(cfg->need_left) {
-		if(array_size(ndstack) == 0) {
-			/* error */
-			__expr_log_err(__LINE__, "exp_str:%lu, need param before '%s'.", \
-					link_node->offset, cfg->text);
-			return -1;
-		}
-		left = 0;
-		array_at(ndstack, array_size(ndstack)-1, &left);
-		if(_NODE_TYPE_OPER == left->type) {
-			opercfg_t * leftcfg = _opercfg_of(left->u.oper);
-			if(leftcfg->need_right && 0 == left->right) {
-				/* error */
-				__expr_log_err(__LINE__, "exp_str:%lu, need param before '%s'.", \
-						link_node->offset, cfg->text);
-				return -1;
-			}
-		}
-		link_node->left = left;
-		array_erase(ndstack, array_size(ndstack)-1);
-		return 0;
-	}
-	return 0;
-}
-
-static int _link_right(array_t* ndstack, expr_node_t * link_node, size_t idx) {
-	expr_node_t *right = 0;
-	opercfg_t * cfg = _opercfg_of(link_node->u.oper);
-	if(cfg->need_right) {
-		if(idx == array_size(ndstack) -1) {
-			/* error */
-			__expr_log_err(__LINE__, "exp_str:%lu, need param after '%s'.", \
-					link_node->offset, cfg->text);
-			return -1;
-		}
-		right = 0;
-		array_at(ndstack, idx+1, &right);
-		link_node->right = right;
-		array_erase(ndstack, idx+1);
-		return 0;
-	}
-	return 0;
-}
-
-static int _deal_oper_node(array_t * ndstack, expr_node_t * oper_node) {
-	opercfg_t * curcfg = 0;
-	opercfg_t *precfg = 0;
-	expr_node_t * pre_oper = 0;
-	size_t pre_oper_idx = 0;
-	
-	curcfg = _opercfg_of(oper_node->u.oper);
-	while(1) {
-		pre_oper = 0;
-		pre_oper_idx = 0;
-		_get_pre_oper(ndstack, &pre_oper, &pre_oper_idx);
-		if(0 == pre_oper || _OPER_BRK_L == pre_oper->u.oper) {
-			if(_link_left(ndstack, oper_node, -1) < 0) {
-				return -1;
-			}
-			node_array_push_back(ndstack, oper_node);
-			return 0;
-		}
-
-		if(!curcfg->need_left) {
-			node_array_push_back(ndstack, oper_node);
-			return 0;
-		}
-		
-		precfg = _opercfg_of(pre_oper->u.oper);
-		if(precfg->priority_r >= curcfg->priority_r) {
-			if(_link_right(ndstack, pre_oper, pre_oper_idx) < 0) {
-				return -1;
-			}
-			continue;
-		}
-
-		if( _link_left(ndstack, oper_node, -1) < 0) {
-			return -1;
-		}
-		node_array_push_back(ndstack, oper_node);
-		return 0;
-	}
-}
-
-static int _deal_end(array_t * ndstack) {
-	size_t pre_oper_idx = 0;
-	expr_node_t * pre_oper = 0;
-	expr_node_t * right = 0;
-	while(1) {
-		pre_oper = 0;
-		pre_oper_idx = 0;
-		_get_pre_oper(ndstack, &pre_oper, &pre_oper_idx);
-		if(0 == pre_oper) {
-			if(array_size(ndstack) > 1) {
-				/* error */
-				__expr_log_err(__LINE__, "too many values.");
-				return -1;
-			}
-			if(array_size(ndstack) == 0) {
-				/* error */
-				__expr_log_err(__LINE__, "no value.");
-				return -1;
-			}
-			return 0;
-		}
-		if(_OPER_BRK_L == pre_oper->u.oper) {
-			/* error */
-			opercfg_t * cfg = _opercfg_of(pre_oper->u.oper);
-			__expr_log_err(__LINE__, "exp_str:%lu, unmatch with '%s'.", \
-					pre_oper->offset, cfg->text);
-			return -1;
-		}
-
-		if(array_size(ndstack)-pre_oper_idx<=1) {
-			/* error */
-			opercfg_t * cfg = _opercfg_of(pre_oper->u.oper);
-			__expr_log_err(__LINE__, "exp_str:%lu, need param after '%s'.", \
-					pre_oper->offset, cfg->text);
-			return -1;
-		}
-		right = 0;
-		array_at(ndstack, pre_oper_idx +1, &right);
-		array_erase(ndstack, pre_oper_idx+1);
-		pre_oper->right = right;
-		continue;
-	}
-}
-
-static expr_node_t * _parse_it(char *exp_str, array_t * ndstack) {
-	size_t cursor = 0;
-	expr_node_t * ret = 0;
-	_clear_stack(ndstack);
-	while(1) {
-		expr_node_t * node = _get_next_node(exp_str, &cursor);
-		if(!node) {
-			if(exp_str[cursor] != '\0') {
-				/* error */
-				__expr_log_err(__LINE__, "exp_str:%lu, unrecognized character '%c'.", \
-						cursor, exp_str[cursor]);
-				_clear_stack(ndstack);
-				return 0;
-			}
-
-			if(_deal_end(ndstack) < 0) { return 0; }
-
-			array_at(ndstack, 0, &ret);
-			return ret;
-		}
-
-		if(node->type == _NODE_TYPE_DATA) {
-			node_array_push_back(ndstack, node);
-			continue;
-		}
-		if(node->type == _NODE_TYPE_OPER) {
-			if(_OPER_BRK_L == node->u.oper) {
-				node_array_push_back(ndstack, node);
-				continue;
-			}
-			if(_OPER_BRK_R == node->u.oper) {
-				if(_deal_brk_r(ndstack, node) < 0) {
-					_free_node(node);
-					return 0;
-				}
-				_free_node(node);
-				continue;
-			}
-
-			if(_deal_oper_node(ndstack, node) < 0) {
-				_free_node(node);
-				return 0;
-			}
-		}
-	}
-}
-
-void expr_parser_reset(expr_parser *parser) {
-	if(parser) {
-		_clear_stack(&parser->_ndstack);
-		parser->root = 0;
-	}
-}
-
-int expr_parser_parse(expr_parser * parser, char *exp_str) {
-	if(parser) {
-		expr_parser_reset(parser);
-		parser->root = _parse_it(exp_str, &parser->_ndstack);
-		if(parser->root) {
-			return 0;
-		}
-	}
-	return -1;
-}
-
-static int _execute_data_node(expr_node_t *node, expr_value_t * value, \
-		expr_value_getter getter, void * usrdata) {
-	char varname[1024] = {0};
-	if(strncmp(node->u.data, "$", 1) == 0) {
-		if(getter((char *)node->u.data+1, value, usrdata) < 0) {
-			__expr_log_err(__LINE__, "value getter error, varname=%s.", \
-					node->u.data);
-			return -1;
-		}
-		return 0;
-	}
-	else {
-		if(node->u.data[0] == '\'' || node->u.data[0] == '\"') {
-			int end = strlen(node->u.data);
-			if(node->u.data[end-1] == node->u.data[0]) {
-				end--;
-			}
-			memset(varname, 0x00, sizeof(varname));
-			if(end-1 > 0) { 
-				memcpy(varname, node->u.data+1, end-1);
-			}
-			expr_value_set_str(value, varname, strlen(varname));
-		}
-		else if(strncmp(node->u.data, "[[", 2) == 0) {
-			int end = strlen(node->u.data);
-			if(strncmp(node->u.data + end -2, "]]", 2) == 0) {
-				end-=2;
-			}
-			memset(varname, 0x00, sizeof(varname));
-			if(end-2>0) {
-				memcpy(varname, node->u.data+2, end-2);
-			}
-			expr_value_set_str(value, varname, strlen(varname));
-		}
-		else if(strcmp(node->u.data, "true") == 0) {
-			expr_value_set_int(value, 1);
-		}
-		else if(strcmp(node->u.data, "false") == 0) {
-			expr_value_set_int(value, 0);
-		}
-		else {
-			int isnumber = _is_number_str(node->u.data);
-			if(isnumber) {
-				int dotpos = -1;
-				int i=0;
-				for(;i<strlen(node->u.data); ++i) {
-					if(node->u.data[i] == '.') {
-						dotpos = i;
-						break;
-					}
-				}
-
-				if(dotpos != -1 && dotpos != strlen(node->u.data) -1) {
-					double d = atof(node->u.data);
-					expr_value_set_double(value, d);
-				}
-				else {
-					int n = atoi(node->u.data);
-					expr_value_set_int(value, n);
-				}
-			}
-			else {
-				if(getter((char *)node->u.data, value, usrdata) < 0) {
-					__expr_log_err(__LINE__, "value getter error, varname=%s.", \
-							node->u.data);
-					return -1;
-				}
-			}
-		}
-
-		return 0;
-	}
-}
-
-static int _get_number_value(expr_value_t * value, double *number) {
-	assert(value);
-	assert(number);
-	if(value->type == _DATA_TYPE_INT) {
-		*number = (double) value->u.n;
-		return 0;
-	}
-	else if(value->type == _DATA_TYPE_DOUBLE) {
-		*number = value->u.d;
-		return 0;
-	}
-	return -1;
-}
-
-static int _execute_oper_node(expr_node_t *node, expr_value_t * value, \
-		expr_value_getter getter, void * usrdata) {
-	int ret = -1;
-	double l=0, r=0;
-	expr_value_t val_l = {0}, val_r = {0};
-	opercfg_t *cfg = 0;
-	expr_node_t *left = 0, *right = 0;
-	
-	assert(node);
-	assert(value);
-
-	memset(&val_l, 0x00, sizeof(val_l));
-	memset(&val_r, 0x00, sizeof(val_r));
-	left = node->left; right = node->right;
-	cfg = _opercfg_of(node->u.oper);
-
-	if(cfg->need_left) {
-		if(_NODE_TYPE_OPER == left->type) {
-			if(_execute_oper_node(left, &val_l, getter, usrdata) < 0) {
-				goto ERROR_RET;
-			}
-		}
-		else {
-			if(_execute_data_node(left, &val_l, getter, usrdata) < 0) {
-				goto ERROR_RET;
-			}
-		} 
-	}
-	if(cfg->need_right) {
-		if(_NODE_TYPE_OPER == right->type) {
-			if(_execute_oper_node(right, &val_r, getter, usrdata) < 0) {
-				goto ERROR_RET;
-			}
-		}
-		else {
-			if(_execute_data_node(right, &val_r, getter, usrdata) < 0) {
-				goto ERROR_RET;
-			}
-		} 
-	}
-
-	if(node->u.oper == _OPER_EQ) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l == r);
-	}
-	else if(node->u.oper == _OPER_NE) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l != r);
-	}
-	else if(node->u.oper == _OPER_LT) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l < r);
-	}
-	else if(node->u.oper == _OPER_LE) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l <= r);
-	}
-	else if(node->u.oper == _OPER_GT) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l > r);
-	}
-	else if(node->u.oper == _OPER_GE) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l >= r);
-	}
-	else if(node->u.oper == _OPER_SE) {
-		if(val_l.type != _DATA_TYPE_STR) goto ERROR_RET_L;
-		if(val_r.type != _DATA_TYPE_STR) goto ERROR_RET_R;
-		expr_value_set_int(value, strcmp(val_l.u.p, val_r.u.p) == 0);
-	}
-	else if(node->u.oper == _OPER_SNE) {
-		if(val_l.type != _DATA_TYPE_STR) goto ERROR_RET_L;
-		if(val_r.type != _DATA_TYPE_STR) goto ERROR_RET_R;
-		expr_value_set_int(value, strcmp(val_l.u.p, val_r.u.p) != 0);
-	}
-	else if(node->u.oper == _OPER_CE) {
-		if(val_l.type != _DATA_TYPE_STR) goto ERROR_RET_L;
-		if(val_r.type != _DATA_TYPE_STR) goto ERROR_RET_R;
-		expr_value_set_int(value, strcasecmp(val_l.u.p, val_r.u.p) == 0);
-	}
-	else if(node->u.oper == _OPER_CNE) {
-		if(val_l.type != _DATA_TYPE_STR) goto ERROR_RET_L;
-		if(val_r.type != _DATA_TYPE_STR) goto ERROR_RET_R;
-		expr_value_set_int(value, strcasecmp(val_l.u.p, val_r.u.p) != 0);
-	}
-	else if(node->u.oper == _OPER_AND) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l && r);
-	}
-	else if(node->u.oper == _OPER_OR) {
-		if(_get_number_value(&val_l, &l) < 0) goto ERROR_RET_L;
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, l || r);
-	}
-	else if(node->u.oper == _OPER_NOT) {
-		if(_get_number_value(&val_r, &r) < 0) goto ERROR_RET_R;
-		expr_value_set_int(value, !r);
-	}
-	else {
-		goto ERROR_RET_OPER;
-	}
-	
-	ret = 0;
-	goto RET;
-
-ERROR_RET_L:
-	__expr_log_err(__LINE__, "exp_str:%lu, invalid left param with '%s'.", \
-			node->offset, cfg->text);
-	goto ERROR_RET;
-ERROR_RET_R:
-	__expr_log_err(__LINE__, "exp_str:%lu, invalid right param with '%s'.", \
-			node->offset, cfg->text);
-	goto ERROR_RET;
-ERROR_RET_OPER:
-	__expr_log_err(__LINE__, "exp_str:%lu, '%s'.", \
-			node->offset, cfg->text);
-	goto ERROR_RET;
-ERROR_RET:
-	ret = -1;
-RET:
-	expr_value_clear(&val_l);
-	expr_value_clear(&val_r);
-	return ret;
-}
-
-int expr_parser_execute(expr_parser *parser, int *result, expr_value_getter getter, \
-		void * usrdata) {
-	int ret = -1;
-	expr_value_t value; 
-	assert(parser);
-	memset(&value,0x00, sizeof(value));
-	if(!parser->root) {
-		goto ERR_RET;
-	}
-	if(parser->root->type != _NODE_TYPE_OPER) {
-		__expr_log_err(__LINE__, "unexecutable!");
-		goto ERR_RET;
-	}
-	if(_execute_oper_node(parser->root, &value, getter, usrdata) < 0) {
-		goto ERR_RET;
-	}
-	if(value.type != _DATA_TYPE_INT) {
-		goto ERR_RET;
-	}
-	*result = (int)value.u.n;
-
-	ret = 0;
-	goto RET;
-ERR_RET:
-	ret = -1;
-RET:
-	expr_value_clear(&value);
-	return ret;
-}
-
-void expr_parser_print_tree(expr_parser *parser) {
-	assert(parser);
-	if(parser) {
-		if(parser->root) {
-			_output_node(parser->root);
-		}
-	}
-}
-
-void expr_value_set_int(expr_value_t *value, int64_t n) {
-	assert(value);
-	value->type = _DATA_TYPE_INT;
-	value->u.n = n;
-}
-
-void expr_value_set_double(expr_value_t *value, double d) {
-	assert(value);
-	value->type = _DATA_TYPE_DOUBLE;
-	value->u.d = d;
-}
-
-void expr_value_set_str(expr_value_t *value, char *p, size_t size) {
-	assert(value);
-	memset(value, 0x00, sizeof(*value));
-	value->type = _DATA_TYPE_STR;
-	value->u.p = (char *)malloc(size+1);
-	if(value->u.p) {
-		memset(value->u.p, 0x00, size+1);
-		if(p && size > 0) {
-			memcpy(value->u.p, p, size);
-		}
-	}
-}
-
-void expr_value_clear(expr_value_t * value) {
-	assert(value);
-	if(value->type == _DATA_TYPE_STR) {
-		if(value->u.p) {
-			free(value->u.p);
-		}
-	}
-}
-
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ */
+#ifdef EXPR_METRICS
+#define _POSIX_C_SOURCE 199309L
+#endif
+#include "array.h"
+#include "expr_parser.h"
+#include "expr_inner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <assert.h>
+#include <stdarg.h>
+#ifdef EXPR_METRICS
+#include <time.h>
+#endif
+
+/* #define __EXPR_LOG */
+#ifdef __EXPR_LOG
+static void __expr_log_info(char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+}
+#else
+static void __expr_log_info(char *fmt, ...) {
+}
+#endif
+
+/*
+ * 日志回调, 默认为空, 出错时什么也不输出
+ */
+static expr_log_fn _log_fn = 0;
+static void * _log_usrdata = 0;
+
+void expr_set_log(expr_log_fn fn, void *usrdata) {
+	_log_fn = fn;
+	_log_usrdata = usrdata;
+}
+
+void _expr_error(expr_error_t *err, int code, size_t offset, const char *oper, const char *name) {
+	expr_error_t local;
+	if(!err) {
+		err = &local;
+	}
+	err->code = code;
+	err->offset = offset;
+	err->oper = oper;
+	err->name = name;
+	if(_log_fn) {
+		_log_fn(err, _log_usrdata);
+	}
+}
+
+const char * expr_strerror(int code) {
+	static const char *texts[] = {
+		"no error",
+		"out of memory",
+		"unrecognized character",
+		"need param before operator",
+		"need param after operator",
+		"unmatched parenthesis",
+		"missing operator or value",
+		"unexecutable",
+		"value getter error",
+		"invalid left param",
+		"invalid right param",
+		"unsupported operator",
+		"result is not an integer",
+		"no column for variable",
+		"system call failed",
+		"invalid image"
+	};
+	if(code < 0 || (size_t)code >= sizeof(texts)/sizeof(texts[0])) {
+		return "unknown error";
+	}
+	return texts[code];
+}
+
+ARRAY_DEFINE(expr_node_t *, node)
+ARRAY_DEFINE(expr_inst_t, inst)
+ARRAY_DEFINE(char *, str)
+ARRAY_DEFINE(int, int)
+
+/*
+ * 解析时运算符栈的一项
+ */
+typedef struct _oper_entry_t {
+	expr_node_t * node;
+	size_t base;		/* 入栈时值栈的高度 */
+} oper_entry_t;
+
+/*
+ * 编译时遍历栈的一项
+ */
+typedef struct _compile_frame_t {
+	expr_node_t * node;
+	int state;			/* 0-未访问, 1-左子树已编译, 2-右子树已编译 */
+	size_t jmp_idx;		/* && 和 || 的跳转指令下标 */
+} compile_frame_t;
+
+ARRAY_DEFINE(oper_entry_t, oper)
+ARRAY_DEFINE(compile_frame_t, frame)
+
+/*
+ * 运算符配置表, 下标就是运算符枚举值.
+ * 静态初始化且只读, 多线程无需加锁.
+ */
+static opercfg_t _opercfgs[] = {
+	{_OPER_EQ,		_TEXT_EQ,		1, 1, 4, 4},
+	{_OPER_NE,		_TEXT_NE,		1, 1, 4, 4},
+	{_OPER_LT,		_TEXT_LT,		1, 1, 4, 4},
+	{_OPER_LE,		_TEXT_LE,		1, 1, 4, 4},
+	{_OPER_GT,		_TEXT_GT,		1, 1, 4, 4},
+	{_OPER_GE,		_TEXT_GE,		1, 1, 4, 4},
+	{_OPER_SE,		_TEXT_SE,		1, 1, 4, 4},
+	{_OPER_SNE,		_TEXT_SNE,		1, 1, 4, 4},
+	{_OPER_CE,		_TEXT_CE,		1, 1, 4, 4},
+	{_OPER_CNE,		_TEXT_CNE,		1, 1, 4, 4},
+	{_OPER_AND,		_TEXT_AND,		1, 1, 3, 3},
+	{_OPER_OR,		_TEXT_OR,		1, 1, 2, 2},
+	{_OPER_NOT,		_TEXT_NOT,		0, 1, 1, 7},
+	{_OPER_BRK_L,	_TEXT_BRK_L,	0, 1, 0, 0},
+	{_OPER_BRK_R,	_TEXT_BRK_R,	0, 0, 0, 0}
+};
+
+#define _OPERCFG_COUNT (sizeof(_opercfgs)/sizeof(_opercfgs[0]))
+
+opercfg_t * _opercfg_of(int oper) {
+	if(oper >= 0 && (size_t)oper < _OPERCFG_COUNT) {
+		assert(_opercfgs[oper].oper == oper);
+		return &_opercfgs[oper];
+	}
+	return 0;
+}
+
+/*
+ * 内存池: 在当前块上顺序分配, 放不下时换到下一块或申请新块.
+ * 重置只回到第一块, 已申请的块留给下次解析, 删除时才释放.
+ */
+#define _ARENA_BLOCK_SIZE	1024
+#define _ARENA_ALIGN		8
+
+static void * _arena_alloc(expr_arena_t *arena, size_t size) {
+	arena_block_t *block = arena->cur;
+	void *p = 0;
+
+	size = (size + _ARENA_ALIGN - 1) & ~(size_t)(_ARENA_ALIGN - 1);
+	if(!block || block->size - block->used < size) {
+		arena_block_t *next = block ? block->next : arena->head;
+		if(next && next->size >= size) {
+			next->used = 0;
+		}
+		else {
+			size_t bytes = block ? block->size * 2 : _ARENA_BLOCK_SIZE;
+			if(bytes < size) { bytes = size; }
+			next = (arena_block_t *)malloc(sizeof(arena_block_t) + bytes);
+			if(!next) {
+				return 0;
+			}
+			next->size = bytes;
+			next->used = 0;
+			if(block) {
+				next->next = block->next;
+				block->next = next;
+			}
+			else {
+				next->next = arena->head;
+				arena->head = next;
+			}
+		}
+		arena->cur = block = next;
+	}
+	p = (char *)(block + 1) + block->used;
+	block->used += size;
+	return p;
+}
+
+static char * _arena_strndup(expr_arena_t *arena, const char *str, size_t len) {
+	char *p = (char *)_arena_alloc(arena, len+1);
+	if(p) {
+		memcpy(p, str, len);
+		p[len] = '\0';
+	}
+	return p;
+}
+
+static void _arena_reset(expr_arena_t *arena) {
+	arena->cur = arena->head;
+	if(arena->cur) {
+		arena->cur->used = 0;
+	}
+}
+
+static void _arena_uinit(expr_arena_t *arena) {
+	arena_block_t *block = arena->head;
+	while(block) {
+		arena_block_t *next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->head = 0;
+	arena->cur = 0;
+}
+
+static expr_node_t * _new_node(expr_arena_t *arena, int type) {
+	expr_node_t * node = (expr_node_t *)_arena_alloc(arena, sizeof(expr_node_t));
+	if(node) {
+		memset(node, 0x00, sizeof(expr_node_t));
+		node->type = type;
+	}
+	return node;
+}
+
+/*
+ * 折叠一个字节: ASCII字母直接置0x20位, 不查 locale, 只有非ASCII字节交给 tolower.
+ * c 为 unsigned int, 会求值多次
+ */
+#define _FOLD(c)	((c) - 'A' < 26u ? ((c) | 0x20) : ((c) < 0x80 ? (c) : (unsigned int)tolower((int)(c))))
+
+void _str_fold(char *p, size_t len) {
+	size_t i;
+	for(i=0; i<len; ++i) {
+		unsigned int c = (unsigned char)p[i];
+		p[i] = (char)_FOLD(c);
+	}
+}
+
+/*
+ * 短于一个向量的字符串不走SIMD
+ */
+#define _SIMD_MIN_STR	16
+
+int _str_equal(const char *a, size_t alen, const char *b, size_t blen, int mode) {
+	size_t i = 0;
+	if(alen != blen) {
+		return 0;
+	}
+	if(!(mode & _STR_NOCASE)) {
+		return memcmp(a, b, alen) == 0;
+	}
+	if(alen >= _SIMD_MIN_STR) {
+		i = _simd_str_nocase(expr_simd_level(), a, b, alen, mode);
+	}
+	for( ; i<alen; ++i) {
+		unsigned int ca = (unsigned char)a[i], cb = (unsigned char)b[i];
+		if(ca == cb) {
+			continue;
+		}
+		if(!(mode & _STR_FOLDED_A)) {
+			ca = _FOLD(ca);
+		}
+		if(!(mode & _STR_FOLDED_B)) {
+			cb = _FOLD(cb);
+		}
+		if(ca != cb) { return 0; }
+	}
+	return 1;
+}
+
+/*
+ * -se/-sne: 长度或哈希不同时不看内容
+ */
+static int _value_str_equal(const expr_value_t *l, const expr_value_t *r) {
+	if(l->len != r->len || (l->hash && r->hash && l->hash != r->hash)) {
+		return 0;
+	}
+	return l->u.p == r->u.p || memcmp(l->u.p, r->u.p, l->len) == 0;
+}
+
+static void _output_node(expr_node_t * node) {
+	if(0 != node->left) {
+		_output_node(node->left);
+	}
+	if(0 != node->right) {
+		_output_node(node->right);
+	}
+
+	if(node->type == _NODE_TYPE_OPER) {
+		opercfg_t * cfg = _opercfg_of(node->u.oper);
+		printf("%s, ", cfg->text);
+	}
+	else {
+		printf("%s, ", node->u.data);
+	}
+}
+
+static void _stack_init(parse_stack_t *stack) {
+	node_array_init(&stack->values);
+	oper_array_init(&stack->opers);
+	frame_array_init(&stack->frames);
+	stack->err = 0;
+}
+
+static void _stack_clear(parse_stack_t *stack) {
+	array_clear(&stack->values);
+	array_clear(&stack->opers);
+	array_clear(&stack->frames);
+}
+
+static void _stack_uinit(parse_stack_t *stack) {
+	array_uinit(&stack->values);
+	array_uinit(&stack->opers);
+	array_uinit(&stack->frames);
+}
+
+static void _program_init(expr_program *prog) {
+	memset(prog, 0x00, sizeof(expr_program));
+	inst_array_init(&prog->code);
+	str_array_init(&prog->vars);
+	int_array_init(&prog->slots);
+}
+
+static void _program_clear(expr_program *prog) {
+	prog->root = 0;
+	prog->executable = 0;
+	_arena_reset(&prog->arena);
+	array_clear(&prog->code);
+	array_clear(&prog->vars);
+	array_clear(&prog->slots);
+	prog->vstack_size = 0;
+	prog->bstack_size = 0;
+	prog->nlogic = 0;
+}
+
+void _program_uinit(expr_program *prog) {
+	_program_clear(prog);
+	array_uinit(&prog->code);
+	array_uinit(&prog->vars);
+	array_uinit(&prog->slots);
+	_arena_uinit(&prog->arena);
+}
+
+static void _context_uinit(expr_context *ctx) {
+	if(ctx->vstack) {
+		free(ctx->vstack);
+	}
+	memset(ctx, 0x00, sizeof(expr_context));
+}
+
+expr_parser * expr_parser_new() {
+	expr_parser * parser = (expr_parser*) malloc(sizeof(expr_parser));
+	if(parser) {
+		memset(parser, 0x00, sizeof(expr_parser));
+		_stack_init(&(parser->_stack));
+		_program_init(&(parser->_prog));
+	}
+
+	return parser;
+}
+
+void expr_parser_delete(expr_parser *parser) {
+	if(parser) {
+		_stack_uinit(&(parser->_stack));
+		_program_uinit(&(parser->_prog));
+		_context_uinit(&(parser->_ctx));
+		if(parser->_stats) {
+			free(parser->_stats);
+		}
+		free(parser);
+	}
+}
+
+/*
+ * 按第一个字符分派识别运算符, 有多个候选时取最长的, 没有运算符返回-1
+ */
+static int _lex_oper(const char *p, size_t *len) {
+	*len = 2;
+	switch(p[0]) {
+	case '=':
+		return '=' == p[1] ? _OPER_EQ : -1;
+	case '!':
+		if('=' == p[1]) { return _OPER_NE; }
+		*len = 1;
+		return _OPER_NOT;
+	case '<':
+		if('=' == p[1]) { return _OPER_LE; }
+		*len = 1;
+		return _OPER_LT;
+	case '>':
+		if('=' == p[1]) { return _OPER_GE; }
+		*len = 1;
+		return _OPER_GT;
+	case '&':
+		return '&' == p[1] ? _OPER_AND : -1;
+	case '|':
+		return '|' == p[1] ? _OPER_OR : -1;
+	case '(':
+		*len = 1;
+		return _OPER_BRK_L;
+	case ')':
+		*len = 1;
+		return _OPER_BRK_R;
+	case '-':
+		if('s' != p[1] && 'c' != p[1]) { return -1; }
+		if('n' == p[2] && 'e' == p[3]) {
+			*len = 4;
+			return 's' == p[1] ? _OPER_SNE : _OPER_CNE;
+		}
+		if('e' == p[2]) {
+			*len = 3;
+			return 's' == p[1] ? _OPER_SE : _OPER_CE;
+		}
+		return -1;
+	default:
+		return -1;
+	}
+}
+
+expr_node_t * _pick_oper(expr_arena_t *arena, char * exp_str, size_t * cursor) {
+	size_t len = 0;
+	int oper = _lex_oper(exp_str + *cursor, &len);
+	expr_node_t *node = 0;
+	if(oper < 0) {
+		return 0;
+	}
+	node = _new_node(arena, _NODE_TYPE_OPER);
+	if(node) {
+		node->u.oper = oper;
+		node->left=0;
+		node->right=0;
+		node->offset = *cursor;
+	}
+	(*cursor) += len;
+	__expr_log_info("oper:%s, end:%lu.\n", _opercfgs[oper].text, (*cursor));
+	return node;
+}
+
+static  int _is_varname_char(char c) {
+	return ( isalpha(c) || isdigit(c) || c == '_' || c == '.' || c == '[' || c == ']');
+}
+
+static int _is_number_start(char c) {
+	return isdigit(c) || c == '.' || c == '-' || c == '+';
+}
+
+static int _is_number_char(char c) {
+	return isdigit(c) || c == '.';
+}
+
+static int _is_number_str(char *str) {
+	int i = 1;
+	if(!_is_number_start(str[0])) { return 0; }
+	while(i<strlen(str)) {
+		if(!_is_number_char(str[i])) { return 0; }
+		i++;
+	}
+	return 1;
+}
+
+/*
+ * 按完整的64位解析整数常量, 溢出返回-1
+ */
+static int _parse_int64(const char *s, int64_t *n) {
+	uint64_t v = 0, limit = (uint64_t)1 << 63;
+	int neg = 0;
+	if('-' == *s || '+' == *s) {
+		neg = '-' == *s;
+		s++;
+	}
+	if(!neg) {
+		limit--;
+	}
+	for( ; isdigit((unsigned char)*s); ++s) {
+		unsigned int d = (unsigned int)(*s - '0');
+		if(v > (limit - d) / 10) {
+			return -1;
+		}
+		v = v * 10 + d;
+	}
+	*n = (neg && v > 0) ? -(int64_t)(v - 1) - 1 : (int64_t)v;
+	return 0;
+}
+
+/*
+ * 字符串常量放在内存池里, 值只是借用
+ */
+static int _arena_set_str(expr_arena_t *arena, expr_value_t *value, char *p, size_t size) {
+	value->type = _DATA_TYPE_STR;
+	value->borrowed = 1;
+	value->u.p = _arena_strndup(arena, p, size);
+	value->len = size;
+	if(!value->u.p) {
+		return -1;
+	}
+	value->hash = expr_str_hash(value->u.p, size);
+	return 0;
+}
+
+/*
+ * 解析时确定数据节点的种类, 并把常量解码到节点中
+ */
+static int _classify_data(expr_arena_t *arena, expr_node_t *node) {
+	char *data = node->u.data;
+	size_t len = strlen(data);
+	if(data[0] == '$') {
+		node->kind = _DATA_KIND_VAR;
+		node->varname = data+1;
+	}
+	else if(data[0] == '\'' || data[0] == '\"') {
+		size_t end = len;
+		if(end > 1 && data[end-1] == data[0]) {
+			end--;
+		}
+		node->kind = _DATA_KIND_STR;
+		if(_arena_set_str(arena, &node->value, data+1, end-1) < 0) { return -1; }
+	}
+	else if(strncmp(data, "[[", 2) == 0) {
+		size_t end = len;
+		if(end >= 4 && strncmp(data + end -2, "]]", 2) == 0) {
+			end-=2;
+		}
+		node->kind = _DATA_KIND_STR;
+		if(_arena_set_str(arena, &node->value, data+2, end-2) < 0) { return -1; }
+	}
+	else if(strcmp(data, "true") == 0) {
+		node->kind = _DATA_KIND_BOOL;
+		expr_value_set_int(&node->value, 1);
+	}
+	else if(strcmp(data, "false") == 0) {
+		node->kind = _DATA_KIND_BOOL;
+		expr_value_set_int(&node->value, 0);
+	}
+	else if(_is_number_str(data)) {
+		char *dot = strchr(data, '.');
+		int64_t n = 0;
+		if((dot && dot != data+len-1) || _parse_int64(data, &n) < 0) {
+			/* 超出int64的整数也按浮点数处理 */
+			node->kind = _DATA_KIND_DOUBLE;
+			expr_value_set_double(&node->value, atof(data));
+		}
+		else {
+			node->kind = _DATA_KIND_INT;
+			expr_value_set_int(&node->value, n);
+		}
+	}
+	else {
+		node->kind = _DATA_KIND_VAR;
+		node->varname = data;
+	}
+	return 0;
+}
+
+/*
+ * 取一个数据节点放到 *out, 不是数据时 *out 为空. 内存不足时返回-1
+ */
+static int _pick_data(expr_arena_t *arena, char *exp_str, size_t *cursor, expr_node_t **out) {
+	expr_node_t * node = 0;
+	char *data = 0;
+	int start = -1;
+	int end = -1;
+
+	*out = 0;
+	if(exp_str[*cursor] == '\0') {
+		return 0;
+	}
+	if(exp_str[*cursor] == '\"' || exp_str[*cursor] == '\'') {	/* "字符串开始 */
+		start = *cursor;
+		end = *cursor+1;
+		while(exp_str[end] != 0 && exp_str[end] != exp_str[*cursor])	{ end++;}
+		if(exp_str[end] == exp_str[*cursor]) end++;
+	}
+	else if(strncmp(exp_str+*cursor, "[[", 2) == 0) {	/* [[字符串开始 */
+		start = *cursor;
+		end = *cursor+2;
+		while(exp_str[end] != '\0' && (exp_str[end] != ']' || exp_str[end-1] != ']'))
+			{end++;}
+		if(exp_str[end] == ']') end++;
+	}
+	else if(strncmp(exp_str+*cursor, "$", 1) == 0) {	/* $引用变量 */
+		start = *cursor;
+		end = *cursor+1;
+		while(_is_varname_char(exp_str[end])) {end++;}
+	}
+	else if(_is_number_start(exp_str[*cursor])) {
+		start = *cursor;
+		end = *cursor + 1;
+		while(_is_number_char(exp_str[end])) {end++;}
+	}
+	else if(_is_varname_char(exp_str[*cursor])) {
+		start = *cursor;
+		end = *cursor + 1;
+		while(_is_varname_char(exp_str[end])) {end++;}
+	}
+	else {
+		return 0;
+	}
+
+	data = _arena_strndup(arena, exp_str+start, end-start);
+	node = _new_node(arena, _NODE_TYPE_DATA);
+	if(!data || !node) {
+		return -1;
+	}
+	node->u.data = data;
+	node->left = 0;
+	node->right = 0;
+	node->offset = *cursor;
+	if(_classify_data(arena, node) < 0) {
+		return -1;
+	}
+	
+	__expr_log_info("data:%s ,end:%d.\n", data, end);
+
+	*cursor = end;
+	*out = node;
+	return 0;
+}
+
+static void _slip_space(char *exp_str, size_t *cursor) {
+	if(exp_str[*cursor] == '\0') {
+		return;
+	}
+	while(isspace(exp_str[*cursor])) {
+		(*cursor)++;
+	}
+}
+
+/*
+ * 取下一个运算符或数据放到 *node, 都不是时 *node 为空. 内存不足时返回-1
+ */
+static int _get_next_node(expr_arena_t *arena, char *exp_str, size_t *cursor, expr_node_t **node) {
+	size_t start;
+	_slip_space(exp_str, cursor);
+	start = *cursor;
+	*node = _pick_oper(arena, exp_str, cursor);
+	if(*node) { return 0; }
+	if(*cursor != start) { return -1; }	/* 认出了运算符, 但分配节点失败 */
+	_slip_space(exp_str, cursor);
+	return _pick_data(arena, exp_str, cursor, node);
+}
+
+/*
+ * 单遍线性解析: 数据和已完成的运算符放值栈, 还缺右参数的运算符和左括号放运算符栈.
+ * 运算符记下入栈时值栈的高度, 之后压入的值都是它的右参数候选.
+ * 每个运算符各入栈出栈一次.
+ */
+static oper_entry_t * _top_oper(parse_stack_t *stack) {
+	size_t size = array_size(&stack->opers);
+	return size > 0 ? (oper_entry_t *)stack->opers._data + size - 1 : 0;
+}
+
+static int _push_oper(parse_stack_t *stack, expr_node_t *node) {
+	oper_entry_t entry;
+	entry.node = node;
+	entry.base = array_size(&stack->values);
+	if(oper_array_push_back(&stack->opers, entry) < 0) {
+		_expr_error(stack->err, EXPR_ERR_NOMEM, node->offset, 0, 0);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * 栈顶运算符取它之后的第一个值作为右参数, 完成的运算符放回这个值的位置
+ */
+static int _link_top(parse_stack_t *stack, oper_entry_t *top) {
+	expr_node_t **values = (expr_node_t **)stack->values._data;
+	if(array_size(&stack->values) == top->base) {
+		/* error */
+		opercfg_t * cfg = _opercfg_of(top->node->u.oper);
+		_expr_error(stack->err, EXPR_ERR_NEED_RIGHT, top->node->offset, cfg->text, 0);
+		return -1;
+	}
+	top->node->right = values[top->base];
+	values[top->base] = top->node;
+	array_pop_back(&stack->opers);
+	return 0;
+}
+
+static int _link_left(parse_stack_t *stack, expr_node_t * link_node) {
+	opercfg_t * cfg = _opercfg_of(link_node->u.oper);
+	oper_entry_t *top = _top_oper(stack);
+	size_t size = array_size(&stack->values);
+	if(cfg->need_left) {
+		if(0 == size || (top && size == top->base)) {
+			/* error */
+			_expr_error(stack->err, EXPR_ERR_NEED_LEFT, link_node->offset, cfg->text, 0);
+			return -1;
+		}
+		link_node->left = ((expr_node_t **)stack->values._data)[size-1];
+		array_pop_back(&stack->values);
+	}
+	return 0;
+}
+
+static int _deal_brk_r(parse_stack_t *stack, expr_node_t * brk_node) {
+	oper_entry_t *top = 0;
+	while(1) {
+		top = _top_oper(stack);
+		if(0 == top) {
+			if(array_size(&stack->values) > 1) {
+				/* error */
+				_expr_error(stack->err, EXPR_ERR_PAREN, brk_node->offset, _TEXT_BRK_R, 0);
+				return -1;
+			}
+			return 0;
+		}
+		if(_OPER_BRK_L == top->node->u.oper) {
+			if(array_size(&stack->values) - top->base > 1) {
+				/* error */
+				_expr_error(stack->err, EXPR_ERR_VALUES, top->node->offset, _TEXT_BRK_L, 0);
+				return -1;
+			}
+			array_pop_back(&stack->opers);
+			return 0;
+		}
+		if(_link_top(stack, top) < 0) {
+			return -1;
+		}
+	}
+}
+
+static int _deal_oper_node(parse_stack_t *stack, expr_node_t * oper_node) {
+	opercfg_t * curcfg = _opercfg_of(oper_node->u.oper);
+	opercfg_t * precfg = 0;
+	oper_entry_t * top = 0;
+	while(1) {
+		top = _top_oper(stack);
+		if(0 == top || _OPER_BRK_L == top->node->u.oper) {
+			break;
+		}
+		if(!curcfg->need_left) {
+			return _push_oper(stack, oper_node);
+		}
+		precfg = _opercfg_of(top->node->u.oper);
+		if(precfg->priority_r < curcfg->priority_r) {
+			break;
+		}
+		if(_link_top(stack, top) < 0) {
+			return -1;
+		}
+	}
+	if(_link_left(stack, oper_node) < 0) {
+		return -1;
+	}
+	return _push_oper(stack, oper_node);
+}
+
+static int _deal_end(parse_stack_t *stack) {
+	oper_entry_t * top = 0;
+	while(1) {
+		top = _top_oper(stack);
+		if(0 == top) {
+			if(array_size(&stack->values) > 1) {
+				/* error */
+				expr_node_t *extra = ((expr_node_t **)stack->values._data)[1];
+				_expr_error(stack->err, EXPR_ERR_VALUES, extra->offset, 0, 0);
+				return -1;
+			}
+			if(array_size(&stack->values) == 0) {
+				/* error */
+				_expr_error(stack->err, EXPR_ERR_VALUES, EXPR_NO_OFFSET, 0, 0);
+				return -1;
+			}
+			return 0;
+		}
+		if(_OPER_BRK_L == top->node->u.oper) {
+			/* error */
+			opercfg_t * cfg = _opercfg_of(top->node->u.oper);
+			_expr_error(stack->err, EXPR_ERR_PAREN, top->node->offset, cfg->text, 0);
+			return -1;
+		}
+		if(_link_top(stack, top) < 0) {
+			return -1;
+		}
+	}
+}
+
+static expr_node_t * _parse_it(expr_arena_t *arena, char *exp_str, parse_stack_t * stack) {
+	size_t cursor = 0;
+	expr_node_t * ret = 0;
+	_stack_clear(stack);
+	while(1) {
+		expr_node_t * node = 0;
+		if(_get_next_node(arena, exp_str, &cursor, &node) < 0) {
+			_expr_error(stack->err, EXPR_ERR_NOMEM, cursor, 0, 0);
+			return 0;
+		}
+		if(!node) {
+			if(exp_str[cursor] != '\0') {
+				/* error */
+				_expr_error(stack->err, EXPR_ERR_CHAR, cursor, 0, 0);
+				return 0;
+			}
+
+			if(_deal_end(stack) < 0) { return 0; }
+
+			array_at(&stack->values, 0, &ret);
+			return ret;
+		}
+
+		if(node->type == _NODE_TYPE_DATA) {
+			if(node_array_push_back(&stack->values, node) < 0) {
+				_expr_error(stack->err, EXPR_ERR_NOMEM, node->offset, 0, 0);
+				return 0;
+			}
+			continue;
+		}
+		if(node->type == _NODE_TYPE_OPER) {
+			if(_OPER_BRK_L == node->u.oper) {
+				if(_push_oper(stack, node) < 0) { return 0; }
+				continue;
+			}
+			if(_OPER_BRK_R == node->u.oper) {
+				if(_deal_brk_r(stack, node) < 0) {
+					return 0;
+				}
+				continue;
+			}
+
+			if(_deal_oper_node(stack, node) < 0) {
+				return 0;
+			}
+		}
+	}
+}
+
+void expr_parser_reset(expr_parser *parser) {
+	if(parser) {
+		_stack_clear(&parser->_stack);
+		_program_clear(&parser->_prog);
+		parser->_ctx.skips = 0;
+		parser->_ctx.skipped_insts = 0;
+		memset(&parser->_ctx.err, 0x00, sizeof(expr_error_t));
+		if(parser->_stats) {
+			memset(parser->_stats, 0x00, sizeof(logic_stat_t) * parser->_nstats);
+		}
+		parser->_adapt_count = 0;
+	}
+}
+
+/*
+ * 查找变量名在变量表中的下标, 没有则追加, 默认槽位就是下标
+ */
+static int _register_var(expr_program *prog, char *varname, size_t *idx) {
+	char **vars = (char **)prog->vars._data;
+	size_t i = 0, size = array_size(&prog->vars);
+	for( ; i<size; ++i) {
+		if(strcmp(vars[i], varname) == 0) {
+			*idx = i;
+			return 0;
+		}
+	}
+	if(str_array_push_back(&prog->vars, varname) < 0) {
+		return -1;
+	}
+	if(int_array_push_back(&prog->slots, (int)size) < 0) {
+		array_pop_back(&prog->vars);
+		return -1;
+	}
+	*idx = size;
+	return 0;
+}
+
+static int _is_logic_node(expr_node_t *node) {
+	return _NODE_TYPE_OPER == node->type && \
+		(_OPER_AND == node->u.oper || _OPER_OR == node->u.oper);
+}
+
+static int _execute_oper(expr_inst_t *inst, expr_value_t *val_l, expr_value_t *val_r);
+
+static int _is_const_node(expr_node_t *node) {
+	return _NODE_TYPE_DATA == node->type && _DATA_KIND_VAR != node->kind;
+}
+
+/*
+ * 常量的布尔值, 不是数值时返回-1(执行时会报错, 不折叠)
+ */
+static int _const_truth(expr_node_t *node, int *truth) {
+	if(!_is_const_node(node) || _DATA_TYPE_STR == node->value.type) {
+		return -1;
+	}
+	*truth = _DATA_TYPE_INT == node->value.type ? node->value.u.n != 0 : node->value.u.d != 0;
+	return 0;
+}
+
+/*
+ * -ce/-cne 的字符串常量在编译时转成小写, 执行时只折叠另一边.
+ * 编译时据此设置指令的 folded
+ */
+static int _is_str_const(expr_node_t *node) {
+	return _is_const_node(node) && _DATA_TYPE_STR == node->value.type;
+}
+
+static void _fold_literal(expr_node_t *node) {
+	if(_is_str_const(node)) {
+		_str_fold(node->value.u.p, node->value.len);
+		node->value.hash = expr_str_hash(node->value.u.p, node->value.len);
+	}
+}
+
+/*
+ * 把运算符节点改成 true/false 常量, 偏移不变
+ */
+static expr_node_t * _set_bool(expr_node_t *node, int truth) {
+	node->type = _NODE_TYPE_DATA;
+	node->kind = _DATA_KIND_BOOL;
+	node->u.data = truth ? "true" : "false";
+	expr_value_set_int(&node->value, truth != 0);
+	node->left = 0;
+	node->right = 0;
+	return node;
+}
+
+/*
+ * 化简一个子树已经化简过的节点, 返回替代它的节点.
+ * truthy 为1表示父节点是 &&, || 或 !, 只用到它的布尔值: 非数值报错, 非0为真.
+ * 只在结果和报错都不变时化简: x && false 的 x 可能取值失败, 不化简.
+ */
+static expr_node_t * _fold_node(expr_node_t *node, int truthy) {
+	expr_node_t *l = node->left, *r = node->right;
+	int lt = 0, rt = 0;
+
+	if(_NODE_TYPE_OPER != node->type) {
+		return node;
+	}
+	switch(node->u.oper) {
+	case _OPER_NOT:
+		if(_const_truth(r, &rt) == 0) {
+			return _set_bool(node, !rt);
+		}
+		/* !!x */
+		if(_NODE_TYPE_OPER == r->type && _OPER_NOT == r->u.oper && !_is_const_node(r->right) \
+				&& (truthy || _NODE_TYPE_OPER == r->right->type)) {
+			return r->right;
+		}
+		return node;
+	case _OPER_AND:
+	case _OPER_OR: {
+		int is_and = _OPER_AND == node->u.oper;
+		if(_const_truth(l, &lt) == 0) {
+			if(lt != is_and) {
+				/* false && x, true || x, 右边本来就不执行 */
+				return _set_bool(node, lt);
+			}
+			if(_const_truth(r, &rt) == 0) {
+				return _set_bool(node, rt);
+			}
+			if(!_is_const_node(r) && (truthy || _NODE_TYPE_OPER == r->type)) {
+				return r;
+			}
+			return node;
+		}
+		if(_const_truth(r, &rt) == 0 && rt == is_and && !_is_const_node(l) \
+				&& (truthy || _NODE_TYPE_OPER == l->type)) {
+			/* x && true, x || false */
+			return l;
+		}
+		return node;
+	}
+	default: {
+		expr_inst_t inst;
+		expr_value_t val_l, val_r;
+		int is_str = node->u.oper >= _OPER_SE;
+		if(_OPER_CE == node->u.oper || _OPER_CNE == node->u.oper) {
+			_fold_literal(l);
+			_fold_literal(r);
+		}
+		if(!_is_const_node(l) || !_is_const_node(r) \
+				|| (_DATA_TYPE_STR == l->value.type) != is_str \
+				|| (_DATA_TYPE_STR == r->value.type) != is_str) {
+			return node;
+		}
+		memset(&inst, 0x00, sizeof(inst));
+		inst.op = node->u.oper;
+		inst.offset = node->offset;
+		inst.folded = _STR_FOLDED_A | _STR_FOLDED_B;
+		val_l = l->value;
+		val_r = r->value;
+		if(_execute_oper(&inst, &val_l, &val_r) != EXPR_ERR_NONE) {
+			return node;
+		}
+		return _set_bool(node, val_l.u.n != 0);
+	}
+	}
+}
+
+/*
+ * 常量折叠和布尔化简, 和编译一样用显式的栈后序遍历.
+ * 节点的父节点是栈中的前一帧, 父节点的 state 说明它是左孩子还是右孩子
+ */
+static int _optimize(expr_program *prog, array_t *frames) {
+	compile_frame_t frame;
+	memset(&frame, 0x00, sizeof(frame));
+	frame.node = prog->root;
+	array_clear(frames);
+	if(frame_array_push_back(frames, frame) < 0) { return -1; }
+	while(array_size(frames) > 0) {
+		compile_frame_t *top = (compile_frame_t *)frames->_data + array_size(frames) - 1;
+		expr_node_t *child = 0;
+		if(0 == top->state) {
+			top->state = 1;
+			child = top->node->left;
+		}
+		else if(1 == top->state) {
+			top->state = 2;
+			child = top->node->right;
+		}
+		else {
+			compile_frame_t *parent = array_size(frames) > 1 ? top - 1 : 0;
+			int truthy = parent && (_is_logic_node(parent->node) || _OPER_NOT == parent->node->u.oper);
+			expr_node_t *node = _fold_node(top->node, truthy);
+			if(!parent) {
+				prog->root = node;
+			}
+			else if(1 == parent->state) {
+				parent->node->left = node;
+			}
+			else {
+				parent->node->right = node;
+			}
+			array_pop_back(frames);
+			continue;
+		}
+		if(child) {
+			frame.node = child;
+			if(frame_array_push_back(frames, frame) < 0) { return -1; }
+		}
+	}
+	return 0;
+}
+
+/*
+ * 指令的估计代价, 用于自适应重排. 取变量要调用取值函数, 按多条指令计
+ */
+#define _COST_VAR	8
+#define _COST_STR	2
+
+static size_t _inst_cost(expr_inst_t *inst) {
+	if(_INST_VAR == inst->op) {
+		return _COST_VAR;
+	}
+	if(inst->op >= _OPER_SE && inst->op <= _OPER_CNE) {
+		return _COST_STR;
+	}
+	return 1;
+}
+
+/*
+ * 生成节点自身的指令, 子树已经编译完. && 和 || 在这里回填跳转目标
+ */
+static int _emit_node(expr_program *prog, expr_node_t *node, size_t jmp_idx) {
+	expr_inst_t inst;
+	memset(&inst, 0x00, sizeof(inst));
+	inst.offset = node->offset;
+	if(_NODE_TYPE_OPER == node->type) {
+		inst.op = node->u.oper;
+		if(_OPER_CE == inst.op || _OPER_CNE == inst.op) {
+			inst.folded = (_is_str_const(node->left) ? _STR_FOLDED_A : 0) \
+				| (_is_str_const(node->right) ? _STR_FOLDED_B : 0);
+		}
+	}
+	else if(_DATA_KIND_VAR == node->kind) {
+		inst.op = _INST_VAR;
+		inst.varname = node->varname;
+		if(_register_var(prog, node->varname, &inst.var) < 0) { return -1; }
+	}
+	else {
+		inst.op = _INST_CONST;
+		inst.value = node->value;
+		inst.value.borrowed = 1;
+	}
+	if(_is_logic_node(node)) {
+		inst.target = jmp_idx;
+	}
+	if(inst_array_push_back(&prog->code, inst) < 0) { return -1; }
+	if(_is_logic_node(node)) {
+		((expr_inst_t *)prog->code._data)[jmp_idx].target = array_size(&prog->code);
+	}
+	node->cost = _inst_cost(&inst) + (node->left ? node->left->cost : 0) \
+		+ (node->right ? node->right->cost : 0);
+	return 0;
+}
+
+/*
+ * 用显式的栈后序遍历语法树, 很深的树也不会栈溢出.
+ * && 和 || 编译为: 左值, 条件跳转, 右值, 对右值取布尔
+ */
+static int _compile_tree(expr_program *prog, array_t *frames) {
+	compile_frame_t frame;
+	memset(&frame, 0x00, sizeof(frame));
+	frame.node = prog->root;
+	array_clear(frames);
+	if(frame_array_push_back(frames, frame) < 0) { return -1; }
+	while(array_size(frames) > 0) {
+		compile_frame_t *top = (compile_frame_t *)frames->_data + array_size(frames) - 1;
+		expr_node_t *child = 0;
+		if(0 == top->state) {
+			top->state = 1;
+			child = top->node->left;
+		}
+		else if(1 == top->state) {
+			top->state = 2;
+			if(_is_logic_node(top->node)) {
+				expr_inst_t inst;
+				memset(&inst, 0x00, sizeof(inst));
+				inst.op = _OPER_AND == top->node->u.oper ? _INST_JMP_FALSE : _INST_JMP_TRUE;
+				inst.offset = top->node->offset;
+				inst.var = top->node->stat = prog->nlogic++;
+				top->jmp_idx = array_size(&prog->code);
+				if(inst_array_push_back(&prog->code, inst) < 0) { return -1; }
+			}
+			child = top->node->right;
+		}
+		else {
+			if(_emit_node(prog, top->node, top->jmp_idx) < 0) { return -1; }
+			array_pop_back(frames);
+			continue;
+		}
+		if(child) {
+			frame.node = child;
+			if(frame_array_push_back(frames, frame) < 0) { return -1; }
+		}
+	}
+	return 0;
+}
+
+/*
+ * 批量执行时跳转指令不出栈, && 和 || 合并左右两个结果, 栈深度要单独计算
+ */
+static size_t _batch_stack_size(expr_inst_t *code, size_t size) {
+	size_t i, depth = 0, max_depth = 0;
+	for(i=0; i<size; ++i) {
+		if(_INST_CONST == code[i].op || _INST_VAR == code[i].op) {
+			depth++;
+			if(depth > max_depth) { max_depth = depth; }
+		}
+		else if(_INST_JMP_FALSE == code[i].op || _INST_JMP_TRUE == code[i].op) {
+		}
+		else if(_OPER_NOT != code[i].op) {
+			depth--;
+		}
+	}
+	return max_depth;
+}
+
+void _program_stack_size(expr_program *prog) {
+	size_t i, size, depth = 0, max_depth = 0;
+	expr_inst_t *code = (expr_inst_t *)prog->code._data;
+
+	size = array_size(&prog->code);
+	prog->bstack_size = _batch_stack_size(code, size);
+	for(i=0; i<size; ++i) {
+		if(_INST_CONST == code[i].op || _INST_VAR == code[i].op) {
+			depth++;
+			if(depth > max_depth) { max_depth = depth; }
+		}
+		else if(_INST_JMP_FALSE == code[i].op || _INST_JMP_TRUE == code[i].op) {
+			depth--;
+		}
+		else if(_OPER_AND == code[i].op || _OPER_OR == code[i].op) {
+			/* 左值已被跳转指令出栈 */
+		}
+		else if(_opercfg_of(code[i].op)->need_left) {
+			depth--;
+		}
+	}
+	prog->vstack_size = max_depth;
+}
+
+/*
+ * 把语法树编译成后缀指令, 并计算执行需要的栈深度.
+ * 变量表不清空, 重新编译时变量的下标和绑定的槽位不变
+ */
+static int _compile(expr_program *prog, array_t *frames) {
+	array_clear(&prog->code);
+	prog->nlogic = 0;
+	if(_compile_tree(prog, frames) < 0) {
+		return -1;
+	}
+	_program_stack_size(prog);
+	return 0;
+}
+
+int _program_recompile(expr_program *prog, array_t *frames) {
+	array_t local;
+	int ret;
+	if(frames) {
+		ret = _compile(prog, frames);
+	}
+	else {
+		frame_array_init(&local);
+		ret = _compile(prog, &local);
+		array_uinit(&local);
+	}
+	if(ret < 0) {
+		_expr_error(0, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		_program_clear(prog);
+	}
+	return ret;
+}
+
+/*
+ * 解析并编译到 prog, 节点都分配在 prog 的内存池里, stack 用完清空
+ */
+static int _build_program(expr_program *prog, parse_stack_t *stack, char *exp_str, expr_error_t *err) {
+	int ret = -1;
+	stack->err = err;
+	prog->root = _parse_it(&prog->arena, exp_str, stack);
+	if(prog->root) {
+		prog->executable = _NODE_TYPE_OPER == prog->root->type;
+		if(_optimize(prog, &stack->frames) == 0 && _compile(prog, &stack->frames) == 0) {
+			ret = 0;
+		}
+		else {
+			_expr_error(err, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		}
+	}
+	if(ret < 0) {
+		_program_clear(prog);
+	}
+	_stack_clear(stack);
+	stack->err = 0;
+	return ret;
+}
+
+#ifdef EXPR_METRICS
+static uint64_t _metrics_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void _metrics_record(uint64_t *hist, uint64_t ns) {
+	size_t i = 0;
+	for( ; ns > 1 && i+1 < EXPR_METRICS_BUCKETS; ns >>= 1) {
+		i++;
+	}
+	hist[i]++;
+}
+#endif
+
+int expr_parser_parse(expr_parser * parser, char *exp_str) {
+	int ret;
+#ifdef EXPR_METRICS
+	uint64_t start = parser && parser->_ctx.sample ? _metrics_now() : 0;
+#endif
+	if(!parser) {
+		return -1;
+	}
+	expr_parser_reset(parser);
+	ret = _build_program(&parser->_prog, &parser->_stack, exp_str, &parser->_ctx.err);
+#ifdef EXPR_METRICS
+	parser->_ctx.metrics.parses++;
+	if(ret < 0) {
+		parser->_ctx.metrics.parse_errors++;
+	}
+	if(parser->_ctx.sample) {
+		_metrics_record(parser->_ctx.metrics.parse_ns, _metrics_now() - start);
+	}
+#endif
+	return ret;
+}
+
+int _program_build(expr_program *prog, char *exp_str) {
+	parse_stack_t stack;
+	int ret;
+	_program_init(prog);
+	_stack_init(&stack);
+	ret = _build_program(prog, &stack, exp_str, 0);
+	if(ret < 0) {
+		_program_uinit(prog);
+	}
+	_stack_uinit(&stack);
+	return ret;
+}
+
+size_t _program_bytes(const expr_program *prog) {
+	arena_block_t *block = prog->arena.head;
+	size_t bytes = sizeof(expr_program);
+	for( ; block; block = block->next) {
+		bytes += sizeof(arena_block_t) + block->size;
+	}
+	bytes += prog->code._capacity * prog->code._element_size;
+	bytes += prog->vars._capacity * prog->vars._element_size;
+	bytes += prog->slots._capacity * prog->slots._element_size;
+	return bytes;
+}
+
+expr_program * expr_program_new(char *exp_str) {
+	expr_program *prog = (expr_program *)malloc(sizeof(expr_program));
+	if(!prog) {
+		_expr_error(0, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+		return 0;
+	}
+	if(_program_build(prog, exp_str) < 0) {
+		free(prog);
+		prog = 0;
+	}
+	return prog;
+}
+
+void expr_program_delete(expr_program *prog) {
+	if(prog) {
+		_program_uinit(prog);
+		free(prog);
+	}
+}
+
+expr_context * expr_context_new(void) {
+	expr_context *ctx = (expr_context *)malloc(sizeof(expr_context));
+	if(ctx) {
+		memset(ctx, 0x00, sizeof(expr_context));
+	}
+	return ctx;
+}
+
+void expr_context_delete(expr_context *ctx) {
+	if(ctx) {
+		_context_uinit(ctx);
+		free(ctx);
+	}
+}
+
+void expr_context_skip_stat(const expr_context *ctx, uint64_t *skips, uint64_t *skipped_insts) {
+	assert(ctx);
+	if(skips) { *skips = ctx->skips; }
+	if(skipped_insts) { *skipped_insts = ctx->skipped_insts; }
+}
+
+void expr_context_error(const expr_context *ctx, expr_error_t *err) {
+	assert(ctx);
+	assert(err);
+	*err = ctx->err;
+}
+
+void expr_parser_error(const expr_parser *parser, expr_error_t *err) {
+	assert(parser);
+	expr_context_error(&parser->_ctx, err);
+}
+
+static int _get_number_value(expr_value_t * value, double *number) {
+	assert(value);
+	assert(number);
+	if(value->type == _DATA_TYPE_INT) {
+		*number = (double) value->u.n;
+		return 0;
+	}
+	else if(value->type == _DATA_TYPE_DOUBLE) {
+		*number = value->u.d;
+		return 0;
+	}
+	return -1;
+}
+
+static int _is_number(const expr_value_t *value) {
+	return _DATA_TYPE_INT == value->type || _DATA_TYPE_DOUBLE == value->type;
+}
+
+/*
+ * 2^63, int64 的范围是 [-2^63, 2^63)
+ */
+#define _TWO_POW_63	9223372036854775808.0
+
+int _cmp_i64_f64(int64_t i, double d) {
+	int64_t t;
+	double frac;
+	if(d != d) {
+		return _CMP_UNORDERED;
+	}
+	if(d >= _TWO_POW_63) {
+		return -1;
+	}
+	if(d < -_TWO_POW_63) {
+		return 1;
+	}
+	t = (int64_t)d;		/* 向0取整, 在范围内是精确的 */
+	if(i != t) {
+		return i < t ? -1 : 1;
+	}
+	frac = d - (double)t;
+	return frac > 0 ? -1 : (frac < 0 ? 1 : 0);
+}
+
+int _i64_f64_bound(int op, double d, int *op2, int64_t *c) {
+	int64_t t;
+	int lt = (_OPER_LT == op || _OPER_LE == op);
+	int gt = (_OPER_GT == op || _OPER_GE == op);
+	if(d != d) {
+		return _OPER_NE == op ? 1 : 2;
+	}
+	if(d >= _TWO_POW_63) {
+		return (lt || _OPER_NE == op) ? 1 : 2;
+	}
+	if(d < -_TWO_POW_63) {
+		return (gt || _OPER_NE == op) ? 1 : 2;
+	}
+	t = (int64_t)d;
+	*op2 = op;
+	*c = t;
+	if((double)t == d) {
+		return 0;
+	}
+	/* d 有小数部分: 不会相等, 大小关系和 floor(d) 比较相同 */
+	if(_OPER_EQ == op) { return 2; }
+	if(_OPER_NE == op) { return 1; }
+	*c = d < 0 ? t - 1 : t;
+	*op2 = lt ? _OPER_LE : _OPER_GT;
+	return 0;
+}
+
+int _cmp_result(int op, int cmp) {
+	switch(op) {
+	case _OPER_EQ: return 0 == cmp;
+	case _OPER_NE: return 0 != cmp;
+	case _OPER_LT: return -1 == cmp;
+	case _OPER_LE: return -1 == cmp || 0 == cmp;
+	case _OPER_GT: return 1 == cmp;
+	case _OPER_GE: return 1 == cmp || 0 == cmp;
+	}
+	return 0;
+}
+
+/*
+ * 按两边的类型选择比较方式, 两个整数直接比较, 不转成浮点
+ */
+static int _num_cmp(const expr_value_t *l, const expr_value_t *r) {
+	if(_DATA_TYPE_INT == l->type) {
+		if(_DATA_TYPE_INT == r->type) {
+			return l->u.n < r->u.n ? -1 : (l->u.n > r->u.n ? 1 : 0);
+		}
+		return _cmp_i64_f64(l->u.n, r->u.d);
+	}
+	if(_DATA_TYPE_INT == r->type) {
+		int cmp = _cmp_i64_f64(r->u.n, l->u.d);
+		return _CMP_UNORDERED == cmp ? cmp : -cmp;
+	}
+	if(l->u.d < r->u.d) { return -1; }
+	if(l->u.d > r->u.d) { return 1; }
+	return l->u.d == r->u.d ? 0 : _CMP_UNORDERED;
+}
+
+/*
+ * 执行一个运算符, 结果放到 val_l. 返回 EXPR_ERR_NONE, 或出错的原因, 由调用方记录
+ */
+static int _execute_oper(expr_inst_t *inst, expr_value_t *val_l, expr_value_t *val_r) {
+	int ret = EXPR_ERR_NONE;
+	double r=0;
+	expr_value_t value;
+
+	memset(&value, 0x00, sizeof(value));
+
+	switch(inst->op) {
+	case _OPER_EQ:
+	case _OPER_NE:
+	case _OPER_LT:
+	case _OPER_LE:
+	case _OPER_GT:
+	case _OPER_GE:
+		if(!_is_number(val_l)) goto ERROR_RET_L;
+		if(!_is_number(val_r)) goto ERROR_RET_R;
+		expr_value_set_int(&value, _cmp_result(inst->op, _num_cmp(val_l, val_r)));
+		break;
+	case _OPER_SE:
+		if(val_l->type != _DATA_TYPE_STR) goto ERROR_RET_L;
+		if(val_r->type != _DATA_TYPE_STR) goto ERROR_RET_R;
+		expr_value_set_int(&value, _value_str_equal(val_l, val_r));
+		break;
+	case _OPER_SNE:
+		if(val_l->type != _DATA_TYPE_STR) goto ERROR_RET_L;
+		if(val_r->type != _DATA_TYPE_STR) goto ERROR_RET_R;
+		expr_value_set_int(&value, !_value_str_equal(val_l, val_r));
+		break;
+	case _OPER_CE:
+		if(val_l->type != _DATA_TYPE_STR) goto ERROR_RET_L;
+		if(val_r->type != _DATA_TYPE_STR) goto ERROR_RET_R;
+		expr_value_set_int(&value, _str_equal(val_l->u.p, val_l->len, val_r->u.p, val_r->len, \
+					_STR_NOCASE | inst->folded));
+		break;
+	case _OPER_CNE:
+		if(val_l->type != _DATA_TYPE_STR) goto ERROR_RET_L;
+		if(val_r->type != _DATA_TYPE_STR) goto ERROR_RET_R;
+		expr_value_set_int(&value, !_str_equal(val_l->u.p, val_l->len, val_r->u.p, val_r->len, \
+					_STR_NOCASE | inst->folded));
+		break;
+	case _OPER_AND:
+	case _OPER_OR:
+		/* 左值已由跳转指令判断, 这里只对右值取布尔 */
+		if(_get_number_value(val_r, &r) < 0) goto ERROR_RET_R;
+		expr_value_set_int(&value, r != 0);
+		break;
+	case _OPER_NOT:
+		if(_get_number_value(val_r, &r) < 0) goto ERROR_RET_R;
+		expr_value_set_int(&value, !r);
+		break;
+	default:
+		goto ERROR_RET_OPER;
+	}
+
+	expr_value_clear(val_l);
+	if(val_r != val_l) {
+		expr_value_clear(val_r);
+	}
+	*val_l = value;
+	goto RET;
+
+ERROR_RET_L:
+	ret = EXPR_ERR_LEFT_TYPE;
+	goto RET;
+ERROR_RET_R:
+	ret = EXPR_ERR_RIGHT_TYPE;
+	goto RET;
+ERROR_RET_OPER:
+	ret = EXPR_ERR_OPER;
+RET:
+	return ret;
+}
+
+/*
+ * 记下出错的指令, 跳转指令报告对应的 && 或 ||
+ */
+static void _inst_error(expr_context *ctx, const expr_inst_t *inst, int code) {
+	const char *oper = 0;
+	if(_INST_JMP_FALSE == inst->op || _INST_JMP_TRUE == inst->op) {
+		oper = _INST_JMP_FALSE == inst->op ? _TEXT_AND : _TEXT_OR;
+	}
+	else if(_opercfg_of(inst->op)) {
+		oper = _opercfg_of(inst->op)->text;
+	}
+	_expr_error(&ctx->err, code, inst->offset, oper, 0);
+}
+
+/*
+ * 在值栈上顺序执行后缀指令, 不做递归
+ */
+static int _vm_execute(const expr_program *prog, expr_context *ctx, expr_value_t *value, \
+		expr_value_getter getter, expr_value_slot_getter slot_getter, void * usrdata, \
+		logic_stat_t *stats) {
+	int ret = -1;
+	const int *slots = (const int *)prog->slots._data;
+	expr_inst_t *code = (expr_inst_t *)prog->code._data;
+	expr_inst_t *inst = code;
+	expr_inst_t *end = inst + prog->code._size;
+	double l = 0;
+	int err;
+	expr_value_t *base = ctx->vstack;
+	expr_value_t *sp = base;	/* 指向下一个空位 */
+
+	for( ; inst < end; ++inst) {
+		if(_INST_CONST == inst->op) {
+			*sp++ = inst->value;
+		}
+		else if(_INST_VAR == inst->op) {
+			memset(sp, 0x00, sizeof(*sp));
+			_METRIC_INC(ctx, getter_calls);
+			if((slot_getter ? slot_getter(slots[inst->var], sp, usrdata) \
+						: getter(inst->varname, sp, usrdata)) < 0) {
+				_METRIC_INC(ctx, getter_failures);
+				_expr_error(&ctx->err, EXPR_ERR_GETTER, inst->offset, 0, inst->varname);
+				goto ERR_RET;
+			}
+			sp++;
+		}
+		else if(_INST_JMP_FALSE == inst->op || _INST_JMP_TRUE == inst->op) {
+			if(_get_number_value(sp-1, &l) < 0) {
+				_METRIC_INC(ctx, type_errors);
+				_inst_error(ctx, inst, EXPR_ERR_LEFT_TYPE);
+				goto ERR_RET;
+			}
+			if(stats) {
+				stats[inst->var].evals[0]++;
+			}
+			if((l != 0) == (_INST_JMP_TRUE == inst->op)) {
+				/* 短路: 结果就是左值的布尔值, 跳过右边 */
+				if(stats) {
+					stats[inst->var].decides[0]++;
+				}
+				expr_value_set_int(sp-1, l != 0);
+				ctx->skips++;
+				ctx->skipped_insts += (code + inst->target) - inst - 1;
+				inst = code + inst->target - 1;
+			}
+			else {
+				sp--;
+				expr_value_clear(sp);
+			}
+		}
+		else if(_OPER_NOT == inst->op || _OPER_AND == inst->op || _OPER_OR == inst->op) {
+			if((err = _execute_oper(inst, sp-1, sp-1)) != EXPR_ERR_NONE) {
+				_METRIC_INC(ctx, type_errors);
+				_inst_error(ctx, inst, err);
+				goto ERR_RET;
+			}
+			if(stats && _OPER_NOT != inst->op) {
+				logic_stat_t *stat = stats + code[inst->target].var;
+				stat->evals[1]++;
+				if((sp-1)->u.n == (_OPER_OR == inst->op)) {
+					stat->decides[1]++;
+				}
+			}
+		}
+		else {
+			if((err = _execute_oper(inst, sp-2, sp-1)) != EXPR_ERR_NONE) {
+				_METRIC_INC(ctx, type_errors);
+				_inst_error(ctx, inst, err);
+				goto ERR_RET;
+			}
+			sp--;
+		}
+	}
+
+	assert(sp == base+1);
+	*value = *base;
+	return 0;
+
+ERR_RET:
+	while(sp > base) {
+		sp--;
+		expr_value_clear(sp);
+	}
+	return ret;
+}
+
+/*
+ * 值栈不够时按程序需要的深度增长
+ */
+int _context_reserve(expr_context *ctx, size_t size) {
+	if(size > ctx->vstack_size) {
+		expr_value_t * vstack = (expr_value_t *)realloc(ctx->vstack, \
+				sizeof(expr_value_t) * size);
+		if(!vstack) {
+			_expr_error(&ctx->err, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+			return -1;
+		}
+		ctx->vstack = vstack;
+		ctx->vstack_size = size;
+	}
+	return 0;
+}
+
+static int _execute(const expr_program *prog, expr_context *ctx, int *result, \
+		expr_value_getter getter, expr_value_slot_getter slot_getter, void * usrdata, \
+		logic_stat_t *stats) {
+	int ret = -1;
+	expr_value_t value; 
+#ifdef EXPR_METRICS
+	uint64_t start = 0;
+#endif
+	assert(prog);
+	assert(ctx);
+	memset(&value,0x00, sizeof(value));
+#ifdef EXPR_METRICS
+	if(ctx->sample && ++ctx->sample_count >= ctx->sample) {
+		ctx->sample_count = 0;
+		start = _metrics_now();
+	}
+#endif
+	if(!_program_compiled(prog) || !prog->executable) {
+		_expr_error(&ctx->err, EXPR_ERR_UNEXECUTABLE, EXPR_NO_OFFSET, 0, 0);
+		goto ERR_RET;
+	}
+	if(_context_reserve(ctx, prog->vstack_size) < 0) {
+		goto ERR_RET;
+	}
+	if(_vm_execute(prog, ctx, &value, getter, slot_getter, usrdata, stats) < 0) {
+		goto ERR_RET;
+	}
+	if(value.type != _DATA_TYPE_INT) {
+		_METRIC_INC(ctx, type_errors);
+		_expr_error(&ctx->err, EXPR_ERR_RESULT_TYPE, EXPR_NO_OFFSET, 0, 0);
+		goto ERR_RET;
+	}
+	*result = (int)value.u.n;
+
+	ret = 0;
+	goto RET;
+ERR_RET:
+	ret = -1;
+	_METRIC_INC(ctx, exec_errors);
+RET:
+	expr_value_clear(&value);
+#ifdef EXPR_METRICS
+	ctx->metrics.executions++;
+	if(start) {
+		_metrics_record(ctx->metrics.exec_ns, _metrics_now() - start);
+	}
+#endif
+	return ret;
+}
+
+/*
+ * 按统计重排并重新编译, 统计清零后重新累计
+ */
+static void _adapt(expr_parser *parser) {
+	if(_reorder_chains(&parser->_prog, parser->_stats) == 0) {
+		_program_recompile(&parser->_prog, &parser->_stack.frames);
+	}
+	memset(parser->_stats, 0x00, sizeof(logic_stat_t) * parser->_nstats);
+	parser->_adapt_count = 0;
+}
+
+static int _parser_execute(expr_parser *parser, int *result, expr_value_getter getter, \
+		expr_value_slot_getter slot_getter, void * usrdata) {
+	logic_stat_t *stats = 0;
+	int ret;
+	if(parser->_adapt_interval && parser->_prog.nlogic) {
+		if(parser->_nstats < parser->_prog.nlogic) {
+			stats = (logic_stat_t *)realloc(parser->_stats, \
+					sizeof(logic_stat_t) * parser->_prog.nlogic);
+			if(!stats) {
+				_expr_error(&parser->_ctx.err, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+				return -1;
+			}
+			memset(stats + parser->_nstats, 0x00, \
+					sizeof(logic_stat_t) * (parser->_prog.nlogic - parser->_nstats));
+			parser->_stats = stats;
+			parser->_nstats = parser->_prog.nlogic;
+		}
+		stats = parser->_stats;
+	}
+	ret = _execute(&parser->_prog, &parser->_ctx, result, getter, slot_getter, usrdata, stats);
+	if(stats && ++parser->_adapt_count >= parser->_adapt_interval) {
+		_adapt(parser);
+	}
+	return ret;
+}
+
+int expr_parser_execute(expr_parser *parser, int *result, expr_value_getter getter, \
+		void * usrdata) {
+	assert(parser);
+	assert(getter);
+	return _parser_execute(parser, result, getter, 0, usrdata);
+}
+
+int expr_parser_execute_slot(expr_parser *parser, int *result, \
+		expr_value_slot_getter getter, void * usrdata) {
+	assert(parser);
+	assert(getter);
+	return _parser_execute(parser, result, 0, getter, usrdata);
+}
+
+void expr_parser_set_adaptive(expr_parser *parser, uint64_t interval) {
+	if(parser) {
+		parser->_adapt_interval = interval;
+		parser->_adapt_count = 0;
+	}
+}
+
+int expr_program_execute(const expr_program *prog, expr_context *ctx, int *result, \
+		expr_value_getter getter, void * usrdata) {
+	assert(getter);
+	return _execute(prog, ctx, result, getter, 0, usrdata, 0);
+}
+
+int expr_program_execute_slot(const expr_program *prog, expr_context *ctx, int *result, \
+		expr_value_slot_getter getter, void * usrdata) {
+	assert(getter);
+	return _execute(prog, ctx, result, 0, getter, usrdata, 0);
+}
+
+void expr_parser_skip_stat(expr_parser *parser, uint64_t *skips, uint64_t *skipped_insts) {
+	assert(parser);
+	expr_context_skip_stat(&parser->_ctx, skips, skipped_insts);
+}
+
+void expr_context_set_metrics_sample(expr_context *ctx, unsigned int sample) {
+	assert(ctx);
+#ifdef EXPR_METRICS
+	ctx->sample = sample;
+	ctx->sample_count = 0;
+#else
+	(void)sample;
+#endif
+}
+
+void expr_context_metrics(const expr_context *ctx, expr_metrics_t *metrics) {
+	assert(ctx);
+	assert(metrics);
+#ifdef EXPR_METRICS
+	*metrics = ctx->metrics;
+#else
+	memset(metrics, 0x00, sizeof(expr_metrics_t));
+#endif
+}
+
+void expr_context_metrics_reset(expr_context *ctx) {
+	assert(ctx);
+#ifdef EXPR_METRICS
+	memset(&ctx->metrics, 0x00, sizeof(expr_metrics_t));
+#endif
+}
+
+void expr_parser_set_metrics_sample(expr_parser *parser, unsigned int sample) {
+	assert(parser);
+	expr_context_set_metrics_sample(&parser->_ctx, sample);
+}
+
+void expr_parser_metrics(expr_parser *parser, expr_metrics_t *metrics) {
+	assert(parser);
+	expr_context_metrics(&parser->_ctx, metrics);
+}
+
+void expr_parser_metrics_reset(expr_parser *parser) {
+	assert(parser);
+	expr_context_metrics_reset(&parser->_ctx);
+}
+
+void expr_metrics_merge(expr_metrics_t *dst, const expr_metrics_t *src) {
+	size_t i;
+	assert(dst);
+	assert(src);
+	dst->parses += src->parses;
+	dst->parse_errors += src->parse_errors;
+	dst->executions += src->executions;
+	dst->exec_errors += src->exec_errors;
+	dst->getter_calls += src->getter_calls;
+	dst->getter_failures += src->getter_failures;
+	dst->type_errors += src->type_errors;
+	for(i=0; i<EXPR_METRICS_BUCKETS; ++i) {
+		dst->parse_ns[i] += src->parse_ns[i];
+		dst->exec_ns[i] += src->exec_ns[i];
+	}
+}
+
+uint64_t expr_metrics_percentile(const uint64_t *hist, double p) {
+	uint64_t total = 0, seen = 0;
+	double rank;
+	size_t i;
+	assert(hist);
+	for(i=0; i<EXPR_METRICS_BUCKETS; ++i) {
+		total += hist[i];
+	}
+	if(0 == total) {
+		return 0;
+	}
+	rank = p * (double)total;
+	for(i=0; i+1<EXPR_METRICS_BUCKETS; ++i) {
+		seen += hist[i];
+		if((double)seen >= rank && seen > 0) {
+			break;
+		}
+	}
+	return (uint64_t)1 << (i + 1);
+}
+
+size_t expr_program_var_count(const expr_program *prog) {
+	assert(prog);
+	return prog->vars._size;
+}
+
+char * expr_program_var_name(const expr_program *prog, size_t idx) {
+	assert(prog);
+	if(idx < prog->vars._size) {
+		return ((char **)prog->vars._data)[idx];
+	}
+	return 0;
+}
+
+int expr_program_bind_var(expr_program *prog, size_t idx, int slot) {
+	assert(prog);
+	if(idx < array_size(&prog->slots)) {
+		((int *)prog->slots._data)[idx] = slot;
+		return 0;
+	}
+	return -1;
+}
+
+void expr_program_print_tree(const expr_program *prog) {
+	assert(prog);
+	if(prog->root) {
+		_output_node(prog->root);
+	}
+}
+
+size_t expr_parser_var_count(expr_parser *parser) {
+	assert(parser);
+	return expr_program_var_count(&parser->_prog);
+}
+
+char * expr_parser_var_name(expr_parser *parser, size_t idx) {
+	assert(parser);
+	return expr_program_var_name(&parser->_prog, idx);
+}
+
+int expr_parser_bind_var(expr_parser *parser, size_t idx, int slot) {
+	assert(parser);
+	return expr_program_bind_var(&parser->_prog, idx, slot);
+}
+
+void expr_parser_print_tree(expr_parser *parser) {
+	assert(parser);
+	if(parser) {
+		expr_program_print_tree(&parser->_prog);
+	}
+}
+
+void expr_value_set_int(expr_value_t *value, int64_t n) {
+	assert(value);
+	value->type = _DATA_TYPE_INT;
+	value->u.n = n;
+}
+
+void expr_value_set_double(expr_value_t *value, double d) {
+	assert(value);
+	value->type = _DATA_TYPE_DOUBLE;
+	value->u.d = d;
+}
+
+void expr_value_set_str(expr_value_t *value, char *p, size_t size) {
+	assert(value);
+	memset(value, 0x00, sizeof(*value));
+	value->type = _DATA_TYPE_STR;
+	value->u.p = (char *)malloc(size+1);
+	if(value->u.p) {
+		memset(value->u.p, 0x00, size+1);
+		if(p && size > 0) {
+			memcpy(value->u.p, p, size);
+		}
+		value->len = size;
+	}
+}
+
+void expr_value_set_str_ref(expr_value_t *value, const char *p, size_t size) {
+	assert(value);
+	memset(value, 0x00, sizeof(*value));
+	value->type = _DATA_TYPE_STR;
+	value->borrowed = 1;
+	value->u.p = (char *)p;
+	value->len = size;
+}
+
+#define _FNV_OFFSET	(((uint64_t)0xcbf29ce4 << 32) | 0x84222325)
+#define _FNV_PRIME	(((uint64_t)0x100 << 32) | 0x1b3)
+
+uint64_t expr_str_hash(const char *p, size_t size) {
+	uint64_t h = _FNV_OFFSET;
+	size_t i;
+	for(i=0; i<size; ++i) {
+		h ^= (unsigned char)p[i];
+		h *= _FNV_PRIME;
+	}
+	return h ? h : 1;
+}
+
+void expr_value_set_hash(expr_value_t *value, uint64_t hash) {
+	assert(value);
+	if(value->type == _DATA_TYPE_STR) {
+		value->hash = hash;
+	}
+}
+
+void expr_value_clear(expr_value_t * value) {
+	assert(value);
+	if(value->type == _DATA_TYPE_STR && !value->borrowed) {
+		if(value->u.p) {
+			free(value->u.p);
+		}
+	}
+}
+
@@ -1,39 +1,232 @@
-/**
- * author: jason886
- * link: https://github.com/Jason886/expr_parser.git
- *
- */
-#include "array.h"
-#include <stdlib.h>
-#include <string.h>
-#include <memory.h>
-#include <stdio.h>
-#include <ctype.h>
-#include <stdint.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-typedef struct expr_parser expr_parser;
-typedef struct expr_value_t expr_value_t;
-typedef int (*expr_value_getter)(char * varname, expr_value_t *value, void *usrdata);
-
-extern expr_parser * expr_parser_new();
-extern void expr_parser_delete(expr_parser *parser);
-extern void expr_parser_reset(expr_parser *parser);
-extern int expr_parser_parse(expr_parser * parser, char *exp_str);
-extern int expr_parser_execute(expr_parser *parser, int *result, \
-		expr_value_getter getter, void * usrdata);
-extern void expr_parser_print_tree(expr_parser *parser);
-
-extern void expr_value_set_int(expr_value_t *value, int64_t n);
-extern void expr_value_set_double(expr_value_t *value, double d);
-extern void expr_value_set_str(expr_value_t *value, char *p, size_t size);
-extern void expr_value_clear(expr_value_t * value);
-
-
-#ifdef __cplusplus
-}
-#endif
-
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ */
+#ifndef _EXPR_PARSER_H_
+#define _EXPR_PARSER_H_
+
+#include "array.h"
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct expr_parser expr_parser;
+typedef struct expr_program expr_program;
+typedef struct expr_context expr_context;
+typedef struct expr_value_t expr_value_t;
+typedef int (*expr_value_getter)(char * varname, expr_value_t *value, void *usrdata);
+typedef int (*expr_value_slot_getter)(int slot, expr_value_t *value, void *usrdata);
+
+extern expr_parser * expr_parser_new();
+extern void expr_parser_delete(expr_parser *parser);
+extern void expr_parser_reset(expr_parser *parser);
+extern int expr_parser_parse(expr_parser * parser, char *exp_str);
+extern int expr_parser_execute(expr_parser *parser, int *result, \
+		expr_value_getter getter, void * usrdata);
+extern void expr_parser_print_tree(expr_parser *parser);
+
+/*
+ * && 和 || 短路求值的统计: 短路次数, 以及因此跳过的指令数.
+ * 重新解析时清零.
+ */
+extern void expr_parser_skip_stat(expr_parser *parser, uint64_t *skips, \
+		uint64_t *skipped_insts);
+
+/*
+ * 变量槽位: 解析后列出去重的变量名($name与name视为同一变量),
+ * 调用方为每个变量绑定槽位, 执行时按槽位取值, 不再比较变量名.
+ * 默认槽位等于变量的下标.
+ */
+extern size_t expr_parser_var_count(expr_parser *parser);
+extern char * expr_parser_var_name(expr_parser *parser, size_t idx);
+extern int expr_parser_bind_var(expr_parser *parser, size_t idx, int slot);
+extern int expr_parser_execute_slot(expr_parser *parser, int *result, \
+		expr_value_slot_getter getter, void * usrdata);
+
+/*
+ * 自适应求值顺序: 记录每个 && 和 || 两边执行的次数和单独决定结果的次数,
+ * 每执行 interval 次, 把连续的同一种 && 或 || 上的操作数按 代价/决定结果的概率
+ * 从小到大重排, 并重新编译. 代价按指令数估计, 取变量按多条指令计.
+ * interval 为0时关闭(默认). 取值不出错时重排不改变结果, 否则出错的操作数可能提前执行.
+ */
+extern void expr_parser_set_adaptive(expr_parser *parser, uint64_t interval);
+
+/*
+ * 操作数的顺序, 可以保存下来, 启动时恢复学到的顺序.
+ * 每条链一组, 组间用';'分隔, 组内是按执行顺序排列的操作数在表达式中的偏移, 用','分隔.
+ * get_order 返回完整的长度, buf 不够时截断. set_order 的组和链对不上时返回-1, 不做修改.
+ */
+extern size_t expr_parser_get_order(expr_parser *parser, char *buf, size_t size);
+extern int expr_parser_set_order(expr_parser *parser, const char *order);
+
+/*
+ * 列式批量执行: 同一个表达式对 nrows 行数据一次求值.
+ * columns 按变量槽位(见 expr_parser_bind_var)给出每个变量的整列数据,
+ * 第 i 行的结果写入 bitmap[i/8] 的第 i%8 位, bitmap 至少 (nrows+7)/8 字节.
+ * 列的类型在整批内固定, 类型不匹配时整批失败返回 -1.
+ */
+#define EXPR_COLUMN_INT64	0
+#define EXPR_COLUMN_DOUBLE	1
+#define EXPR_COLUMN_STR		2	/* 第 i 行为 data[offsets[i], offsets[i+1]) */
+
+typedef struct expr_column_t {
+	int type;
+	const int64_t * i64;
+	const double * f64;
+	const size_t * offsets;
+	const char * data;
+} expr_column_t;
+
+extern int expr_parser_execute_batch(expr_parser *parser, const expr_column_t *columns, \
+		size_t ncolumns, size_t nrows, unsigned char *bitmap);
+
+/*
+ * 编译好的表达式和执行上下文.
+ * expr_program 创建后只读(绑定槽位须在共享给其他线程之前完成),
+ * 多个线程可以同时执行同一个程序, 每个线程使用各自的 expr_context.
+ * expr_parser 相当于一个程序加一个上下文, 不能跨线程共享.
+ */
+extern expr_program * expr_program_new(char *exp_str);
+extern void expr_program_delete(expr_program *prog);
+extern size_t expr_program_var_count(const expr_program *prog);
+extern char * expr_program_var_name(const expr_program *prog, size_t idx);
+extern int expr_program_bind_var(expr_program *prog, size_t idx, int slot);
+extern int expr_program_execute(const expr_program *prog, expr_context *ctx, int *result, \
+		expr_value_getter getter, void * usrdata);
+extern int expr_program_execute_slot(const expr_program *prog, expr_context *ctx, int *result, \
+		expr_value_slot_getter getter, void * usrdata);
+extern int expr_program_execute_batch(const expr_program *prog, const expr_column_t *columns, \
+		size_t ncolumns, size_t nrows, unsigned char *bitmap);
+extern void expr_program_print_tree(const expr_program *prog);
+
+/*
+ * 同 expr_parser_get_order/expr_parser_set_order, set_order 须在共享给其他线程之前调用
+ */
+extern size_t expr_program_get_order(const expr_program *prog, char *buf, size_t size);
+extern int expr_program_set_order(expr_program *prog, const char *order);
+
+extern expr_context * expr_context_new(void);
+extern void expr_context_delete(expr_context *ctx);
+extern void expr_context_skip_stat(const expr_context *ctx, uint64_t *skips, \
+		uint64_t *skipped_insts);
+
+/*
+ * 错误信息: 解析或执行返回-1时, 出错的原因记在解析器或执行上下文里, 成功时不清除,
+ * 解析器重新解析时清除. 库本身不输出任何内容, 设置日志回调后每个错误都交给回调,
+ * 回调在出错的线程中调用, 须在其他线程开始使用之前设置.
+ * 没有解析器或上下文可记的错误(expr_program_new, 批量执行, 映像, 线程池)只交给回调.
+ */
+#define EXPR_ERR_NONE			0
+#define EXPR_ERR_NOMEM			1	/* 内存不足 */
+#define EXPR_ERR_CHAR			2	/* 不认识的字符 */
+#define EXPR_ERR_NEED_LEFT		3	/* 运算符前缺少参数 */
+#define EXPR_ERR_NEED_RIGHT		4	/* 运算符后缺少参数 */
+#define EXPR_ERR_PAREN			5	/* 括号不匹配 */
+#define EXPR_ERR_VALUES			6	/* 没有值, 或多个值之间缺少运算符 */
+#define EXPR_ERR_UNEXECUTABLE	7	/* 没有编译好, 或表达式只是一个值 */
+#define EXPR_ERR_GETTER			8	/* 取值函数返回失败 */
+#define EXPR_ERR_LEFT_TYPE		9	/* 左参数的类型不符 */
+#define EXPR_ERR_RIGHT_TYPE		10	/* 右参数的类型不符 */
+#define EXPR_ERR_OPER			11	/* 不支持的运算符 */
+#define EXPR_ERR_RESULT_TYPE	12	/* 结果不是整数 */
+#define EXPR_ERR_COLUMN			13	/* 批量执行时变量没有对应的列 */
+#define EXPR_ERR_SYSTEM			14	/* 文件读写或创建线程失败 */
+#define EXPR_ERR_IMAGE			15	/* 映像不合法 */
+
+#define EXPR_NO_OFFSET	((size_t)-1)
+
+typedef struct expr_error_t {
+	int code;
+	size_t offset;			/* 出错位置在表达式中的字节偏移, 没有时为 EXPR_NO_OFFSET */
+	const char * oper;		/* 出错的运算符, 如 "&&", 没有时为空 */
+	const char * name;		/* 取值失败的变量名, 或读写失败的文件名(只在回调中有效), 没有时为空 */
+} expr_error_t;
+
+typedef void (*expr_log_fn)(const expr_error_t *err, void *usrdata);
+
+extern void expr_set_log(expr_log_fn fn, void *usrdata);
+extern const char * expr_strerror(int code);
+extern void expr_parser_error(const expr_parser *parser, expr_error_t *err);
+extern void expr_context_error(const expr_context *ctx, expr_error_t *err);
+
+/*
+ * 运行时统计, 编译时定义 EXPR_METRICS 才记录, 否则读出的都是0, 执行路径上没有任何额外代码.
+ * 统计保存在执行上下文里(解析器用自己的上下文), 由使用它的线程更新, 不加锁;
+ * 读取时复制一份, 多个线程的上下文用 expr_metrics_merge 相加.
+ * 计数一直更新. 耗时默认不测(解析也不测), sample 为 n 时每 n 次执行测一次,
+ * 解析则每次都测.
+ * 耗时按2的幂分桶, 第 i 个桶是 [2^i, 2^(i+1)) 纳秒, 第0个桶包括0.
+ * 只统计逐条执行, 不包括批量执行和 jit 的机器码.
+ */
+#define EXPR_METRICS_BUCKETS	32
+
+typedef struct expr_metrics_t {
+	uint64_t parses;
+	uint64_t parse_errors;
+	uint64_t executions;
+	uint64_t exec_errors;
+	uint64_t getter_calls;
+	uint64_t getter_failures;
+	uint64_t type_errors;			/* 参数或结果的类型不符 */
+	uint64_t parse_ns[EXPR_METRICS_BUCKETS];
+	uint64_t exec_ns[EXPR_METRICS_BUCKETS];
+} expr_metrics_t;
+
+extern void expr_parser_set_metrics_sample(expr_parser *parser, unsigned int sample);
+extern void expr_parser_metrics(expr_parser *parser, expr_metrics_t *metrics);
+extern void expr_parser_metrics_reset(expr_parser *parser);
+extern void expr_context_set_metrics_sample(expr_context *ctx, unsigned int sample);
+extern void expr_context_metrics(const expr_context *ctx, expr_metrics_t *metrics);
+extern void expr_context_metrics_reset(expr_context *ctx);
+extern void expr_metrics_merge(expr_metrics_t *dst, const expr_metrics_t *src);
+
+/*
+ * 直方图中第 p(0~1) 分位所在桶的上界(纳秒), 直方图为空时返回0
+ */
+extern uint64_t expr_metrics_percentile(const uint64_t *hist, double p);
+
+/*
+ * 批量执行使用的SIMD级别, 运行时按CPU选择.
+ * expr_simd_limit 限制最高级别, 用于测试和基准对比.
+ */
+#define EXPR_SIMD_NONE	0
+#define EXPR_SIMD_SSE42	1
+#define EXPR_SIMD_AVX2	2
+
+extern int expr_simd_level(void);
+extern void expr_simd_limit(int level);
+
+extern void expr_value_set_int(expr_value_t *value, int64_t n);
+extern void expr_value_set_double(expr_value_t *value, double d);
+extern void expr_value_set_str(expr_value_t *value, char *p, size_t size);
+
+/*
+ * 借用调用方的字符串, 不复制也不释放, 可以包含'\0'.
+ * 调用方保证在本次执行结束前内存有效.
+ */
+extern void expr_value_set_str_ref(expr_value_t *value, const char *p, size_t size);
+
+/*
+ * 字符串的哈希(FNV-1a), 不会返回0.
+ * 调用方可以预先算好哈希挂到字符串值上(比如加载数据时算一次), -se/-sne 比较时
+ * 双方都有哈希且不同就不再比较内容. 字符串常量的哈希在解析时算好.
+ * expr_value_set_hash 要在设置字符串之后调用, 哈希必须和内容一致.
+ */
+extern uint64_t expr_str_hash(const char *p, size_t size);
+extern void expr_value_set_hash(expr_value_t *value, uint64_t hash);
+extern void expr_value_clear(expr_value_t * value);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,374 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ */
+#define _POSIX_C_SOURCE 200112L
+#include "expr_pool.h"
+#include "expr_inner.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define _LINE_BYTES		64
+#define _LINE_ROWS		(_LINE_BYTES * 8)	/* 一个缓存行的位图对应的行数 */
+#define _MIN_CHUNK_ROWS	_LINE_ROWS
+#define _MAX_CHUNK_ROWS	(_LINE_ROWS * 128)
+#define _CHUNKS_PER_THREAD	8
+
+#define _JOB_ROW	0
+#define _JOB_BATCH	1
+
+typedef struct _worker_t {
+	struct expr_pool * pool;
+	int id;
+	pthread_t thread;
+	pthread_mutex_t lock;	/* 保护 lo/hi, 本线程从队头取, 其他线程从队尾偷 */
+	size_t lo;
+	size_t hi;				/* 待执行的块 [lo, hi) */
+	uint64_t steals;
+	expr_context * ctx;
+} worker_t;
+
+struct expr_pool {
+	int nthreads;
+	worker_t * workers;
+	pthread_mutex_t run_lock;	/* 串行化任务 */
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	uint64_t gen;				/* 任务代数, 变化时工作线程开始执行 */
+	int running;				/* 尚未做完的线程数 */
+	int quit;
+	int failed;					/* 用原子操作读写 */
+
+	/* 当前任务 */
+	int job;
+	const expr_program * prog;
+	expr_value_row_getter getter;
+	void ** usrdatas;
+	const expr_column_t * columns;
+	size_t ncolumns;
+	size_t nrows;
+	unsigned char * bitmap;
+	size_t first_rows;			/* 第一块的行数, 之后的块从缓存行边界开始 */
+	size_t chunk_rows;
+	size_t nchunks;
+};
+
+typedef struct _row_arg_t {
+	expr_value_row_getter getter;
+	size_t row;
+	void * usrdata;
+} row_arg_t;
+
+static int _row_slot_getter(int slot, expr_value_t *value, void *usrdata) {
+	row_arg_t *arg = (row_arg_t *)usrdata;
+	return arg->getter(slot, arg->row, value, arg->usrdata);
+}
+
+static void _chunk_range(expr_pool *pool, size_t chunk, size_t *begin, size_t *end) {
+	*begin = 0 == chunk ? 0 : pool->first_rows + (chunk-1) * pool->chunk_rows;
+	*end = 0 == chunk ? pool->first_rows : *begin + pool->chunk_rows;
+	if(*end > pool->nrows) { *end = pool->nrows; }
+}
+
+/*
+ * 先取自己的队头, 没有了再依次从其他线程的队尾偷
+ */
+static int _take_chunk(worker_t *w, size_t *chunk) {
+	expr_pool *pool = w->pool;
+	int i, found = 0;
+
+	pthread_mutex_lock(&w->lock);
+	if(w->lo < w->hi) {
+		*chunk = w->lo++;
+		found = 1;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	for(i=1; !found && i<pool->nthreads; ++i) {
+		worker_t *victim = pool->workers + (w->id + i) % pool->nthreads;
+		pthread_mutex_lock(&victim->lock);
+		if(victim->lo < victim->hi) {
+			*chunk = --victim->hi;
+			found = 1;
+		}
+		pthread_mutex_unlock(&victim->lock);
+		if(found) {
+			w->steals++;
+		}
+	}
+	return found;
+}
+
+static int _run_rows(worker_t *w, size_t begin, size_t end) {
+	expr_pool *pool = w->pool;
+	row_arg_t arg;
+	size_t i;
+	unsigned char byte = 0;
+	int result = 0;
+
+	arg.getter = pool->getter;
+	arg.usrdata = pool->usrdatas ? pool->usrdatas[w->id] : 0;
+	for(i=begin; i<end; ++i) {
+		arg.row = i;
+		if(expr_program_execute_slot(pool->prog, w->ctx, &result, _row_slot_getter, &arg) < 0) {
+			return -1;
+		}
+		if(result) {
+			byte |= (unsigned char)(1u << (i&7));
+		}
+		if((i&7) == 7 || i+1 == end) {
+			pool->bitmap[i/8] = byte;
+			byte = 0;
+		}
+	}
+	return 0;
+}
+
+static int _run_batch(worker_t *w, expr_column_t *columns, size_t begin, size_t end) {
+	expr_pool *pool = w->pool;
+	size_t i;
+	for(i=0; i<pool->ncolumns; ++i) {
+		columns[i] = pool->columns[i];
+		if(columns[i].i64) { columns[i].i64 += begin; }
+		if(columns[i].f64) { columns[i].f64 += begin; }
+		if(columns[i].offsets) { columns[i].offsets += begin; }
+	}
+	return expr_program_execute_batch(pool->prog, columns, pool->ncolumns, end - begin, \
+			pool->bitmap + begin/8);
+}
+
+static void _run_job(worker_t *w) {
+	expr_pool *pool = w->pool;
+	expr_column_t *columns = 0;
+	size_t chunk, begin, end;
+
+	if(_JOB_BATCH == pool->job && pool->ncolumns) {
+		columns = (expr_column_t *)malloc(sizeof(expr_column_t) * pool->ncolumns);
+		if(!columns) {
+			_expr_error(0, EXPR_ERR_NOMEM, EXPR_NO_OFFSET, 0, 0);
+			__sync_fetch_and_or(&pool->failed, 1);
+			return;
+		}
+	}
+	while(!__sync_fetch_and_or(&pool->failed, 0) && _take_chunk(w, &chunk)) {
+		_chunk_range(pool, chunk, &begin, &end);
+		if((_JOB_BATCH == pool->job ? _run_batch(w, columns, begin, end) \
+					: _run_rows(w, begin, end)) < 0) {
+			__sync_fetch_and_or(&pool->failed, 1);
+		}
+	}
+	if(columns) {
+		free(columns);
+	}
+}
+
+static void * _worker_main(void *arg) {
+	worker_t *w = (worker_t *)arg;
+	expr_pool *pool = w->pool;
+	uint64_t seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while(1) {
+		while(seen == pool->gen && !pool->quit) {
+			pthread_cond_wait(&pool->start, &pool->lock);
+		}
+		if(pool->quit) {
+			break;
+		}
+		seen = pool->gen;
+		pthread_mutex_unlock(&pool->lock);
+
+		_run_job(w);
+
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->running == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+static int _cpu_count(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+expr_pool * expr_pool_new(int nthreads) {
+	expr_pool *pool = 0;
+	int i, err = EXPR_ERR_NOMEM;
+
+	if(nthreads <= 0) {
+		nthreads = _cpu_count();
+	}
+	pool = (expr_pool *)malloc(sizeof(expr_pool));
+	if(!pool) {
+		goto ERR_RET;
+	}
+	memset(pool, 0x00, sizeof(expr_pool));
+	pool->workers = (worker_t *)calloc(nthreads, sizeof(worker_t));
+	if(!pool->workers) {
+		free(pool);
+		pool = 0;
+		goto ERR_RET;
+	}
+	pthread_mutex_init(&pool->run_lock, 0);
+	pthread_mutex_init(&pool->lock, 0);
+	pthread_cond_init(&pool->start, 0);
+	pthread_cond_init(&pool->done, 0);
+
+	for(i=0; i<nthreads; ++i) {
+		worker_t *w = pool->workers + i;
+		w->pool = pool;
+		w->id = i;
+		pthread_mutex_init(&w->lock, 0);
+		w->ctx = expr_context_new();
+		if(!w->ctx || pthread_create(&w->thread, 0, _worker_main, w) != 0) {
+			if(w->ctx) {
+				err = EXPR_ERR_SYSTEM;
+			}
+			expr_context_delete(w->ctx);
+			pthread_mutex_destroy(&w->lock);
+			break;
+		}
+		pool->nthreads++;
+	}
+	if(pool->nthreads < nthreads) {
+		expr_pool_delete(pool);
+		pool = 0;
+		goto ERR_RET;
+	}
+	return pool;
+
+ERR_RET:
+	_expr_error(0, err, EXPR_NO_OFFSET, 0, 0);
+	return pool;
+}
+
+void expr_pool_delete(expr_pool *pool) {
+	int i;
+	if(pool) {
+		pthread_mutex_lock(&pool->lock);
+		pool->quit = 1;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->lock);
+		for(i=0; i<pool->nthreads; ++i) {
+			pthread_join(pool->workers[i].thread, 0);
+			pthread_mutex_destroy(&pool->workers[i].lock);
+			expr_context_delete(pool->workers[i].ctx);
+		}
+		pthread_cond_destroy(&pool->start);
+		pthread_cond_destroy(&pool->done);
+		pthread_mutex_destroy(&pool->lock);
+		pthread_mutex_destroy(&pool->run_lock);
+		free(pool->workers);
+		free(pool);
+	}
+}
+
+int expr_pool_threads(expr_pool *pool) {
+	assert(pool);
+	return pool->nthreads;
+}
+
+uint64_t expr_pool_steals(expr_pool *pool) {
+	uint64_t steals = 0;
+	int i;
+	assert(pool);
+	pthread_mutex_lock(&pool->run_lock);
+	for(i=0; i<pool->nthreads; ++i) {
+		steals += pool->workers[i].steals;
+	}
+	pthread_mutex_unlock(&pool->run_lock);
+	return steals;
+}
+
+/*
+ * 切块并平均分给各线程, 然后等全部线程做完
+ */
+static int _run(expr_pool *pool) {
+	size_t lead, rows;
+	int i, failed;
+
+	if(!_program_compiled(pool->prog)) {
+		return -1;
+	}
+	if(0 == pool->nrows) {
+		return 0;
+	}
+
+	/* 块的行数是缓存行对应行数的倍数, 第一块补齐到位图的缓存行边界 */
+	rows = pool->nrows / ((size_t)pool->nthreads * _CHUNKS_PER_THREAD);
+	rows = (rows + _LINE_ROWS - 1) / _LINE_ROWS * _LINE_ROWS;
+	if(rows < _MIN_CHUNK_ROWS) { rows = _MIN_CHUNK_ROWS; }
+	if(rows > _MAX_CHUNK_ROWS) { rows = _MAX_CHUNK_ROWS; }
+	lead = (_LINE_BYTES - ((size_t)pool->bitmap & (_LINE_BYTES-1))) & (_LINE_BYTES-1);
+	pool->chunk_rows = rows;
+	pool->first_rows = lead ? lead * 8 : rows;
+	pool->nchunks = pool->nrows <= pool->first_rows ? 1 : \
+		1 + (pool->nrows - pool->first_rows + rows - 1) / rows;
+
+	pthread_mutex_lock(&pool->lock);
+	for(i=0; i<pool->nthreads; ++i) {
+		worker_t *w = pool->workers + i;
+		pthread_mutex_lock(&w->lock);
+		w->lo = pool->nchunks * i / pool->nthreads;
+		w->hi = pool->nchunks * (i+1) / pool->nthreads;
+		pthread_mutex_unlock(&w->lock);
+	}
+	pool->failed = 0;
+	pool->running = pool->nthreads;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->start);
+	while(pool->running > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	failed = pool->failed;
+	pthread_mutex_unlock(&pool->lock);
+	return failed ? -1 : 0;
+}
+
+int expr_pool_execute(expr_pool *pool, const expr_program *prog, size_t nrows, \
+		expr_value_row_getter getter, void **usrdatas, unsigned char *bitmap) {
+	int ret;
+	assert(pool);
+	assert(prog);
+	assert(getter);
+	assert(bitmap);
+
+	pthread_mutex_lock(&pool->run_lock);
+	pool->job = _JOB_ROW;
+	pool->prog = prog;
+	pool->getter = getter;
+	pool->usrdatas = usrdatas;
+	pool->nrows = nrows;
+	pool->bitmap = bitmap;
+	ret = _run(pool);
+	pthread_mutex_unlock(&pool->run_lock);
+	return ret;
+}
+
+int expr_pool_execute_batch(expr_pool *pool, const expr_program *prog, \
+		const expr_column_t *columns, size_t ncolumns, size_t nrows, unsigned char *bitmap) {
+	int ret;
+	assert(pool);
+	assert(prog);
+	assert(bitmap);
+
+	pthread_mutex_lock(&pool->run_lock);
+	pool->job = _JOB_BATCH;
+	pool->prog = prog;
+	pool->columns = columns;
+	pool->ncolumns = ncolumns;
+	pool->nrows = nrows;
+	pool->bitmap = bitmap;
+	ret = _run(pool);
+	pthread_mutex_unlock(&pool->run_lock);
+	return ret;
+}
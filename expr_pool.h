@@ -0,0 +1,55 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 并行执行: 把 [0, nrows) 切成块, 由工作窃取的线程池执行同一个程序.
+ * 每个线程先做分给自己的块, 做完后从其他线程的队尾窃取.
+ * 块的边界对齐到输出位图的64字节缓存行, 不同线程不会写同一行.
+ */
+#ifndef _EXPR_POOL_H_
+#define _EXPR_POOL_H_
+
+#include "expr_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct expr_pool expr_pool;
+
+/*
+ * 按行取值, usrdata 是执行该行的线程自己的上下文
+ */
+typedef int (*expr_value_row_getter)(int slot, size_t row, expr_value_t *value, void *usrdata);
+
+/*
+ * nthreads <= 0 时使用在线的CPU数
+ */
+extern expr_pool * expr_pool_new(int nthreads);
+extern void expr_pool_delete(expr_pool *pool);
+extern int expr_pool_threads(expr_pool *pool);
+
+/*
+ * 逐行执行, 第 w 个线程的 getter 使用 usrdatas[w](usrdatas 可以为空).
+ * 第 i 行的结果写入 bitmap[i/8] 的第 i%8 位. 任意一行出错时返回 -1.
+ * 同一个池同时只执行一个任务, 并发调用会排队.
+ */
+extern int expr_pool_execute(expr_pool *pool, const expr_program *prog, size_t nrows, \
+		expr_value_row_getter getter, void **usrdatas, unsigned char *bitmap);
+
+/*
+ * 列式批量执行的并行版本, 参数同 expr_program_execute_batch
+ */
+extern int expr_pool_execute_batch(expr_pool *pool, const expr_program *prog, \
+		const expr_column_t *columns, size_t ncolumns, size_t nrows, unsigned char *bitmap);
+
+/*
+ * 累计窃取的块数
+ */
+extern uint64_t expr_pool_steals(expr_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,430 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ */
+#include "expr_ruleset.h"
+#include "expr_inner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <assert.h>
+
+/*
+ * 索引键的种类
+ */
+#define _KEY_NUM	0	/* == 数字, 按double比较 */
+#define _KEY_STR	1	/* -se 字符串 */
+
+#define _ORI_BUCKETS	64
+
+#define _FNV_OFFSET	(((uint64_t)0xcbf29ce4 << 32) | 0x84222325)
+#define _FNV_PRIME	(((uint64_t)0x100 << 32) | 0x1b3)
+
+typedef struct _rule_t {
+	int id;
+	expr_program * prog;
+} rule_t;
+
+typedef struct _idx_key_t {
+	size_t var;			/* 被索引变量的下标 */
+	int kind;
+	double num;
+	const char * str;	/* 借用规则语法树中常量的内存 */
+	size_t len;
+	uint64_t hash;
+} idx_key_t;
+
+/*
+ * 倒排表的一项, 同一个键的规则串成链表
+ */
+typedef struct _entry_t {
+	idx_key_t key;
+	size_t head;		/* 第一条posting的下标+1, 0表示空 */
+	size_t next;		/* 同一个桶中下一项的下标+1 */
+} entry_t;
+
+typedef struct _posting_t {
+	size_t rule;
+	size_t next;		/* 下一条posting的下标+1 */
+} posting_t;
+
+struct expr_ruleset {
+	array_t rules;		/* rule_t */
+	array_t vars;		/* char *, 被索引的变量名 */
+	array_t entries;	/* entry_t */
+	array_t postings;	/* posting_t */
+	array_t unindexed;	/* size_t, 没有可索引条件的规则下标 */
+	size_t * buckets;	/* entry下标+1 */
+	size_t nbuckets;
+	expr_context * ctx;	/* 所有规则共用的执行上下文 */
+	uint64_t evals;
+};
+
+ARRAY_DEFINE(rule_t, rule)
+ARRAY_DEFINE(char *, str)
+ARRAY_DEFINE(entry_t, entry)
+ARRAY_DEFINE(posting_t, posting)
+ARRAY_DEFINE(size_t, size)
+ARRAY_DEFINE(expr_node_t *, node)
+
+static uint64_t _hash_bytes(uint64_t h, const void *p, size_t len) {
+	const unsigned char *s = (const unsigned char *)p;
+	size_t i;
+	for(i=0; i<len; ++i) {
+		h ^= s[i];
+		h *= _FNV_PRIME;
+	}
+	return h;
+}
+
+static void _key_hash(idx_key_t *key) {
+	uint64_t h = _FNV_OFFSET;
+	h = _hash_bytes(h, &key->var, sizeof(key->var));
+	h = _hash_bytes(h, &key->kind, sizeof(key->kind));
+	if(_KEY_NUM == key->kind) {
+		if(key->num == 0) {
+			key->num = 0;	/* -0.0 和 0.0 相等 */
+		}
+		h = _hash_bytes(h, &key->num, sizeof(key->num));
+	}
+	else {
+		h = _hash_bytes(h, key->str, key->len);
+	}
+	key->hash = h;
+}
+
+static int _key_equal(const idx_key_t *a, const idx_key_t *b) {
+	if(a->hash != b->hash || a->var != b->var || a->kind != b->kind) {
+		return 0;
+	}
+	if(_KEY_NUM == a->kind) {
+		return a->num == b->num;
+	}
+	return a->len == b->len && memcmp(a->str, b->str, a->len) == 0;
+}
+
+expr_ruleset * expr_ruleset_new() {
+	expr_ruleset *rs = (expr_ruleset *)malloc(sizeof(expr_ruleset));
+	if(rs) {
+		memset(rs, 0x00, sizeof(*rs));
+		rule_array_init(&rs->rules);
+		str_array_init(&rs->vars);
+		entry_array_init(&rs->entries);
+		posting_array_init(&rs->postings);
+		size_array_init(&rs->unindexed);
+		rs->buckets = (size_t *)calloc(_ORI_BUCKETS, sizeof(size_t));
+		rs->nbuckets = _ORI_BUCKETS;
+		rs->ctx = expr_context_new();
+		if(!rs->buckets || !rs->ctx) {
+			expr_ruleset_delete(rs);
+			return 0;
+		}
+	}
+	return rs;
+}
+
+void expr_ruleset_delete(expr_ruleset *rs) {
+	size_t i;
+	if(rs) {
+		for(i=0; i<array_size(&rs->rules); ++i) {
+			expr_program_delete(((rule_t *)rs->rules._data)[i].prog);
+		}
+		for(i=0; i<array_size(&rs->vars); ++i) {
+			free(((char **)rs->vars._data)[i]);
+		}
+		array_uinit(&rs->rules);
+		array_uinit(&rs->vars);
+		array_uinit(&rs->entries);
+		array_uinit(&rs->postings);
+		array_uinit(&rs->unindexed);
+		if(rs->buckets) {
+			free(rs->buckets);
+		}
+		expr_context_delete(rs->ctx);
+		free(rs);
+	}
+}
+
+size_t expr_ruleset_size(expr_ruleset *rs) {
+	assert(rs);
+	return array_size(&rs->rules);
+}
+
+uint64_t expr_ruleset_eval_count(expr_ruleset *rs) {
+	assert(rs);
+	return rs->evals;
+}
+
+size_t expr_ruleset_unindexed(expr_ruleset *rs) {
+	assert(rs);
+	return array_size(&rs->unindexed);
+}
+
+/*
+ * 是否 变量 == 数字常量 或 变量 -se 字符串常量 的条件
+ */
+static int _match_pred(expr_node_t *node, expr_node_t **var, expr_node_t **cst) {
+	expr_node_t *l, *r;
+	if(_NODE_TYPE_OPER != node->type) {
+		return -1;
+	}
+	if(_OPER_EQ != node->u.oper && _OPER_SE != node->u.oper) {
+		return -1;
+	}
+	l = node->left;
+	r = node->right;
+	if(_NODE_TYPE_DATA != l->type || _NODE_TYPE_DATA != r->type) {
+		return -1;
+	}
+	if(_DATA_KIND_VAR == r->kind) {
+		expr_node_t *t = l; l = r; r = t;
+	}
+	if(_DATA_KIND_VAR != l->kind || _DATA_KIND_VAR == r->kind) {
+		return -1;
+	}
+	if((_OPER_SE == node->u.oper) != (_DATA_KIND_STR == r->kind)) {
+		return -1;
+	}
+	*var = l;
+	*cst = r;
+	return 0;
+}
+
+/*
+ * 从左到右在顶层 && 链中找第一个可索引的条件.
+ * 用显式的栈保存还没看的右边, 很长的链也不会递归过深
+ */
+static int _find_pred(expr_node_t *root, expr_node_t **var, expr_node_t **cst) {
+	array_t stack;
+	expr_node_t *node = root;
+	int ret = -1;
+
+	if(node_array_init(&stack) < 0) {
+		return -1;
+	}
+	while(node) {
+		if(_NODE_TYPE_OPER == node->type && _OPER_AND == node->u.oper) {
+			if(node_array_push_back(&stack, node->right) < 0) {
+				break;
+			}
+			node = node->left;
+			continue;
+		}
+		if(_match_pred(node, var, cst) == 0) {
+			ret = 0;
+			break;
+		}
+		node = 0;
+		if(array_size(&stack) > 0) {
+			array_back(&stack, &node);
+			array_pop_back(&stack);
+		}
+	}
+	array_uinit(&stack);
+	return ret;
+}
+
+static int _var_index(expr_ruleset *rs, char *varname, size_t *idx) {
+	char **vars = (char **)rs->vars._data;
+	size_t i, size = array_size(&rs->vars);
+	char *copy = 0;
+	for(i=0; i<size; ++i) {
+		if(strcmp(vars[i], varname) == 0) {
+			*idx = i;
+			return 0;
+		}
+	}
+	copy = (char *)malloc(strlen(varname)+1);
+	if(!copy) {
+		return -1;
+	}
+	strcpy(copy, varname);
+	if(str_array_push_back(&rs->vars, copy) < 0) {
+		free(copy);
+		return -1;
+	}
+	*idx = size;
+	return 0;
+}
+
+static entry_t * _lookup(expr_ruleset *rs, const idx_key_t *key) {
+	entry_t *entries = (entry_t *)rs->entries._data;
+	size_t e = rs->buckets[key->hash % rs->nbuckets];
+	while(e) {
+		if(_key_equal(&entries[e-1].key, key)) {
+			return entries + e-1;
+		}
+		e = entries[e-1].next;
+	}
+	return 0;
+}
+
+static int _rehash(expr_ruleset *rs) {
+	entry_t *entries = (entry_t *)rs->entries._data;
+	size_t i, nbuckets = rs->nbuckets * 2;
+	size_t *buckets = (size_t *)calloc(nbuckets, sizeof(size_t));
+	if(!buckets) {
+		return -1;
+	}
+	for(i=0; i<array_size(&rs->entries); ++i) {
+		size_t b = entries[i].key.hash % nbuckets;
+		entries[i].next = buckets[b];
+		buckets[b] = i+1;
+	}
+	free(rs->buckets);
+	rs->buckets = buckets;
+	rs->nbuckets = nbuckets;
+	return 0;
+}
+
+static int _index_rule(expr_ruleset *rs, size_t rule, expr_node_t *var, expr_node_t *cst) {
+	idx_key_t key;
+	entry_t *entry = 0;
+	posting_t posting;
+
+	memset(&key, 0x00, sizeof(key));
+	if(_var_index(rs, var->varname, &key.var) < 0) {
+		return -1;
+	}
+	if(_DATA_KIND_STR == cst->kind) {
+		key.kind = _KEY_STR;
+		key.str = cst->value.u.p;
+		key.len = cst->value.len;
+	}
+	else {
+		key.kind = _KEY_NUM;
+		key.num = _DATA_TYPE_DOUBLE == cst->value.type ? \
+			cst->value.u.d : (double)cst->value.u.n;
+	}
+	_key_hash(&key);
+
+	entry = _lookup(rs, &key);
+	if(!entry) {
+		entry_t e;
+		size_t b;
+		if(array_size(&rs->entries) >= rs->nbuckets && _rehash(rs) < 0) {
+			return -1;
+		}
+		memset(&e, 0x00, sizeof(e));
+		e.key = key;
+		b = key.hash % rs->nbuckets;
+		e.next = rs->buckets[b];
+		if(entry_array_push_back(&rs->entries, e) < 0) {
+			return -1;
+		}
+		rs->buckets[b] = array_size(&rs->entries);
+		entry = (entry_t *)rs->entries._data + array_size(&rs->entries) - 1;
+	}
+
+	posting.rule = rule;
+	posting.next = entry->head;
+	if(posting_array_push_back(&rs->postings, posting) < 0) {
+		return -1;
+	}
+	entry->head = array_size(&rs->postings);
+	return 0;
+}
+
+int expr_ruleset_add(expr_ruleset *rs, int rule_id, char *exp_str) {
+	rule_t rule;
+	expr_node_t *var = 0, *cst = 0;
+	size_t idx;
+	assert(rs);
+
+	rule.id = rule_id;
+	rule.prog = expr_program_new(exp_str);
+	if(!rule.prog) {
+		return -1;
+	}
+	if(rule_array_push_back(&rs->rules, rule) < 0) {
+		expr_program_delete(rule.prog);
+		return -1;
+	}
+
+	idx = array_size(&rs->rules) - 1;
+	if(_find_pred(rule.prog->root, &var, &cst) == 0) {
+		if(_index_rule(rs, idx, var, cst) == 0) {
+			return 0;
+		}
+	}
+	if(size_array_push_back(&rs->unindexed, idx) < 0) {
+		array_pop_back(&rs->rules);
+		expr_program_delete(rule.prog);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * 执行一条规则, 命中时记下id. 只有记录id失败时返回-1
+ */
+static int _eval_rule(expr_ruleset *rs, size_t idx, expr_value_getter getter, \
+		void *usrdata, array_t *ids) {
+	rule_t *rule = (rule_t *)rs->rules._data + idx;
+	int result = 0;
+	rs->evals++;
+	if(expr_program_execute(rule->prog, rs->ctx, &result, getter, usrdata) == 0 && result) {
+		return array_push_back(ids, &rule->id);
+	}
+	return 0;
+}
+
+int expr_ruleset_match(expr_ruleset *rs, expr_value_getter getter, \
+		void *usrdata, array_t *ids) {
+	size_t i, nvars;
+	char **vars = 0;
+	size_t *unindexed = 0;
+	posting_t *postings = 0;
+
+	assert(rs);
+	assert(getter);
+	assert(ids && array_element_size(ids) == sizeof(int));
+	array_clear(ids);
+
+	vars = (char **)rs->vars._data;
+	nvars = array_size(&rs->vars);
+	postings = (posting_t *)rs->postings._data;
+	for(i=0; i<nvars; ++i) {
+		expr_value_t value;
+		idx_key_t key;
+		entry_t *entry = 0;
+		size_t p;
+
+		memset(&value, 0x00, sizeof(value));
+		if(getter(vars[i], &value, usrdata) < 0) {
+			/* 取不到值的变量, 依赖它的规则执行时也会出错 */
+			continue;
+		}
+		memset(&key, 0x00, sizeof(key));
+		key.var = i;
+		if(_DATA_TYPE_STR == value.type) {
+			key.kind = _KEY_STR;
+			key.str = value.u.p;
+			key.len = value.len;
+		}
+		else {
+			key.kind = _KEY_NUM;
+			key.num = _DATA_TYPE_DOUBLE == value.type ? value.u.d : (double)value.u.n;
+		}
+		_key_hash(&key);
+		entry = _lookup(rs, &key);
+		expr_value_clear(&value);
+		if(!entry) {
+			continue;
+		}
+		for(p = entry->head; p; p = postings[p-1].next) {
+			if(_eval_rule(rs, postings[p-1].rule, getter, usrdata, ids) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	unindexed = (size_t *)rs->unindexed._data;
+	for(i=0; i<array_size(&rs->unindexed); ++i) {
+		if(_eval_rule(rs, unindexed[i], getter, usrdata, ids) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 规则集: 持有大量表达式, 按事件返回命中的规则.
+ * 每条规则顶层 && 链中的一个等值条件($var == 常量 或 $var -se 常量)被放进倒排索引,
+ * 匹配时每个被索引的变量只取一次值, 只有索引命中的规则才完整执行.
+ * 没有可索引条件的规则每次都执行.
+ */
+#ifndef _EXPR_RULESET_H_
+#define _EXPR_RULESET_H_
+
+#include "expr_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct expr_ruleset expr_ruleset;
+
+extern expr_ruleset * expr_ruleset_new();
+extern void expr_ruleset_delete(expr_ruleset *rs);
+extern int expr_ruleset_add(expr_ruleset *rs, int rule_id, char *exp_str);
+extern size_t expr_ruleset_size(expr_ruleset *rs);
+
+/*
+ * ids 须已用 array_init(ids, sizeof(int)) 初始化, 先清空再写入命中的规则id,
+ * 顺序不保证. 执行出错的规则视为不命中. 内存不足记不下命中的规则时返回-1.
+ */
+extern int expr_ruleset_match(expr_ruleset *rs, expr_value_getter getter, \
+		void *usrdata, array_t *ids);
+
+/*
+ * 统计: 被完整执行的规则数, 以及没有可索引条件的规则数
+ */
+extern uint64_t expr_ruleset_eval_count(expr_ruleset *rs);
+extern size_t expr_ruleset_unindexed(expr_ruleset *rs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
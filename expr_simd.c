@@ -0,0 +1,278 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 批量执行的向量化比较内核, 运行时按CPU选择AVX2/SSE4.2, 否则由调用方走标量.
+ * 每个内核只处理整64行的部分, 返回已处理的行数, 剩余行由标量代码完成.
+ */
+#include "expr_inner.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define _EXPR_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static int _simd_limit = EXPR_SIMD_AVX2;
+
+void expr_simd_limit(int level) {
+	_simd_limit = level;
+}
+
+/*
+ * CPU支持的级别在装载时检测一次, 之后只读, 字符串比较每次取用不必再查
+ */
+static int _cpu_level = EXPR_SIMD_NONE;
+
+#ifdef _EXPR_X86_SIMD
+__attribute__((constructor))
+static void _simd_detect(void) {
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		_cpu_level = EXPR_SIMD_AVX2;
+	}
+	else if(__builtin_cpu_supports("sse4.2")) {
+		_cpu_level = EXPR_SIMD_SSE42;
+	}
+}
+#endif
+
+int expr_simd_level(void) {
+	return _cpu_level < _simd_limit ? _cpu_level : _simd_limit;
+}
+
+#ifdef _EXPR_X86_SIMD
+
+/*
+ * 按64行一个字生成掩码, STEP 为每个向量的行数, CMP 得到 STEP 位
+ */
+#define _SIMD_LOOP(STEP, CMP) \
+	for(w=0; w<nwords; ++w) { \
+		uint64_t bits = 0; \
+		const size_t base = w*64; \
+		for(j=0; j<64; j+=STEP) { bits |= (uint64_t)(CMP) << j; } \
+		mask[w] = invert ? ~bits : bits; \
+	}
+
+/*
+ * 整数只有相等和大于两种比较, 其余由交换参数和取反得到
+ */
+#define _I64_SETUP \
+	size_t w, j, nwords = n/64; \
+	int eq = (_OPER_EQ == op || _OPER_NE == op); \
+	int swap = (_OPER_LT == op || _OPER_GE == op); \
+	int invert = (_OPER_NE == op || _OPER_LE == op || _OPER_GE == op)
+
+__attribute__((target("avx2")))
+static size_t _cmp_i64_ac_avx2(int op, const int64_t *l, int64_t c, size_t n, uint64_t *mask) {
+	__m256i vc = _mm256_set1_epi64x(c);
+	_I64_SETUP;
+#define _LOAD _mm256_loadu_si256((const __m256i *)(l+base+j))
+#define _MOVE(m) _mm256_movemask_pd(_mm256_castsi256_pd(m))
+	if(eq) { _SIMD_LOOP(4, _MOVE(_mm256_cmpeq_epi64(_LOAD, vc))) }
+	else if(swap) { _SIMD_LOOP(4, _MOVE(_mm256_cmpgt_epi64(vc, _LOAD))) }
+	else { _SIMD_LOOP(4, _MOVE(_mm256_cmpgt_epi64(_LOAD, vc))) }
+#undef _LOAD
+	return nwords*64;
+}
+
+__attribute__((target("avx2")))
+static size_t _cmp_i64_aa_avx2(int op, const int64_t *l, const int64_t *r, size_t n, uint64_t *mask) {
+	_I64_SETUP;
+#define _LOAD_L _mm256_loadu_si256((const __m256i *)(l+base+j))
+#define _LOAD_R _mm256_loadu_si256((const __m256i *)(r+base+j))
+	if(eq) { _SIMD_LOOP(4, _MOVE(_mm256_cmpeq_epi64(_LOAD_L, _LOAD_R))) }
+	else if(swap) { _SIMD_LOOP(4, _MOVE(_mm256_cmpgt_epi64(_LOAD_R, _LOAD_L))) }
+	else { _SIMD_LOOP(4, _MOVE(_mm256_cmpgt_epi64(_LOAD_L, _LOAD_R))) }
+#undef _LOAD_L
+#undef _LOAD_R
+#undef _MOVE
+	return nwords*64;
+}
+
+__attribute__((target("sse4.2")))
+static size_t _cmp_i64_ac_sse42(int op, const int64_t *l, int64_t c, size_t n, uint64_t *mask) {
+	__m128i vc = _mm_set1_epi64x(c);
+	_I64_SETUP;
+#define _LOAD _mm_loadu_si128((const __m128i *)(l+base+j))
+#define _MOVE(m) _mm_movemask_pd(_mm_castsi128_pd(m))
+	if(eq) { _SIMD_LOOP(2, _MOVE(_mm_cmpeq_epi64(_LOAD, vc))) }
+	else if(swap) { _SIMD_LOOP(2, _MOVE(_mm_cmpgt_epi64(vc, _LOAD))) }
+	else { _SIMD_LOOP(2, _MOVE(_mm_cmpgt_epi64(_LOAD, vc))) }
+#undef _LOAD
+	return nwords*64;
+}
+
+__attribute__((target("sse4.2")))
+static size_t _cmp_i64_aa_sse42(int op, const int64_t *l, const int64_t *r, size_t n, uint64_t *mask) {
+	_I64_SETUP;
+#define _LOAD_L _mm_loadu_si128((const __m128i *)(l+base+j))
+#define _LOAD_R _mm_loadu_si128((const __m128i *)(r+base+j))
+	if(eq) { _SIMD_LOOP(2, _MOVE(_mm_cmpeq_epi64(_LOAD_L, _LOAD_R))) }
+	else if(swap) { _SIMD_LOOP(2, _MOVE(_mm_cmpgt_epi64(_LOAD_R, _LOAD_L))) }
+	else { _SIMD_LOOP(2, _MOVE(_mm_cmpgt_epi64(_LOAD_L, _LOAD_R))) }
+#undef _LOAD_L
+#undef _LOAD_R
+#undef _MOVE
+	return nwords*64;
+}
+
+/*
+ * 浮点比较的谓词是立即数, 每个运算符展开一次; != 要对NaN为真, 用无序谓词
+ */
+#define _F64_SETUP \
+	size_t w, j, nwords = n/64; \
+	const int invert = 0
+
+#define _F64_SWITCH(CMP) \
+	switch(op) { \
+	case _OPER_EQ: _SIMD_LOOP(_STEP, CMP(_CMP_EQ_OQ)) break; \
+	case _OPER_NE: _SIMD_LOOP(_STEP, CMP(_CMP_NEQ_UQ)) break; \
+	case _OPER_LT: _SIMD_LOOP(_STEP, CMP(_CMP_LT_OQ)) break; \
+	case _OPER_LE: _SIMD_LOOP(_STEP, CMP(_CMP_LE_OQ)) break; \
+	case _OPER_GT: _SIMD_LOOP(_STEP, CMP(_CMP_GT_OQ)) break; \
+	case _OPER_GE: _SIMD_LOOP(_STEP, CMP(_CMP_GE_OQ)) break; \
+	default: return 0; \
+	}
+
+__attribute__((target("avx2")))
+static size_t _cmp_f64_ac_avx2(int op, const double *l, double c, size_t n, uint64_t *mask) {
+	__m256d vc = _mm256_set1_pd(c);
+	_F64_SETUP;
+#define _STEP 4
+#define _CMP(P) _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(l+base+j), vc, P))
+	_F64_SWITCH(_CMP)
+#undef _CMP
+	return nwords*64;
+}
+
+__attribute__((target("avx2")))
+static size_t _cmp_f64_aa_avx2(int op, const double *l, const double *r, size_t n, uint64_t *mask) {
+	_F64_SETUP;
+#define _CMP(P) _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(l+base+j), \
+			_mm256_loadu_pd(r+base+j), P))
+	_F64_SWITCH(_CMP)
+#undef _CMP
+#undef _STEP
+	return nwords*64;
+}
+
+/*
+ * SSE没有带谓词的比较, 按运算符选择指令
+ */
+#define _SSE_F64_SWITCH(LOAD_R) \
+	switch(op) { \
+	case _OPER_EQ: _SIMD_LOOP(2, _mm_movemask_pd(_mm_cmpeq_pd(_LOAD_L, LOAD_R))) break; \
+	case _OPER_NE: _SIMD_LOOP(2, _mm_movemask_pd(_mm_cmpneq_pd(_LOAD_L, LOAD_R))) break; \
+	case _OPER_LT: _SIMD_LOOP(2, _mm_movemask_pd(_mm_cmplt_pd(_LOAD_L, LOAD_R))) break; \
+	case _OPER_LE: _SIMD_LOOP(2, _mm_movemask_pd(_mm_cmple_pd(_LOAD_L, LOAD_R))) break; \
+	case _OPER_GT: _SIMD_LOOP(2, _mm_movemask_pd(_mm_cmpgt_pd(_LOAD_L, LOAD_R))) break; \
+	case _OPER_GE: _SIMD_LOOP(2, _mm_movemask_pd(_mm_cmpge_pd(_LOAD_L, LOAD_R))) break; \
+	default: return 0; \
+	}
+
+#define _LOAD_L _mm_loadu_pd(l+base+j)
+
+__attribute__((target("sse4.2")))
+static size_t _cmp_f64_ac_sse42(int op, const double *l, double c, size_t n, uint64_t *mask) {
+	__m128d vc = _mm_set1_pd(c);
+	_F64_SETUP;
+	_SSE_F64_SWITCH(vc)
+	return nwords*64;
+}
+
+__attribute__((target("sse4.2")))
+static size_t _cmp_f64_aa_sse42(int op, const double *l, const double *r, size_t n, uint64_t *mask) {
+	_F64_SETUP;
+	_SSE_F64_SWITCH(_mm_loadu_pd(r+base+j))
+	return nwords*64;
+}
+
+#undef _LOAD_L
+
+/*
+ * ASCII字母折叠成小写: 'A'-1 < c < 'Z'+1 的字节置0x20位.
+ * 有符号比较时非ASCII字节是负数, 不在范围内
+ */
+#define _FOLD_SSE(v) _mm_or_si128(v, _mm_and_si128(_mm_and_si128( \
+			_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v)), \
+			_mm_set1_epi8(0x20)))
+#define _FOLD_AVX2(v) _mm256_or_si256(v, _mm256_and_si256(_mm256_and_si256( \
+			_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v)), \
+			_mm256_set1_epi8(0x20)))
+
+__attribute__((target("avx2")))
+static size_t _str_nocase_avx2(const char *a, const char *b, size_t len, int mode) {
+	size_t i = 0;
+	for( ; i + 32 <= len; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a+i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b+i));
+		if(_mm256_movemask_epi8(_mm256_or_si256(va, vb))) { break; }
+		if(!(mode & _STR_FOLDED_A)) { va = _FOLD_AVX2(va); }
+		if(!(mode & _STR_FOLDED_B)) { vb = _FOLD_AVX2(vb); }
+		if((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != 0xffffffffu) { break; }
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static size_t _str_nocase_sse2(const char *a, const char *b, size_t len, int mode) {
+	size_t i = 0;
+	for( ; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a+i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b+i));
+		if(_mm_movemask_epi8(_mm_or_si128(va, vb))) { break; }
+		if(!(mode & _STR_FOLDED_A)) { va = _FOLD_SSE(va); }
+		if(!(mode & _STR_FOLDED_B)) { vb = _FOLD_SSE(vb); }
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) { break; }
+	}
+	return i;
+}
+
+#undef _FOLD_SSE
+#undef _FOLD_AVX2
+
+#endif
+
+size_t _simd_cmp_i64_ac(int level, int op, const int64_t *l, int64_t c, size_t n, uint64_t *mask) {
+#ifdef _EXPR_X86_SIMD
+	if(EXPR_SIMD_AVX2 == level) { return _cmp_i64_ac_avx2(op, l, c, n, mask); }
+	if(EXPR_SIMD_SSE42 == level) { return _cmp_i64_ac_sse42(op, l, c, n, mask); }
+#endif
+	return 0;
+}
+
+size_t _simd_cmp_i64_aa(int level, int op, const int64_t *l, const int64_t *r, size_t n, uint64_t *mask) {
+#ifdef _EXPR_X86_SIMD
+	if(EXPR_SIMD_AVX2 == level) { return _cmp_i64_aa_avx2(op, l, r, n, mask); }
+	if(EXPR_SIMD_SSE42 == level) { return _cmp_i64_aa_sse42(op, l, r, n, mask); }
+#endif
+	return 0;
+}
+
+size_t _simd_cmp_f64_ac(int level, int op, const double *l, double c, size_t n, uint64_t *mask) {
+#ifdef _EXPR_X86_SIMD
+	if(EXPR_SIMD_AVX2 == level) { return _cmp_f64_ac_avx2(op, l, c, n, mask); }
+	if(EXPR_SIMD_SSE42 == level) { return _cmp_f64_ac_sse42(op, l, c, n, mask); }
+#endif
+	return 0;
+}
+
+size_t _simd_cmp_f64_aa(int level, int op, const double *l, const double *r, size_t n, uint64_t *mask) {
+#ifdef _EXPR_X86_SIMD
+	if(EXPR_SIMD_AVX2 == level) { return _cmp_f64_aa_avx2(op, l, r, n, mask); }
+	if(EXPR_SIMD_SSE42 == level) { return _cmp_f64_aa_sse42(op, l, r, n, mask); }
+#endif
+	return 0;
+}
+
+size_t _simd_str_nocase(int level, const char *a, const char *b, size_t len, int mode) {
+#ifdef _EXPR_X86_SIMD
+	if(EXPR_SIMD_AVX2 == level) {
+		size_t i = _str_nocase_avx2(a, b, len, mode);
+		/* 不足32字节的尾部再用16字节比较 */
+		return i + _str_nocase_sse2(a+i, b+i, len-i, mode);
+	}
+	if(EXPR_SIMD_SSE42 == level) { return _str_nocase_sse2(a, b, len, mode); }
+#endif
+	return 0;
+}
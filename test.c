@@ -1,6 +1,24 @@
 #include "expr_parser.h"
 #include <stdlib.h>
 #include <assert.h>
+#include <ctype.h>
+
+/*
+ * 统计分配次数, 链接时用 -Wl,--wrap=malloc,--wrap=realloc 把分配转到这里
+ */
+static size_t alloc_count = 0;
+void * __real_malloc(size_t size);
+void * __real_realloc(void *p, size_t size);
+
+void * __wrap_malloc(size_t size) {
+	alloc_count++;
+	return __real_malloc(size);
+}
+
+void * __wrap_realloc(void *p, size_t size) {
+	alloc_count++;
+	return __real_realloc(p, size);
+}
 
 int get_value(char *varname, expr_value_t * value, void *usrdata) {
 	assert(varname);
@@ -35,6 +53,859 @@ int get_value(char *varname, expr_value_t * value, void *usrdata) {
 	return 0;
 }
 
+static void check(char *exp_str, int expect_ret, int expect_result) {
+	int ret, result = -1;
+	expr_parser * parser = expr_parser_new();
+	assert(parser);
+	ret = expr_parser_parse(parser, exp_str);
+	if(ret == 0) {
+		ret = expr_parser_execute(parser, &result, get_value, NULL);
+	}
+	printf("%s => ret:%d, result:%d\n", exp_str, ret, result);
+	assert(ret == expect_ret);
+	if(ret == 0) {
+		assert(result == expect_result);
+	}
+	expr_parser_delete(parser);
+}
+
+void test_execute() {
+	check("1 == 1", 0, 1);
+	check("1 < 2 && 2 < 1", 0, 0);
+	check("!(1 > 2) || 0", 0, 1);
+	check("$e <= -178 && $d >= 36.6", 0, 1);
+	check("$var_pchar -se 'hello' && $var_pchar -sne \"world\"", 0, 1);
+	check("[[HeLLo]] -ce $var_pchar && !([[x]] -cne 'X')", 0, 1);
+	check("(((true))) && !false", 0, 1);
+	check("[[a]] -se 'a' && 2.5 > 2. && 7 == 7. && '' -se [[]]", 0, 1);
+	check("1<=1&&2>=2&&!(1!=1)&&(1<2||2>1)", 0, 1);
+	check("'ab'-se'ab'&&'ab'-sne'a'&&'AB'-ce'ab'&&!('AB'-cne'ab')", 0, 1);
+	check("1 = 1", -1, 0);
+	check("1 & 1", -1, 0);
+	check("'a' -sx 'a'", -1, 0);
+	check("$var_pchar == 1", -1, 0);
+	check("$nosuchvar == 1", -1, 0);
+	check("1 == ", -1, 0);
+	check("1", -1, 0);
+}
+
+int get_slot_value(int slot, expr_value_t *value, void *usrdata) {
+	int64_t *values = (int64_t *)usrdata;
+	expr_value_set_int(value, values[slot]);
+	return 0;
+}
+
+void test_slot() {
+	int result = -1;
+	int64_t values[3] = {0, 0, 0};
+	size_t i;
+	expr_parser * parser = expr_parser_new();
+	assert(expr_parser_parse(parser, "$a > b && ($b < 10 || $c == a)") == 0);
+	assert(expr_parser_var_count(parser) == 3);
+	for(i=0; i<expr_parser_var_count(parser); ++i) {
+		char *name = expr_parser_var_name(parser, i);
+		/* 倒序绑定槽位: a->2, b->1, c->0 */
+		assert(expr_parser_bind_var(parser, i, (int)(2-(name[0]-'a'))) == 0);
+	}
+	assert(expr_parser_var_name(parser, 3) == 0);
+	assert(expr_parser_bind_var(parser, 3, 0) < 0);
+
+	values[2] = 5; values[1] = 3; values[0] = 0;
+	assert(expr_parser_execute_slot(parser, &result, get_slot_value, values) == 0);
+	assert(result == 1);
+	values[1] = 30;
+	assert(expr_parser_execute_slot(parser, &result, get_slot_value, values) == 0);
+	assert(result == 0);
+	values[2] = 50; values[0] = 50;
+	assert(expr_parser_execute_slot(parser, &result, get_slot_value, values) == 0);
+	assert(result == 1);
+	printf("test_slot ok\n");
+	expr_parser_delete(parser);
+}
+
+int get_counted_value(char *varname, expr_value_t *value, void *usrdata) {
+	int *calls = (int *)usrdata;
+	(*calls)++;
+	if(strcmp(varname, "flag") == 0) {
+		expr_value_set_int(value, 0);
+	}
+	else if(strcmp(varname, "on") == 0) {
+		expr_value_set_int(value, 1);
+	}
+	else {
+		expr_value_set_str(value, "x", 1);
+	}
+	return 0;
+}
+
+void test_short_circuit() {
+	int result = -1, calls = 0;
+	uint64_t skips = 0, skipped = 0;
+	expr_parser * parser = expr_parser_new();
+
+	assert(expr_parser_parse(parser, "$flag && $expensive -se 'x'") == 0);
+	assert(expr_parser_execute(parser, &result, get_counted_value, &calls) == 0);
+	assert(result == 0 && calls == 1);
+	expr_parser_skip_stat(parser, &skips, &skipped);
+	assert(skips == 1 && skipped == 4);
+
+	calls = 0;
+	assert(expr_parser_parse(parser, "on || $expensive -se 'x'") == 0);
+	assert(expr_parser_execute(parser, &result, get_counted_value, &calls) == 0);
+	assert(result == 1 && calls == 1);
+
+	calls = 0;
+	assert(expr_parser_parse(parser, "!on || ($flag || $expensive -se 'x') && on") == 0);
+	assert(expr_parser_execute(parser, &result, get_counted_value, &calls) == 0);
+	assert(result == 1 && calls == 4);
+	expr_parser_skip_stat(parser, &skips, &skipped);
+	assert(skips == 0);
+
+	calls = 0;
+	assert(expr_parser_parse(parser, "$expensive && on") == 0);
+	assert(expr_parser_execute(parser, &result, get_counted_value, &calls) < 0);
+	assert(calls == 1);
+	printf("test_short_circuit ok\n");
+	expr_parser_delete(parser);
+}
+
+#define BATCH_ROWS 3001
+
+typedef struct batch_row_ctx {
+	expr_column_t *columns;
+	size_t row;
+} batch_row_ctx;
+
+int get_column_value(int slot, expr_value_t *value, void *usrdata) {
+	batch_row_ctx *ctx = (batch_row_ctx *)usrdata;
+	expr_column_t *col = ctx->columns + slot;
+	if(col->type == EXPR_COLUMN_INT64) {
+		expr_value_set_int(value, col->i64[ctx->row]);
+	}
+	else if(col->type == EXPR_COLUMN_DOUBLE) {
+		expr_value_set_double(value, col->f64[ctx->row]);
+	}
+	else {
+		expr_value_set_str(value, (char *)col->data + col->offsets[ctx->row], \
+				col->offsets[ctx->row+1] - col->offsets[ctx->row]);
+	}
+	return 0;
+}
+
+static int64_t batch_ints[BATCH_ROWS];
+static double batch_doubles[BATCH_ROWS];
+static size_t batch_offsets[BATCH_ROWS+1];
+static char batch_strs[BATCH_ROWS*8];
+
+/*
+ * 批量执行的结果必须和逐行执行一致
+ */
+static void check_batch(expr_parser *parser, char *exp_str) {
+	static unsigned char bitmap[(BATCH_ROWS+7)/8];
+	expr_column_t columns[3];
+	batch_row_ctx ctx;
+	int result = -1;
+	size_t i, v;
+
+	assert(expr_parser_parse(parser, exp_str) == 0);
+	memset(columns, 0x00, sizeof(columns));
+	for(v=0; v<expr_parser_var_count(parser); ++v) {
+		char *name = expr_parser_var_name(parser, v);
+		expr_column_t *col = columns + v;
+		if(strcmp(name, "i") == 0) {
+			col->type = EXPR_COLUMN_INT64;
+			col->i64 = batch_ints;
+		}
+		else if(strcmp(name, "d") == 0) {
+			col->type = EXPR_COLUMN_DOUBLE;
+			col->f64 = batch_doubles;
+		}
+		else {
+			col->type = EXPR_COLUMN_STR;
+			col->offsets = batch_offsets;
+			col->data = batch_strs;
+		}
+	}
+	memset(bitmap, 0xcc, sizeof(bitmap));
+	assert(expr_parser_execute_batch(parser, columns, expr_parser_var_count(parser), \
+				BATCH_ROWS, bitmap) == 0);
+	ctx.columns = columns;
+	for(i=0; i<BATCH_ROWS; ++i) {
+		ctx.row = i;
+		assert(expr_parser_execute_slot(parser, &result, get_column_value, &ctx) == 0);
+		assert(result == ((bitmap[i/8] >> (i%8)) & 1));
+	}
+	assert((bitmap[BATCH_ROWS/8] >> (BATCH_ROWS%8)) == 0);
+}
+
+void test_batch() {
+	static unsigned char bitmap[(BATCH_ROWS+7)/8];
+	char *words[4] = {"get", "GET", "post", "put"};
+	char *exps[] = {
+		"$i > 50",
+		"50 >= $i && $d < 0.5",
+		"!($i != 7) || $d >= 0.25",
+		"$i == $d || $i < 3 && !($s -se 'get')",
+		"$s -ce [[GET]] && ($i <= 20 || 1.5 > $d)",
+		"$s -sne 'put' && $s -cne \"post\" && true",
+		"($i > 10) == ($d > 0.3) || false",
+		"'a' -se 'a' && 1 < 2",
+		"!$i",
+		"$i >= -3 && $i != 0 || $i < -15",
+		"$d > $d || $d == $d && $i <= $i && !($i < $i)",
+		"1 == 1 || $i > 5",
+		"!!($i > 5) && true || false && $d < 0.5"
+	};
+	expr_column_t column;
+	size_t i, k;
+	int level;
+	expr_parser * parser = expr_parser_new();
+
+	batch_offsets[0] = 0;
+	for(i=0; i<BATCH_ROWS; ++i) {
+		char *w = words[(i*7) % 4];
+		batch_ints[i] = (int64_t)((i * 37) % 101) - 20;
+		batch_doubles[i] = (double)((i * 13) % 17) / 16;
+		memcpy(batch_strs + batch_offsets[i], w, strlen(w));
+		batch_offsets[i+1] = batch_offsets[i] + strlen(w);
+	}
+
+	/* 每个SIMD级别都要和逐行执行一致 */
+	for(level=EXPR_SIMD_NONE; level<=EXPR_SIMD_AVX2; ++level) {
+		expr_simd_limit(level);
+		for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+			check_batch(parser, exps[k]);
+		}
+	}
+	expr_simd_limit(EXPR_SIMD_AVX2);
+
+	memset(&column, 0x00, sizeof(column));
+	column.type = EXPR_COLUMN_STR;
+	column.offsets = batch_offsets;
+	column.data = batch_strs;
+	assert(expr_parser_parse(parser, "$s > 1") == 0);
+	assert(expr_parser_execute_batch(parser, &column, 1, BATCH_ROWS, bitmap) < 0);
+	assert(expr_parser_execute_batch(parser, &column, 0, BATCH_ROWS, bitmap) < 0);
+	printf("test_batch ok\n");
+	expr_parser_delete(parser);
+}
+
+/*
+ * 节点和文本来自内存池, 预热后反复解析不再申请内存
+ */
+void test_arena() {
+	char *exps[] = {
+		0,
+		"[[Ab]] -cne $b.a[5] && hello_c<$d&&(e>=-179.4.) && !world_c",
+		"!($x -se 'str') || 1.5 < $y"
+	};
+	char long_exp[4096];
+	expr_parser *parser = expr_parser_new();
+	expr_program *prog = 0;
+	size_t i, k, count;
+
+	long_exp[0] = '\0';
+	for(i=0; i<200; ++i) {
+		sprintf(long_exp + strlen(long_exp), "%s$v%lu == %lu", i ? " || " : "", \
+				(unsigned long)i, (unsigned long)i);
+	}
+	exps[0] = long_exp;
+
+	/* 第一次解析: 内存池的块和各数组都按倍数增长, 分配次数与节点数成对数关系 */
+	count = alloc_count;
+	prog = expr_program_new(long_exp);
+	assert(prog);
+	assert(alloc_count - count < 64);
+	expr_program_delete(prog);
+
+	for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+		assert(expr_parser_parse(parser, exps[k]) == 0);
+	}
+	count = alloc_count;
+	for(i=0; i<100; ++i) {
+		for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+			assert(expr_parser_parse(parser, exps[k]) == 0);
+		}
+		expr_parser_reset(parser);
+	}
+	assert(alloc_count == count);
+	expr_parser_delete(parser);
+	printf("test_arena ok\n");
+}
+
+/*
+ * 借用的字符串按长度比较, 可以包含'\0', 执行时不申请内存
+ */
+typedef struct ref_row_t {
+	const char *s;
+	size_t slen;
+	const char *t;
+	size_t tlen;
+} ref_row_t;
+
+static int get_ref_value(char *varname, expr_value_t *value, void *usrdata) {
+	ref_row_t *row = (ref_row_t *)usrdata;
+	if(strcmp(varname, "s") == 0) {
+		expr_value_set_str_ref(value, row->s, row->slen);
+	}
+	else if(strcmp(varname, "t") == 0) {
+		expr_value_set_str_ref(value, row->t, row->tlen);
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static void check_ref(expr_parser *parser, char *exp_str, ref_row_t *row, int expect_result) {
+	int result = -1;
+	assert(expr_parser_parse(parser, exp_str) == 0);
+	assert(expr_parser_execute(parser, &result, get_ref_value, row) == 0);
+	assert(result == expect_result);
+}
+
+void test_str_ref() {
+	static const char buf[] = "ab\0cd|ab\0ce|AB";
+	expr_parser *parser = expr_parser_new();
+	ref_row_t row;
+	size_t i, count;
+	int result;
+
+	row.s = buf;
+	row.slen = 5;
+	row.t = buf + 6;
+	row.tlen = 5;
+	check_ref(parser, "$s -se 'ab'", &row, 0);
+	check_ref(parser, "$s -sne 'ab'", &row, 1);
+	check_ref(parser, "$s -se $t", &row, 0);
+	row.tlen = 4;
+	check_ref(parser, "$s -se $t", &row, 0);
+	row.slen = 4;
+	check_ref(parser, "$s -se $t", &row, 1);
+	check_ref(parser, "$s -cne $t", &row, 0);
+
+	row.slen = 2;
+	row.t = buf + 12;
+	row.tlen = 2;
+	check_ref(parser, "$s -se 'ab'", &row, 1);
+	check_ref(parser, "$s -se $t", &row, 0);
+	check_ref(parser, "$s -ce $t", &row, 1);
+	check_ref(parser, "$t -ce 'aB' && $s -cne 'abc'", &row, 1);
+
+	count = alloc_count;
+	for(i=0; i<100; ++i) {
+		assert(expr_parser_execute(parser, &result, get_ref_value, &row) == 0);
+		assert(result == 1);
+	}
+	assert(alloc_count == count);
+	expr_parser_delete(parser);
+	printf("test_str_ref ok\n");
+}
+
+/*
+ * 常量折叠和布尔化简: 结果和报错不变, 被化简掉的变量不再取值
+ */
+static void check_folded(expr_parser *parser, char *exp_str, int expect_ret, int expect_result, \
+		int expect_calls) {
+	int result = -1, calls = 0;
+	assert(expr_parser_parse(parser, exp_str) == 0);
+	assert(expr_parser_execute(parser, &result, get_counted_value, &calls) == expect_ret);
+	assert(expect_ret < 0 || result == expect_result);
+	assert(calls == expect_calls);
+}
+
+void test_optimize() {
+	uint64_t skips = 0, skipped = 0;
+	int result = -1;
+	expr_parser * parser = expr_parser_new();
+
+	check_folded(parser, "1 == 1 || $expensive -se 'x'", 0, 1, 0);
+	check_folded(parser, "true && $on", 0, 1, 1);
+	check_folded(parser, "!!$on && true", 0, 1, 1);
+	check_folded(parser, "!!!$flag", 0, 1, 1);
+	check_folded(parser, "($flag > 0 || false) && (2.5 > 1)", 0, 0, 1);
+	check_folded(parser, "!('abc' -ce [[ABC]]) || !(1 != 1)", 0, 1, 0);
+	expr_parser_skip_stat(parser, &skips, &skipped);
+	assert(skips == 0 && skipped == 0);
+
+	/* 可能报错的部分不化简 */
+	check_folded(parser, "$expensive && false", -1, 0, 1);
+	check_folded(parser, "'a' == 1 || true", -1, 0, 0);
+	check_folded(parser, "true && 'a'", -1, 0, 0);
+
+	/* 根上的 !! 把值变成0或1, 不能去掉 */
+	assert(expr_parser_parse(parser, "!!$hello_c") == 0);
+	assert(expr_parser_execute(parser, &result, get_value, 0) == 0 && result == 1);
+	assert(expr_parser_parse(parser, "true") == 0);
+	assert(expr_parser_execute(parser, &result, get_value, 0) < 0);
+
+	expr_parser_parse(parser, "true && ($x > 1 || 2 < 1) && !!($y -se 'a')");
+	expr_parser_print_tree(parser);
+	printf("\ntest_optimize ok\n");
+	expr_parser_delete(parser);
+}
+
+/*
+ * 自适应顺序: 常常为假的便宜条件被移到前面, 结果不变, 学到的顺序可以保存和恢复
+ */
+static int get_row_value(char *varname, expr_value_t *value, void *usrdata) {
+	int *row = (int *)usrdata;
+	row[3]++;
+	if(varname[0] < 'a' || varname[0] > 'c') {
+		return -1;
+	}
+	expr_value_set_int(value, row[varname[0] - 'a']);
+	return 0;
+}
+
+void test_adaptive() {
+	char *exp_str = "$a > 5 && $c > 0 || ($a > 8 || $b == 3 || $c < 0) && !($a == $b)";
+	char order[256], order2[256];
+	int result = -1, result2 = -1, calls = 0, i;
+	int row[4];
+	expr_parser *parser = expr_parser_new();
+	expr_parser *plain = expr_parser_new();
+	expr_program *prog = 0;
+	expr_context *ctx = expr_context_new();
+
+	assert(expr_parser_parse(parser, "$expensive -se 'x' && $on && $flag") == 0);
+	assert(expr_parser_execute(parser, &result, get_counted_value, &calls) == 0);
+	assert(result == 0 && calls == 3);
+	expr_parser_set_adaptive(parser, 50);
+	for(i=0; i<50; ++i) {
+		assert(expr_parser_execute(parser, &result, get_counted_value, &calls) == 0);
+	}
+	calls = 0;
+	assert(expr_parser_execute(parser, &result, get_counted_value, &calls) == 0);
+	assert(result == 0 && calls == 1);
+	assert(expr_parser_get_order(parser, order, sizeof(order)) == strlen(order));
+	assert(strcmp(order, "29,22,11") == 0);
+	assert(expr_parser_get_order(parser, order2, 4) == strlen(order));
+	assert(strcmp(order2, "29,") == 0);
+
+	/* 恢复顺序后不用再学习 */
+	prog = expr_program_new("$expensive -se 'x' && $on && $flag");
+	assert(expr_program_set_order(prog, "1,2") < 0);
+	assert(expr_program_set_order(prog, "29,29,11") < 0);
+	assert(expr_program_set_order(prog, "29,22") < 0);
+	assert(expr_program_set_order(prog, "29,22,11;") == 0);
+	calls = 0;
+	assert(expr_program_execute(prog, ctx, &result, get_counted_value, &calls) == 0);
+	assert(result == 0 && calls == 1);
+	expr_program_delete(prog);
+
+	/* 嵌套的链, 结果和不重排时一致 */
+	expr_parser_set_adaptive(parser, 7);
+	assert(expr_parser_parse(parser, exp_str) == 0);
+	assert(expr_parser_parse(plain, exp_str) == 0);
+	for(i=0; i<1000; ++i) {
+		row[0] = (i * 7) % 11;
+		row[1] = (i * 5) % 4;
+		row[2] = i % 13 == 0 ? -1 : 1;
+		row[3] = 0;
+		assert(expr_parser_execute(parser, &result, get_row_value, row) == 0);
+		assert(expr_parser_execute(plain, &result2, get_row_value, row) == 0);
+		assert(result == result2);
+	}
+	assert(expr_parser_get_order(parser, order, sizeof(order)) > 0);
+	assert(expr_parser_set_order(plain, order) == 0);
+	assert(expr_parser_get_order(plain, order2, sizeof(order2)) == strlen(order));
+	assert(strcmp(order, order2) == 0);
+
+	expr_context_delete(ctx);
+	expr_parser_delete(parser);
+	expr_parser_delete(plain);
+	printf("test_adaptive ok\n");
+}
+
+/*
+ * 忽略大小写比较: 各SIMD级别的结果都和逐字节 tolower 一致, 包括非ASCII字节
+ */
+typedef struct nocase_row_t {
+	char *s;
+	char *t;
+} nocase_row_t;
+
+static int get_nocase_value(char *varname, expr_value_t *value, void *usrdata) {
+	nocase_row_t *row = (nocase_row_t *)usrdata;
+	char *p = strcmp(varname, "s") == 0 ? row->s : row->t;
+	expr_value_set_str_ref(value, p, strlen(p));
+	return 0;
+}
+
+static int ref_nocase_equal(const char *a, const char *b) {
+	if(strlen(a) != strlen(b)) {
+		return 0;
+	}
+	for( ; *a; ++a, ++b) {
+		if(tolower((unsigned char)*a) != tolower((unsigned char)*b)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void test_nocase() {
+	static const char chars[] = "aAzZbB09@[`{-.\xc4\xe4";
+	char s[128], t[128], exp_str[256];
+	unsigned int seed = 12345;
+	nocase_row_t row;
+	expr_parser *parser = expr_parser_new();
+	expr_parser *lit = expr_parser_new();
+	int k, level, result;
+	size_t i, len;
+
+	row.s = s;
+	row.t = t;
+	assert(expr_parser_parse(parser, "$s -ce $t") == 0);
+	for(k=0; k<3000; ++k) {
+		seed = seed * 1103515245u + 12345u;
+		len = (seed >> 8) % 100;
+		for(i=0; i<len; ++i) {
+			seed = seed * 1103515245u + 12345u;
+			s[i] = chars[(seed >> 12) % (sizeof(chars) - 1)];
+			t[i] = s[i];
+			if((seed >> 20) % 2 && isalpha((unsigned char)s[i])) {
+				t[i] = (char)(s[i] ^ 0x20);
+			}
+			if((seed >> 4) % 97 == 0) {
+				t[i] = chars[(seed >> 24) % (sizeof(chars) - 1)];
+			}
+		}
+		s[len] = t[len] = '\0';
+		if(k % 5 == 0 && len > 0) {
+			t[len-1] = '\0';
+		}
+		sprintf(exp_str, "$s -cne [[%s]]", t);
+		assert(expr_parser_parse(lit, exp_str) == 0);
+		for(level=EXPR_SIMD_NONE; level<=EXPR_SIMD_AVX2; ++level) {
+			expr_simd_limit(level);
+			assert(expr_parser_execute(parser, &result, get_nocase_value, &row) == 0);
+			assert(result == ref_nocase_equal(s, t));
+			assert(expr_parser_execute(lit, &result, get_nocase_value, &row) == 0);
+			assert(result == !ref_nocase_equal(s, t));
+		}
+	}
+	expr_simd_limit(EXPR_SIMD_AVX2);
+	expr_parser_delete(parser);
+	expr_parser_delete(lit);
+	printf("test_nocase ok\n");
+}
+
+/*
+ * 带哈希的字符串: 结果和只按内容比较一致, 哈希相同时仍然比较内容
+ */
+static int get_hashed_value(char *varname, expr_value_t *value, void *usrdata) {
+	nocase_row_t *row = (nocase_row_t *)usrdata;
+	char *p = strcmp(varname, "s") == 0 ? row->s : row->t;
+	expr_value_set_str_ref(value, p, strlen(p));
+	if(varname[0] == 's' || strcmp(row->t, "skip") != 0) {
+		expr_value_set_hash(value, expr_str_hash(p, strlen(p)));
+	}
+	return 0;
+}
+
+void test_str_hash() {
+	static char *strs[] = {"GET /index.html", "GET /index.htm", "GET /index.htmx", \
+		"get /index.html", "", "skip", "GET /index.html"};
+	char exp_str[128];
+	nocase_row_t row;
+	expr_parser *vars = expr_parser_new();
+	int result;
+	size_t i, k, n = sizeof(strs) / sizeof(strs[0]);
+
+	assert(expr_str_hash("", 0) != 0);
+	assert(expr_str_hash("abc", 3) == expr_str_hash("abcd", 3));
+	assert(expr_str_hash("abc", 3) != expr_str_hash("abd", 3));
+	assert(expr_parser_parse(vars, "$s -se $t") == 0);
+	for(i=0; i<n; ++i) {
+		for(k=0; k<n; ++k) {
+			expr_parser *lit = expr_parser_new();
+			row.s = strs[i];
+			row.t = strs[k];
+			assert(expr_parser_execute(vars, &result, get_hashed_value, &row) == 0);
+			assert(result == (strcmp(strs[i], strs[k]) == 0));
+			sprintf(exp_str, "$s -sne '%s' && $s -ce '%s'", strs[k], strs[k]);
+			assert(expr_parser_parse(lit, exp_str) == 0);
+			assert(expr_parser_execute(lit, &result, get_hashed_value, &row) == 0);
+			assert(result == (strcmp(strs[i], strs[k]) != 0 && ref_nocase_equal(strs[i], strs[k])));
+			expr_parser_delete(lit);
+		}
+	}
+	expr_parser_delete(vars);
+	printf("test_str_hash ok\n");
+}
+
+/*
+ * 大整数按int64精确比较, 不经过浮点; 批量执行的混合比较和逐行一致
+ */
+typedef struct big_row_t {
+	int64_t a;
+	double d;
+} big_row_t;
+
+static int get_big_value(char *varname, expr_value_t *value, void *usrdata) {
+	big_row_t *row = (big_row_t *)usrdata;
+	if(strcmp(varname, "a") == 0) {
+		expr_value_set_int(value, row->a);
+	}
+	else {
+		expr_value_set_double(value, row->d);
+	}
+	return 0;
+}
+
+static int eval_big(char *exp_str, int64_t a, double d) {
+	expr_parser *parser = expr_parser_new();
+	big_row_t row;
+	int result = -1;
+	row.a = a;
+	row.d = d;
+	assert(expr_parser_parse(parser, exp_str) == 0);
+	assert(expr_parser_execute(parser, &result, get_big_value, &row) == 0);
+	expr_parser_delete(parser);
+	return result;
+}
+
+void test_int64() {
+	char *exps[] = {
+		"$i == 9007199254740993",
+		"$i != 9007199254740992",
+		"$i > 9007199254740992.0 && $i < 9223372036854775807",
+		"$i <= $d || $d == $i",
+		"$d < $i && !($i >= $d)",
+		"$i >= 9223372036854775808 || $i < -9223372036854775808",
+		"$i > -1.5 && $i <= 2.5",
+		"$i == 1.5 || $i != 2.0",
+		"9007199254740993 > $d || 3 < $d"
+	};
+	int64_t big = (int64_t)1 << 53, max = (int64_t)((((uint64_t)1) << 63) - 1);
+	double zero = 0;
+	size_t i, k;
+	int level;
+	expr_parser *parser = expr_parser_new();
+
+	/* 整数常量按64位解析, 超出范围的按浮点数 */
+	assert(eval_big("$a == 9007199254740993", big + 1, 0) == 1);
+	assert(eval_big("$a == 9007199254740993", big, 0) == 0);
+	assert(eval_big("$a == 4294967297", ((int64_t)1 << 32) + 1, 0) == 1);
+	assert(eval_big("$a == 9223372036854775807", max, 0) == 1);
+	assert(eval_big("$a == -9223372036854775808 && $a < -9223372036854775807", -max - 1, 0) == 1);
+	assert(eval_big("$a < 9223372036854775808", max, 0) == 1);
+	assert(eval_big("$a != 9223372036854775808", max, 0) == 1);
+
+	/* 整数和浮点数混合时也不丢精度 */
+	assert(eval_big("$d < $a", big + 1, (double)big) == 1);
+	assert(eval_big("$a == $d", big + 1, (double)big) == 0);
+	assert(eval_big("$a == $d", big, (double)big) == 1);
+	assert(eval_big("$a > 2.5 && $a < 3.5 && $a != 3.0", 3, 0) == 0);
+	assert(eval_big("$a > -2.5 && $a <= -2.0", -2, 0) == 1);
+	assert(eval_big("$a < $d", max, 9223372036854775808.0) == 1);
+	assert(eval_big("$a > $d", -max - 1, -9223372036854775808.0 * 2) == 1);
+
+	/* NaN 只有 != 为真 */
+	assert(eval_big("$a != $d && !($a == $d) && !($a < $d) && !($d >= $a)", 1, zero / zero) == 1);
+	assert(eval_big("$d != $d && !($d == 0.5)", 1, zero / zero) == 1);
+
+	for(i=0; i<BATCH_ROWS; ++i) {
+		switch(i % 4) {
+		case 0: batch_ints[i] = big + (int64_t)(i % 7) - 3; break;
+		case 1: batch_ints[i] = max - (int64_t)(i % 5); break;
+		case 2: batch_ints[i] = -max - 1 + (int64_t)(i % 3); break;
+		default: batch_ints[i] = (int64_t)(i % 9) - 4; break;
+		}
+		batch_doubles[i] = i % 3 ? (double)big + (double)(i % 11) - 5 : (double)(i % 13) / 4 - 1;
+		if(i % 97 == 0) {
+			batch_doubles[i] = zero / zero;
+		}
+	}
+	for(level=EXPR_SIMD_NONE; level<=EXPR_SIMD_AVX2; ++level) {
+		expr_simd_limit(level);
+		for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+			check_batch(parser, exps[k]);
+		}
+	}
+	expr_simd_limit(EXPR_SIMD_AVX2);
+	expr_parser_delete(parser);
+	printf("test_int64 ok\n");
+}
+
+/*
+ * 运行时统计: 定义 EXPR_METRICS 编译时计数和耗时, 否则都是0
+ */
+static uint64_t hist_total(const uint64_t *hist) {
+	uint64_t total = 0;
+	size_t i;
+	for(i=0; i<EXPR_METRICS_BUCKETS; ++i) {
+		total += hist[i];
+	}
+	return total;
+}
+
+void test_metrics() {
+	expr_parser *parser = expr_parser_new();
+	expr_program *prog = expr_program_new("d > 1 && world_c == 0");
+	expr_context *ctx1 = expr_context_new(), *ctx2 = expr_context_new();
+	expr_metrics_t m, sum;
+	uint64_t hist[EXPR_METRICS_BUCKETS];
+	int result, i;
+
+	expr_parser_set_metrics_sample(parser, 1);
+	assert(expr_parser_parse(parser, "d > 1 && var_pchar -se 'hello'") == 0);
+	assert(expr_parser_execute(parser, &result, get_value, NULL) == 0 && result == 1);
+	assert(expr_parser_parse(parser, "(d > 1") < 0);
+	assert(expr_parser_parse(parser, "nope > 1 || d > 1") == 0);
+	assert(expr_parser_execute(parser, &result, get_value, NULL) < 0);
+	assert(expr_parser_parse(parser, "var_pchar > 1") == 0);
+	assert(expr_parser_execute(parser, &result, get_value, NULL) < 0);
+	expr_parser_metrics(parser, &m);
+#ifdef EXPR_METRICS
+	assert(m.parses == 4 && m.parse_errors == 1);
+	assert(m.executions == 3 && m.exec_errors == 2);
+	assert(m.getter_calls == 4 && m.getter_failures == 1 && m.type_errors == 1);
+	assert(hist_total(m.parse_ns) == 4 && hist_total(m.exec_ns) == 3);
+#else
+	assert(m.parses == 0 && m.executions == 0 && m.getter_calls == 0 && hist_total(m.exec_ns) == 0);
+#endif
+	expr_parser_metrics_reset(parser);
+	expr_parser_metrics(parser, &m);
+	assert(m.parses == 0 && m.executions == 0 && hist_total(m.parse_ns) == 0);
+
+	/* 每个线程一个上下文, 读取时相加; 没有设置抽样时不测耗时 */
+	for(i=0; i<5; ++i) {
+		assert(expr_program_execute(prog, i < 3 ? ctx1 : ctx2, &result, get_value, NULL) == 0);
+	}
+	memset(&sum, 0x00, sizeof(sum));
+	expr_context_metrics(ctx1, &m);
+	expr_metrics_merge(&sum, &m);
+	expr_context_metrics(ctx2, &m);
+	expr_metrics_merge(&sum, &m);
+#ifdef EXPR_METRICS
+	assert(sum.executions == 5 && sum.getter_calls == 10 && sum.exec_errors == 0);
+	assert(hist_total(sum.exec_ns) == 0);
+	expr_context_set_metrics_sample(ctx1, 2);
+	for(i=0; i<6; ++i) {
+		assert(expr_program_execute(prog, ctx1, &result, get_value, NULL) == 0);
+	}
+	expr_context_metrics(ctx1, &m);
+	assert(m.executions == 9 && hist_total(m.exec_ns) == 3);
+#else
+	assert(sum.executions == 0);
+#endif
+
+	memset(hist, 0x00, sizeof(hist));
+	assert(expr_metrics_percentile(hist, 0.5) == 0);
+	hist[3] = 10;
+	hist[10] = 10;
+	assert(expr_metrics_percentile(hist, 0) == 16);
+	assert(expr_metrics_percentile(hist, 0.5) == 16);
+	assert(expr_metrics_percentile(hist, 0.99) == 2048);
+
+	expr_context_delete(ctx1);
+	expr_context_delete(ctx2);
+	expr_program_delete(prog);
+	expr_parser_delete(parser);
+	printf("test_metrics ok\n");
+}
+
+/*
+ * 错误信息: 解析和执行失败时记下原因、偏移和运算符, 设置回调后交给回调
+ */
+static int log_count = 0;
+static expr_error_t log_last;
+
+static void count_log(const expr_error_t *err, void *usrdata) {
+	assert(usrdata == &log_count);
+	log_count++;
+	log_last = *err;
+}
+
+static void check_parse_error(expr_parser *parser, char *exp_str, int code, size_t offset, \
+		const char *oper) {
+	expr_error_t err;
+	assert(expr_parser_parse(parser, exp_str) < 0);
+	expr_parser_error(parser, &err);
+	assert(err.code == code && err.offset == offset);
+	assert(oper ? (err.oper && strcmp(err.oper, oper) == 0) : err.oper == 0);
+}
+
+static void check_exec_error(expr_parser *parser, char *exp_str, int code, size_t offset, \
+		const char *oper, const char *name) {
+	expr_error_t err;
+	int result;
+	assert(expr_parser_parse(parser, exp_str) == 0);
+	assert(expr_parser_execute(parser, &result, get_value, NULL) < 0);
+	expr_parser_error(parser, &err);
+	assert(err.code == code && err.offset == offset);
+	assert(oper ? (err.oper && strcmp(err.oper, oper) == 0) : err.oper == 0);
+	assert(name ? (err.name && strcmp(err.name, name) == 0) : err.name == 0);
+}
+
+void test_error() {
+	expr_parser *parser = expr_parser_new();
+	expr_program *prog;
+	expr_context *ctx = expr_context_new();
+	expr_error_t err;
+	unsigned char bitmap[1];
+	int result;
+
+	check_parse_error(parser, "d > 1 && # 2", EXPR_ERR_CHAR, 9, 0);
+	check_parse_error(parser, "d >", EXPR_ERR_NEED_RIGHT, 2, ">");
+	check_parse_error(parser, "> 1", EXPR_ERR_NEED_LEFT, 0, ">");
+	check_parse_error(parser, "!(d > 1", EXPR_ERR_PAREN, 1, "(");
+	check_parse_error(parser, "(d 1) > 1", EXPR_ERR_VALUES, 0, "(");
+	check_parse_error(parser, "d > 1 world_c", EXPR_ERR_VALUES, 6, 0);
+	check_parse_error(parser, "", EXPR_ERR_VALUES, EXPR_NO_OFFSET, 0);
+
+	check_exec_error(parser, "d > 1 && nope", EXPR_ERR_GETTER, 9, 0, "nope");
+	check_exec_error(parser, "var_pchar > 1", EXPR_ERR_LEFT_TYPE, 10, ">", 0);
+	check_exec_error(parser, "d -se 'x'", EXPR_ERR_LEFT_TYPE, 2, "-se", 0);
+	check_exec_error(parser, "'x' -ce d", EXPR_ERR_RIGHT_TYPE, 4, "-ce", 0);
+	check_exec_error(parser, "var_pchar && d", EXPR_ERR_LEFT_TYPE, 10, "&&", 0);
+	check_exec_error(parser, "d > 1 && var_pchar", EXPR_ERR_RIGHT_TYPE, 6, "&&", 0);
+	check_exec_error(parser, "1", EXPR_ERR_UNEXECUTABLE, EXPR_NO_OFFSET, 0, 0);
+
+	/* 成功的执行不清除, 重新解析时清除 */
+	assert(expr_parser_parse(parser, "d > 1") == 0);
+	expr_parser_error(parser, &err);
+	assert(err.code == EXPR_ERR_NONE);
+	assert(expr_parser_execute_batch(parser, 0, 0, 8, bitmap) < 0);
+	expr_parser_error(parser, &err);
+	assert(err.code == EXPR_ERR_COLUMN && err.offset == 0 && strcmp(err.name, "d") == 0);
+	assert(expr_parser_execute(parser, &result, get_value, NULL) == 0 && result == 1);
+	expr_parser_error(parser, &err);
+	assert(err.code == EXPR_ERR_COLUMN);
+
+	/* 程序和上下文 */
+	prog = expr_program_new("world_c == 0 && nope");
+	assert(expr_program_execute(prog, ctx, &result, get_value, NULL) < 0);
+	expr_context_error(ctx, &err);
+	assert(err.code == EXPR_ERR_GETTER && err.offset == 16 && strcmp(err.name, "nope") == 0);
+	expr_program_delete(prog);
+
+	/* 默认没有回调; 设置后每个错误交给回调一次, 包括没有地方记录的错误 */
+	expr_set_log(count_log, &log_count);
+	assert(expr_program_new("world_c ==") == 0);
+	assert(log_count == 1 && log_last.code == EXPR_ERR_NEED_RIGHT && log_last.offset == 8);
+	check_exec_error(parser, "nope == 1", EXPR_ERR_GETTER, 0, 0, "nope");
+	assert(log_count == 2 && log_last.code == EXPR_ERR_GETTER);
+	assert(expr_parser_parse(parser, "d > 1 && world_c == 0") == 0);
+	assert(expr_parser_execute(parser, &result, get_value, NULL) == 0);
+	assert(log_count == 2);
+	expr_set_log(0, 0);
+	assert(expr_program_new("(") == 0);
+	assert(log_count == 2);
+
+	assert(strcmp(expr_strerror(EXPR_ERR_NONE), "no error") == 0);
+	assert(strcmp(expr_strerror(EXPR_ERR_IMAGE), "invalid image") == 0);
+	assert(strcmp(expr_strerror(-1), "unknown error") == 0);
+	assert(strcmp(expr_strerror(EXPR_ERR_IMAGE + 1), "unknown error") == 0);
+
+	expr_context_delete(ctx);
+	expr_parser_delete(parser);
+	printf("test_error ok\n");
+}
+
 int main()
 {
 	expr_parser * parser = expr_parser_new();
@@ -52,5 +923,18 @@ int main()
 		}	
 		expr_parser_delete(parser);
 	}
+	test_execute();
+	test_slot();
+	test_short_circuit();
+	test_batch();
+	test_arena();
+	test_str_ref();
+	test_optimize();
+	test_adaptive();
+	test_nocase();
+	test_str_hash();
+	test_int64();
+	test_metrics();
+	test_error();
 	return 0;
 }
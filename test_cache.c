@@ -0,0 +1,180 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 编译结果缓存的测试: 命中和淘汰, 以及多个线程在插入淘汰的同时执行取出的程序.
+ * 用 ./build.sh tsan 编译后在 ThreadSanitizer 下运行.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include "expr_cache.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define THREADS	8
+#define ROUNDS	20000
+#define NEXPS	64
+
+static int get_value(char *varname, expr_value_t *value, void *usrdata) {
+	if(strcmp(varname, "a") == 0) {
+		expr_value_set_int(value, *(int64_t *)usrdata);
+		return 0;
+	}
+	return -1;
+}
+
+static int run(const expr_program *prog, int64_t a) {
+	expr_context *ctx = expr_context_new();
+	int result = -1;
+	assert(ctx);
+	assert(expr_program_execute(prog, ctx, &result, get_value, &a) == 0);
+	expr_context_delete(ctx);
+	return result;
+}
+
+static void test_lru() {
+	expr_cache *cache = expr_cache_new(2, 0);
+	expr_cache_stat_t stat;
+	const expr_program *p1, *p2, *p3, *p;
+
+	assert(cache);
+	p1 = expr_cache_get(cache, "$a > 1");
+	p2 = expr_cache_get(cache, "$a > 2");
+	assert(p1 && p2 && p1 != p2);
+	p = expr_cache_get(cache, "$a > 1");
+	assert(p == p1);
+	expr_cache_release(cache, p);
+	expr_cache_stat(cache, &stat);
+	assert(stat.hits == 1 && stat.misses == 2 && stat.evictions == 0);
+	assert(stat.entries == 2 && stat.bytes > 0);
+
+	/* "$a > 2" 最久未用, 被淘汰, 但还在使用中, 仍然可以执行 */
+	p3 = expr_cache_get(cache, "$a > 3");
+	assert(p3);
+	expr_cache_stat(cache, &stat);
+	assert(stat.evictions == 1 && stat.entries == 2);
+	assert(run(p2, 3) == 1 && run(p2, 2) == 0);
+	expr_cache_release(cache, p2);
+	p = expr_cache_get(cache, "$a > 2");
+	assert(p);
+	expr_cache_stat(cache, &stat);
+	assert(stat.misses == 4 && stat.evictions == 2);
+	expr_cache_release(cache, p);
+
+	/* 解析失败不进缓存 */
+	assert(expr_cache_get(cache, "$a >") == 0);
+	assert(expr_cache_get(cache, "$a >") == 0);
+	expr_cache_stat(cache, &stat);
+	assert(stat.misses == 6 && stat.entries == 2);
+
+	expr_cache_release(cache, p1);
+	expr_cache_release(cache, p3);
+	expr_cache_delete(cache);
+}
+
+static void test_bytes() {
+	expr_cache *cache = expr_cache_new(0, 1);
+	expr_cache_stat_t stat, stat2;
+	const expr_program *p;
+	size_t one;
+
+	/* 超过字节上限的程序照常返回, 但不缓存 */
+	p = expr_cache_get(cache, "$a == 5");
+	assert(p && run(p, 5) == 1);
+	expr_cache_release(cache, p);
+	expr_cache_stat(cache, &stat);
+	assert(stat.entries == 0 && stat.bytes == 0);
+	expr_cache_delete(cache);
+
+	cache = expr_cache_new(0, 0);
+	p = expr_cache_get(cache, "$a == 5");
+	expr_cache_release(cache, p);
+	expr_cache_stat(cache, &stat);
+	one = stat.bytes;
+	expr_cache_delete(cache);
+
+	/* 同样大小的程序, 字节上限只容得下3个 */
+	cache = expr_cache_new(0, one * 3 + one / 2);
+	p = expr_cache_get(cache, "$a == 1"); expr_cache_release(cache, p);
+	p = expr_cache_get(cache, "$a == 2"); expr_cache_release(cache, p);
+	p = expr_cache_get(cache, "$a == 3"); expr_cache_release(cache, p);
+	expr_cache_stat(cache, &stat);
+	assert(stat.entries == 3 && stat.evictions == 0 && stat.bytes == one * 3);
+	p = expr_cache_get(cache, "$a == 4"); expr_cache_release(cache, p);
+	expr_cache_stat(cache, &stat2);
+	assert(stat2.entries == 3 && stat2.evictions == 1 && stat2.bytes <= one * 3 + one / 2);
+	p = expr_cache_get(cache, "$a == 1"); expr_cache_release(cache, p);
+	expr_cache_stat(cache, &stat2);
+	assert(stat2.hits == 0 && stat2.misses == 5);
+	expr_cache_delete(cache);
+}
+
+static expr_cache *shared;
+static char exps[NEXPS][32];
+
+static void * worker(void *arg) {
+	unsigned int seed = (unsigned int)(size_t)arg;
+	expr_context *ctx = expr_context_new();
+	int r, result;
+
+	assert(ctx);
+	for(r=0; r<ROUNDS; ++r) {
+		int k, k2;
+		int64_t a;
+		const expr_program *prog, *prog2;
+
+		seed = seed * 1103515245u + 12345u;
+		k = (seed >> 8) % NEXPS;
+		k2 = (seed >> 16) % NEXPS;
+		a = (seed >> 4) % NEXPS;
+		prog = expr_cache_get(shared, exps[k]);
+		assert(prog);
+		/* 持有一个程序的同时取另一个, 触发插入和淘汰 */
+		prog2 = expr_cache_get(shared, exps[k2]);
+		assert(prog2);
+		assert(expr_program_execute(prog, ctx, &result, get_value, &a) == 0);
+		assert(result == (a >= k));
+		expr_cache_release(shared, prog2);
+		assert(expr_program_execute(prog, ctx, &result, get_value, &a) == 0);
+		assert(result == (a >= k));
+		expr_cache_release(shared, prog);
+	}
+	expr_context_delete(ctx);
+	return 0;
+}
+
+static void test_threads() {
+	pthread_t threads[THREADS];
+	expr_cache_stat_t stat;
+	size_t i;
+
+	for(i=0; i<NEXPS; ++i) {
+		sprintf(exps[i], "$a >= %lu", (unsigned long)i);
+	}
+	shared = expr_cache_new(NEXPS / 4, 0);
+	assert(shared);
+	for(i=0; i<THREADS; ++i) {
+		assert(pthread_create(&threads[i], 0, worker, (void *)i) == 0);
+	}
+	for(i=0; i<THREADS; ++i) {
+		assert(pthread_join(threads[i], 0) == 0);
+	}
+	expr_cache_stat(shared, &stat);
+	assert(stat.hits + stat.misses == (uint64_t)THREADS * ROUNDS * 2);
+	assert(stat.entries <= NEXPS / 4 && stat.evictions > 0);
+	expr_cache_delete(shared);
+}
+
+void test_cache() {
+	test_lru();
+	test_bytes();
+	test_threads();
+	printf("test_cache ok\n");
+}
+
+int main() {
+	test_cache();
+	return 0;
+}
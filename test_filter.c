@@ -0,0 +1,185 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * expr_filter 的测试: 把输入写到文件, 运行 ./expr_filter, 比较输出和退出码.
+ * -b 设成很小的缓冲, 覆盖记录跨两次读入和缓冲加倍的路径.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/wait.h>
+
+#define IN_PATH		"test_filter.in"
+#define OUT_PATH	"test_filter.out"
+
+static void write_file(const char *path, const char *data) {
+	FILE *fp = fopen(path, "wb");
+	assert(fp);
+	assert(fwrite(data, 1, strlen(data), fp) == strlen(data));
+	fclose(fp);
+}
+
+static char * read_file(const char *path) {
+	static char buf[1 << 16];
+	size_t n;
+	FILE *fp = fopen(path, "rb");
+	assert(fp);
+	n = fread(buf, 1, sizeof(buf) - 1, fp);
+	buf[n] = '\0';
+	fclose(fp);
+	return buf;
+}
+
+/*
+ * 用单引号括起来交给 shell, 其中的单引号写成 '\''
+ */
+static char * shell_quote(char *p, const char *s) {
+	*p++ = '\'';
+	for( ; *s; ++s) {
+		if(*s == '\'') {
+			strcpy(p, "'\\''");
+			p += 4;
+		}
+		else {
+			*p++ = *s;
+		}
+	}
+	*p++ = '\'';
+	*p = '\0';
+	return p;
+}
+
+/*
+ * 用 opts 和表达式过滤 input, 输出和退出码要和期望的一致
+ */
+static void check(const char *opts, const char *exp_str, const char *input, \
+		const char *expect, int expect_code) {
+	char cmd[1024];
+	char *out, *p;
+	int status;
+
+	write_file(IN_PATH, input);
+	p = cmd + sprintf(cmd, "./expr_filter %s ", opts);
+	p = shell_quote(p, exp_str);
+	strcpy(p, " " IN_PATH " > " OUT_PATH " 2>/dev/null");
+	status = system(cmd);
+	assert(status != -1 && WIFEXITED(status));
+	out = read_file(OUT_PATH);
+	if(WEXITSTATUS(status) != expect_code || strcmp(out, expect) != 0) {
+		printf("mismatch: %s\nexit %d, expect %d\n--- output\n%s--- expect\n%s---\n", cmd, \
+				WEXITSTATUS(status), expect_code, out, expect);
+		fflush(stdout);
+		assert(0);
+	}
+}
+
+/*
+ * 默认缓冲和各种很小的缓冲结果都一样
+ */
+static void check_sizes(const char *opts, const char *exp_str, const char *input, \
+		const char *expect, int expect_code) {
+	static const char *sizes[] = {"", "-b 1", "-b 7", "-b 16", "-b 33"};
+	char all[256];
+	size_t k;
+	for(k=0; k<sizeof(sizes)/sizeof(sizes[0]); ++k) {
+		sprintf(all, "%s %s", opts, sizes[k]);
+		check(all, exp_str, input, expect, expect_code);
+	}
+}
+
+static void test_json() {
+	const char *input =
+		"{\"id\": 1, \"msg\": \"say \\\"hi\\\"\", \"path\": \"a\\/b\\\\c\", \"ok\": true}\n"
+		"{\"id\": 2, \"msg\": \"caf\\u00e9\", \"a\\u0062\": 3, \"tags\": [\"x\", \"}\"]}\n"
+		"\n"
+		"{\"id\": 3, \"x\": null, \"user\": {\"name\": \"u\"}, \"n\": 9223372036854775807}\n"
+		"{\"id\": 4, \"x\": 5, \"n\": 1.5e3}\n"
+		"not json\n"
+		"{\"id\": 5, \"x\": 0.5}";
+
+	check_sizes("", "msg -se 'say \"hi\"'", input,
+		"{\"id\": 1, \"msg\": \"say \\\"hi\\\"\", \"path\": \"a\\/b\\\\c\", \"ok\": true}\n", 0);
+	check_sizes("", "path -se 'a/b\\c' && ok", input,
+		"{\"id\": 1, \"msg\": \"say \\\"hi\\\"\", \"path\": \"a\\/b\\\\c\", \"ok\": true}\n", 0);
+	check_sizes("", "msg -se \"caf\xc3\xa9\" && ab == 3", input,
+		"{\"id\": 2, \"msg\": \"caf\\u00e9\", \"a\\u0062\": 3, \"tags\": [\"x\", \"}\"]}\n", 0);
+	check_sizes("", "user -se '{\"name\": \"u\"}' && n == 9223372036854775807", input,
+		"{\"id\": 3, \"x\": null, \"user\": {\"name\": \"u\"}, \"n\": 9223372036854775807}\n", 0);
+	check_sizes("-c", "n > 1000", input, "2\n", 0);
+
+	/* null 和缺少的键取值失败, 算不匹配, -v 时输出 */
+	check_sizes("", "x > 1", input, "{\"id\": 4, \"x\": 5, \"n\": 1.5e3}\n", 0);
+	check_sizes("-v", "x > 1", input,
+		"{\"id\": 1, \"msg\": \"say \\\"hi\\\"\", \"path\": \"a\\/b\\\\c\", \"ok\": true}\n"
+		"{\"id\": 2, \"msg\": \"caf\\u00e9\", \"a\\u0062\": 3, \"tags\": [\"x\", \"}\"]}\n"
+		"{\"id\": 3, \"x\": null, \"user\": {\"name\": \"u\"}, \"n\": 9223372036854775807}\n"
+		"not json\n"
+		"{\"id\": 5, \"x\": 0.5}\n", 0);
+
+	/* 最后一条没有换行 */
+	check_sizes("", "id == 5", input, "{\"id\": 5, \"x\": 0.5}\n", 0);
+	check_sizes("-c", "id > 100", input, "0\n", 1);
+	printf("test_json ok\n");
+}
+
+static void test_csv() {
+	const char *input =
+		"id,method,status,note\n"
+		"1,GET,200,plain\n"
+		"2,POST,500,\"has, comma\"\n"
+		"3,get,404,\"multi\n"
+		"line \"\"q\"\"\"\n"
+		"4,PUT,x,\"\"\"\"\n"
+		"\n"
+		"5,\"DELETE\",\"204\",last";
+
+	check_sizes("", "status >= 404", input,
+		"id,method,status,note\n"
+		"2,POST,500,\"has, comma\"\n"
+		"3,get,404,\"multi\n"
+		"line \"\"q\"\"\"\n", 0);
+	check_sizes("", "note -se [[multi\nline \"q\"]]", input,
+		"id,method,status,note\n"
+		"3,get,404,\"multi\n"
+		"line \"\"q\"\"\"\n", 0);
+	check_sizes("", "note -se '\"' || note -se 'has, comma'", input,
+		"id,method,status,note\n"
+		"2,POST,500,\"has, comma\"\n"
+		"4,PUT,x,\"\"\"\"\n", 0);
+
+	/* 带引号的格按字符串, 不是数字的格和数字比较算不匹配 */
+	check_sizes("", "status -se '204' && note -se 'last'", input,
+		"id,method,status,note\n"
+		"5,\"DELETE\",\"204\",last\n", 0);
+	check_sizes("-v", "status < 1000", input,
+		"id,method,status,note\n"
+		"4,PUT,x,\"\"\"\"\n"
+		"5,\"DELETE\",\"204\",last\n", 0);
+	check_sizes("-c", "method -ce 'get'", input, "2\n", 0);
+
+	/* 缺少的列 */
+	check_sizes("", "latency > 1", input, "id,method,status,note\n", 1);
+
+	check_sizes("-d ';'", "b -se 'x;y'", "a;b\n1;\"x;y\"\n2;z\n", "a;b\n1;\"x;y\"\n", 0);
+	printf("test_csv ok\n");
+}
+
+static void test_errors() {
+	check("", "1 == ", "{}\n", "", 2);
+	check("", "1", "{}\n", "", 2);
+	check("-f xml", "1 == 1", "{}\n", "", 2);
+	check("-b 0", "1 == 1", "{}\n", "", 2);
+	printf("test_errors ok\n");
+}
+
+int main() {
+	test_json();
+	test_csv();
+	test_errors();
+	remove(IN_PATH);
+	remove(OUT_PATH);
+	return 0;
+}
@@ -0,0 +1,309 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 二进制映像的测试: 保存再加载的程序和原程序结果一致, 损坏或不合法的映像拒绝加载.
+ */
+#include "expr_image.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define IMAGE_PATH	"test_image.img"
+#define ROWS		64
+
+typedef struct row_t {
+	int64_t a;
+	double b;
+	const char *s;
+	int fail;		/* 1-取 $a 失败 */
+} row_t;
+
+static char *exps[] = {
+	"$a == 3",
+	"$a > 9007199254740993 || $b <= -1.5",
+	"$s -se 'GET' && ($a != 0 || !$b)",
+	"$s -ce 'post' || $s -cne 'Put' && $a < 100",
+	"!($a >= 2 && $b < 0.5) || $s -sne 'DELETE'",
+	"($a == 1) == ($b == 1) && true",
+	"$b > 9223372036854775807 && false || $a <= -9223372036854775808",
+	"$a",
+	"1"
+};
+
+static int get_by_name(char *varname, expr_value_t *value, void *usrdata) {
+	row_t *row = (row_t *)usrdata;
+	if(strcmp(varname, "a") == 0) {
+		if(row->fail) {
+			return -1;
+		}
+		expr_value_set_int(value, row->a);
+	}
+	else if(strcmp(varname, "b") == 0) {
+		expr_value_set_double(value, row->b);
+	}
+	else if(strcmp(varname, "s") == 0) {
+		expr_value_set_str_ref(value, row->s, strlen(row->s));
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * 槽位: 0-a, 1-b, 2-s, 故意和变量下标不同
+ */
+static int get_by_slot(int slot, expr_value_t *value, void *usrdata) {
+	static char *names[] = {"a", "b", "s"};
+	return get_by_name(names[slot], value, usrdata);
+}
+
+static void gen_rows(row_t *rows) {
+	static const char *strs[] = {"GET", "get", "POST", "put", "DELETE", ""};
+	static const int64_t ints[] = {0, 1, 2, 3, 99, 100, -1};
+	static const double doubles[] = {0, 0.5, 1, -1.5, -2, 1e300};
+	size_t i;
+	for(i=0; i<ROWS; ++i) {
+		rows[i].a = ints[i % 7];
+		rows[i].b = doubles[(i / 7) % 6];
+		rows[i].s = strs[i % 6];
+		rows[i].fail = i % 13 == 5;
+	}
+	rows[0].a = (int64_t)1 << 53;
+	rows[1].a = ((int64_t)1 << 53) + 2;
+	rows[2].a = -(int64_t)((((uint64_t)1) << 63) - 1) - 1;
+}
+
+static void bind_slots(expr_program *prog) {
+	size_t i;
+	for(i=0; i<expr_program_var_count(prog); ++i) {
+		char *name = expr_program_var_name(prog, i);
+		expr_program_bind_var(prog, i, name[0] == 'a' ? 0 : (name[0] == 'b' ? 1 : 2));
+	}
+}
+
+static expr_program ** new_progs(size_t *n) {
+	expr_program **progs;
+	size_t i;
+	*n = sizeof(exps) / sizeof(exps[0]);
+	progs = (expr_program **)malloc(sizeof(expr_program *) * *n);
+	for(i=0; i<*n; ++i) {
+		progs[i] = expr_program_new(exps[i]);
+		assert(progs[i]);
+		bind_slots(progs[i]);
+	}
+	return progs;
+}
+
+static void delete_progs(expr_program **progs, size_t n) {
+	size_t i;
+	for(i=0; i<n; ++i) {
+		expr_program_delete(progs[i]);
+	}
+	free(progs);
+}
+
+/*
+ * 两个程序在每一行上按变量名和按槽位执行的返回值和结果都相同
+ */
+static void check_same(const expr_program *p1, const expr_program *p2, row_t *rows) {
+	expr_context *ctx = expr_context_new();
+	size_t i, k;
+	assert(expr_program_var_count(p1) == expr_program_var_count(p2));
+	for(k=0; k<expr_program_var_count(p1); ++k) {
+		assert(strcmp(expr_program_var_name(p1, k), expr_program_var_name(p2, k)) == 0);
+	}
+	for(i=0; i<ROWS; ++i) {
+		int r1 = -1, r2 = -1, ret1, ret2;
+		ret1 = expr_program_execute(p1, ctx, &r1, get_by_name, rows + i);
+		ret2 = expr_program_execute(p2, ctx, &r2, get_by_name, rows + i);
+		assert(ret1 == ret2 && (ret1 < 0 || r1 == r2));
+		ret1 = expr_program_execute_slot(p1, ctx, &r1, get_by_slot, rows + i);
+		ret2 = expr_program_execute_slot(p2, ctx, &r2, get_by_slot, rows + i);
+		assert(ret1 == ret2 && (ret1 < 0 || r1 == r2));
+	}
+	expr_context_delete(ctx);
+}
+
+static void test_roundtrip() {
+	static row_t rows[ROWS];
+	expr_program **progs;
+	expr_image *img;
+	void *data = 0, *data2 = 0;
+	size_t i, n, size, size2;
+	int64_t ints[ROWS];
+	double doubles[ROWS];
+	expr_column_t columns[2];
+	unsigned char bm1[ROWS / 8], bm2[ROWS / 8];
+
+	gen_rows(rows);
+	progs = new_progs(&n);
+	assert(expr_image_build(progs, n, &data, &size) == 0);
+	assert(size % 8 == 0);
+	img = expr_image_load(data, size);
+	assert(img && expr_image_count(img) == n);
+	assert(expr_image_program(img, n) == 0);
+	for(i=0; i<n; ++i) {
+		check_same(progs[i], expr_image_program(img, i), rows);
+	}
+
+	/* 空的映像 */
+	assert(expr_image_build(progs, 0, &data2, &size2) == 0);
+	{
+		expr_image *empty = expr_image_load(data2, size2);
+		assert(empty && expr_image_count(empty) == 0 && expr_image_program(empty, 0) == 0);
+		expr_image_close(empty);
+	}
+	free(data2);
+
+	/* 加载的程序可以再保存, 得到相同的映像 */
+	{
+		expr_program **loaded = (expr_program **)malloc(sizeof(expr_program *) * n);
+		for(i=0; i<n; ++i) {
+			loaded[i] = expr_image_program(img, i);
+		}
+		assert(expr_image_build(loaded, n, &data2, &size2) == 0);
+		assert(size2 == size && memcmp(data, data2, size) == 0);
+		free(data2);
+		free(loaded);
+	}
+
+	/* 批量执行, 以及重新绑定槽位 */
+	for(i=0; i<ROWS; ++i) {
+		ints[i] = rows[i].a;
+		doubles[i] = rows[i].b;
+	}
+	memset(columns, 0x00, sizeof(columns));
+	columns[0].type = EXPR_COLUMN_DOUBLE;
+	columns[0].f64 = doubles;
+	columns[1].type = EXPR_COLUMN_INT64;
+	columns[1].i64 = ints;
+	expr_program_bind_var(progs[1], 0, 1);
+	expr_program_bind_var(progs[1], 1, 0);
+	assert(expr_program_bind_var(expr_image_program(img, 1), 0, 1) == 0);
+	assert(expr_program_bind_var(expr_image_program(img, 1), 1, 0) == 0);
+	assert(expr_program_execute_batch(progs[1], columns, 2, ROWS, bm1) == 0);
+	assert(expr_program_execute_batch(expr_image_program(img, 1), columns, 2, ROWS, bm2) == 0);
+	assert(memcmp(bm1, bm2, sizeof(bm1)) == 0);
+
+	expr_image_close(img);
+	free(data);
+	delete_progs(progs, n);
+	printf("test_roundtrip ok\n");
+}
+
+static void test_file() {
+	static row_t rows[ROWS];
+	expr_program **progs;
+	expr_image *img;
+	size_t i, n;
+
+	gen_rows(rows);
+	progs = new_progs(&n);
+	assert(expr_image_save(IMAGE_PATH, progs, n) == 0);
+	img = expr_image_open(IMAGE_PATH);
+	assert(img && expr_image_count(img) == n);
+	for(i=0; i<n; ++i) {
+		check_same(progs[i], expr_image_program(img, i), rows);
+	}
+	expr_image_close(img);
+	remove(IMAGE_PATH);
+	assert(expr_image_open(IMAGE_PATH) == 0);
+	delete_progs(progs, n);
+	printf("test_file ok\n");
+}
+
+/*
+ * 改动映像后重新计算校验和, 只留下结构上的错误
+ */
+static void fix_checksum(unsigned char *data, size_t size) {
+	expr_image_header_t *hdr = (expr_image_header_t *)data;
+	hdr->checksum = expr_image_checksum(hdr + 1, size - sizeof(expr_image_header_t));
+}
+
+static void test_corrupt() {
+	expr_program *prog = expr_program_new("$a > 1 && $s -se 'x'");
+	expr_program *progs[1];
+	expr_image_header_t *hdr;
+	expr_image_inst_t *insts;
+	expr_image_var_t *vars;
+	unsigned char *data = 0, *copy;
+	void *buf;
+	size_t size, i;
+
+	progs[0] = prog;
+	assert(expr_image_build(progs, 1, &buf, &size) == 0);
+	data = (unsigned char *)buf;
+	copy = (unsigned char *)malloc(size + 8);
+	hdr = (expr_image_header_t *)copy;
+	insts = (expr_image_inst_t *)((expr_image_prog_t *)(hdr + 1) + 1);
+
+	/* 每隔7个字节改动一个, 都拒绝加载 */
+	for(i=0; i<size; i+=7) {
+		memcpy(copy, data, size);
+		copy[i] ^= 0x20;
+		assert(expr_image_load(copy, size) == 0);
+	}
+	memcpy(copy, data, size);
+	assert(expr_image_load(copy, size - 8) == 0);
+	memcpy(copy + 4, data, size);
+	assert(expr_image_load(copy + 4, size) == 0);
+
+	/* 校验和正确但结构不合法 */
+	memcpy(copy, data, size);
+	hdr->version++;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+	memcpy(copy, data, size);
+	assert(insts[0].op == 33);
+	insts[0].u.ref.var = 5;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+	memcpy(copy, data, size);
+	insts[3].u.ref.target = 4;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+	memcpy(copy, data, size);
+	insts[2].op = 99;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+	memcpy(copy, data, size);
+	insts[5].u.value = hdr->nstrs;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+	memcpy(copy, data, size);
+	insts[5].u.value += 4;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+	memcpy(copy, data, size);
+	insts[6].op = 33;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+	memcpy(copy, data, size);
+	vars = (expr_image_var_t *)(insts + hdr->ninsts);
+	vars[0].slot = (int64_t)1 << 40;
+	fix_checksum(copy, size);
+	assert(expr_image_load(copy, size) == 0);
+
+	/* 原样复制的映像可以加载 */
+	memcpy(copy, data, size);
+	{
+		expr_image *img = expr_image_load(copy, size);
+		assert(img && expr_image_count(img) == 1);
+		expr_image_close(img);
+	}
+	free(copy);
+	free(data);
+	expr_program_delete(prog);
+	printf("test_corrupt ok\n");
+}
+
+int main() {
+	test_roundtrip();
+	test_file();
+	test_corrupt();
+	printf("test_image ok\n");
+	return 0;
+}
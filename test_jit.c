@@ -0,0 +1,254 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 即时编译的差分测试: 随机生成表达式和取值, 结果和返回值都要和 expr_parser_execute 一致.
+ * 取值中混入类型不符、字符串和取值失败, 覆盖交给解释器的路径.
+ */
+#include "expr_jit.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define NINTS	3
+#define NDOUBLES	2
+#define EXPS	3000
+#define ROWS	40
+
+/*
+ * 一行取值, 每个变量可以按声明的类型给出, 也可以换成其他类型或者取值失败
+ */
+#define _GIVE_DECLARED	0
+#define _GIVE_OTHER		1
+#define _GIVE_STR		2
+#define _GIVE_FAIL		3
+
+typedef struct row_t {
+	int64_t ints[NINTS];
+	double doubles[NDOUBLES];
+	int give[NINTS + NDOUBLES];
+	const char *str;
+	const expr_program *prog;		/* 按槽位取值时由下标找变量名 */
+} row_t;
+
+static unsigned int seed = 20240607u;
+
+static unsigned int next_rand(void) {
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 8;
+}
+
+static int64_t pick_int(void) {
+	static const int64_t small[] = {0, 1, -1, 2, 3, 7, -7, 100};
+	int64_t big = (int64_t)1 << 53, max = (int64_t)((((uint64_t)1) << 63) - 1);
+	switch(next_rand() % 6) {
+	case 0: return big + (int64_t)(next_rand() % 3) - 1;
+	case 1: return next_rand() % 2 ? max : -max - 1;
+	default: return small[next_rand() % (sizeof(small) / sizeof(small[0]))];
+	}
+}
+
+static double pick_double(void) {
+	static const double vals[] = {0.0, 0.5, 1.0, 1.5, -2.5, 3.0, 7.0, 100.0, 1e300, -1e300, \
+		9007199254740992.0, 9007199254740994.0, 9223372036854775808.0};
+	double zero = 0;
+	if(next_rand() % 15 == 0) {
+		return zero / zero;
+	}
+	if(next_rand() % 15 == 0) {
+		return -zero;
+	}
+	return vals[next_rand() % (sizeof(vals) / sizeof(vals[0]))];
+}
+
+static int get_by_name(char *varname, expr_value_t *value, void *usrdata) {
+	row_t *row = (row_t *)usrdata;
+	int idx, is_double = varname[0] == 'd';
+	if(varname[0] == 's') {
+		expr_value_set_str_ref(value, row->str, strlen(row->str));
+		return 0;
+	}
+	idx = varname[1] - '0' + (is_double ? NINTS : 0);
+	switch(row->give[idx]) {
+	case _GIVE_OTHER:
+		if(is_double) { expr_value_set_int(value, (int64_t)row->doubles[idx - NINTS] / 2); }
+		else { expr_value_set_double(value, (double)row->ints[idx]); }
+		return 0;
+	case _GIVE_STR:
+		expr_value_set_str(value, "12", 2);
+		return 0;
+	case _GIVE_FAIL:
+		return -1;
+	}
+	if(is_double) { expr_value_set_double(value, row->doubles[idx - NINTS]); }
+	else { expr_value_set_int(value, row->ints[idx]); }
+	return 0;
+}
+
+static int get_by_slot(int slot, expr_value_t *value, void *usrdata) {
+	row_t *row = (row_t *)usrdata;
+	return get_by_name(expr_program_var_name(row->prog, (size_t)slot), value, usrdata);
+}
+
+static char * gen_atom(char *p) {
+	static const char *lits[] = {"0", "1", "-1", "3", "7", "1.5", "-0.5", "3.0", "100", \
+		"9007199254740993", "9007199254740992.0", "9223372036854775807", "-9223372036854775808", \
+		"9223372036854775808", "true", "false"};
+	unsigned int k = next_rand() % 10;
+	if(k < 3) { return p + sprintf(p, "$i%u", next_rand() % NINTS); }
+	if(k < 5) { return p + sprintf(p, "$d%u", next_rand() % NDOUBLES); }
+	return p + sprintf(p, "%s", lits[next_rand() % (sizeof(lits) / sizeof(lits[0]))]);
+}
+
+static char * gen_exp(char *p, int depth) {
+	static const char *cmps[] = {"==", "!=", "<", "<=", ">", ">="};
+	unsigned int k = next_rand() % 12;
+	if(depth <= 0 || k < 4) {
+		if(next_rand() % 40 == 0) {
+			return p + sprintf(p, "$s -se 'abc'");
+		}
+		if(next_rand() % 8 == 0) {
+			return gen_atom(p);
+		}
+		p = gen_atom(p);
+		p += sprintf(p, " %s ", cmps[next_rand() % 6]);
+		return gen_atom(p);
+	}
+	if(k < 6) {
+		p += sprintf(p, "!(");
+		p = gen_exp(p, depth - 1);
+		return p + sprintf(p, ")");
+	}
+	if(k < 8) {
+		/* 比较的结果再参与比较 */
+		p += sprintf(p, "(");
+		p = gen_exp(p, depth - 1);
+		p += sprintf(p, ") %s (", cmps[next_rand() % 6]);
+		p = gen_exp(p, depth - 1);
+		return p + sprintf(p, ")");
+	}
+	p += sprintf(p, "(");
+	p = gen_exp(p, depth - 1);
+	p += sprintf(p, ") %s (", k < 10 ? "&&" : "||");
+	p = gen_exp(p, depth - 1);
+	return p + sprintf(p, ")");
+}
+
+static void gen_row(row_t *row) {
+	size_t i;
+	for(i=0; i<NINTS; ++i) { row->ints[i] = pick_int(); }
+	for(i=0; i<NDOUBLES; ++i) { row->doubles[i] = pick_double(); }
+	for(i=0; i<NINTS + NDOUBLES; ++i) {
+		unsigned int k = next_rand() % 40;
+		row->give[i] = k == 0 ? _GIVE_OTHER : (k == 1 ? _GIVE_STR : (k == 2 ? _GIVE_FAIL : _GIVE_DECLARED));
+	}
+	row->str = next_rand() % 2 ? "abc" : "abd";
+}
+
+/*
+ * 编译 exp_str, 在 rows 上逐行和解释器对比, 返回是否生成了机器码
+ */
+static int check_exp(char *exp_str, row_t *rows, size_t nrows) {
+	expr_parser *parser = expr_parser_new();
+	expr_program *prog = expr_program_new(exp_str);
+	expr_context *ctx = expr_context_new();
+	expr_jit *jit = 0;
+	int types[NINTS + NDOUBLES + 1];
+	size_t i;
+	int native;
+
+	assert(parser && prog && ctx);
+	assert(expr_parser_parse(parser, exp_str) == 0);
+	for(i=0; i<expr_program_var_count(prog); ++i) {
+		types[i] = expr_program_var_name(prog, i)[0] == 'd' ? EXPR_COLUMN_DOUBLE : EXPR_COLUMN_INT64;
+	}
+	jit = expr_jit_new(prog, types);
+	assert(jit);
+	native = expr_jit_native(jit);
+	for(i=0; i<nrows; ++i) {
+		int r1 = -1, r2 = -1, ret1, ret2;
+		rows[i].prog = prog;
+		ret1 = expr_parser_execute(parser, &r1, get_by_name, rows + i);
+		ret2 = expr_jit_execute(jit, ctx, &r2, get_by_slot, rows + i);
+		if(ret1 != ret2 || (ret1 == 0 && r1 != r2)) {
+			printf("mismatch: %s\nrow %lu: ret %d/%d result %d/%d\n", exp_str, (unsigned long)i, \
+					ret1, ret2, r1, r2);
+			fflush(stdout);
+			assert(0);
+		}
+	}
+	expr_jit_delete(jit);
+	expr_context_delete(ctx);
+	expr_program_delete(prog);
+	expr_parser_delete(parser);
+	return native;
+}
+
+static void test_random() {
+	static row_t rows[ROWS];
+	char exp_str[8192];
+	size_t i, native = 0;
+	int k;
+
+	for(k=0; k<EXPS; ++k) {
+		gen_exp(exp_str, 1 + k % 5);
+		for(i=0; i<ROWS; ++i) {
+			gen_row(rows + i);
+		}
+		native += check_exp(exp_str, rows, ROWS);
+	}
+	/* 只有带字符串比较的表达式走解释器 */
+	assert(native > EXPS * 3 / 4);
+	printf("test_random ok, %lu/%d native\n", (unsigned long)native, EXPS);
+}
+
+static void test_shapes() {
+	static row_t rows[ROWS];
+	char *exps[] = {
+		"$i0 < $i1",
+		"$d0 >= 1.5 && $i0 != 7",
+		"($i0 < $i1) == (($d0 > $d1) != ($i2 >= 3))",
+		"!$d0 || !!$i1",
+		"1.5 < $i0 || 9007199254740993 == $d0 || $i1 > 9223372036854775808",
+		"$i0 == $d0 || $d1 <= $i2",
+		"$s -se 'abc' && $i0 > 1"
+	};
+	char *chain = (char *)malloc(20000 * 24);
+	char *p = chain;
+	size_t i, k;
+
+	for(i=0; i<ROWS; ++i) {
+		gen_row(rows + i);
+	}
+	for(k=0; k<sizeof(exps)/sizeof(exps[0]); ++k) {
+		assert(check_exp(exps[k], rows, ROWS) == (k + 1 != sizeof(exps)/sizeof(exps[0])));
+	}
+	/* 很长的链和很深的嵌套也能编译 */
+	for(i=0; i<20000; ++i) {
+		p += sprintf(p, "%s$i%lu == %lu", i ? " || " : "", (unsigned long)(i % NINTS), (unsigned long)i);
+	}
+	assert(check_exp(chain, rows, ROWS));
+	p = chain;
+	for(i=0; i<5000; ++i) {
+		p += sprintf(p, "%s$d%lu > %lu.5", i ? " && (" : "", (unsigned long)(i % NDOUBLES), \
+				(unsigned long)(i % 3));
+	}
+	for(i=1; i<5000; ++i) {
+		*p++ = ')';
+	}
+	*p = '\0';
+	assert(check_exp(chain, rows, ROWS));
+	/* 没有变量, 新的上下文还没有值栈 */
+	assert(check_exp("(1 < 2) == (3.5 >= 3)", rows, ROWS));
+	assert(check_exp("!(7 > 1.5) || 0", rows, ROWS));
+	free(chain);
+	printf("test_shapes ok\n");
+}
+
+int main() {
+	test_shapes();
+	test_random();
+	printf("test_jit ok\n");
+	return 0;
+}
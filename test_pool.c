@@ -0,0 +1,152 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 线程池并行执行的测试, 结果与单线程逐行执行对比
+ */
+#include "expr_pool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define ROWS	100003
+#define MAX_THREADS	4
+
+typedef struct worker_data_t {
+	const int64_t *a;
+	const double *b;
+	size_t rows;		/* 本线程取值的次数 */
+	size_t fail_row;	/* 在这一行取值失败, ROWS 表示不失败 */
+} worker_data_t;
+
+static int get_row_value(int slot, size_t row, expr_value_t *value, void *usrdata) {
+	worker_data_t *data = (worker_data_t *)usrdata;
+	if(row == data->fail_row) {
+		return -1;
+	}
+	data->rows++;
+	if(0 == slot) {
+		expr_value_set_int(value, data->a[row]);
+	}
+	else {
+		expr_value_set_double(value, data->b[row]);
+	}
+	return 0;
+}
+
+typedef struct row_ctx_t {
+	worker_data_t *data;
+	size_t row;
+} row_ctx_t;
+
+static int get_slot_value(int slot, expr_value_t *value, void *usrdata) {
+	row_ctx_t *ctx = (row_ctx_t *)usrdata;
+	return get_row_value(slot, ctx->row, value, ctx->data);
+}
+
+static int get_bit(const unsigned char *bitmap, size_t i) {
+	return (bitmap[i/8] >> (i%8)) & 1;
+}
+
+static void check_pool(int nthreads, const char *exp_str, worker_data_t *src, size_t offset) {
+	expr_pool *pool = expr_pool_new(nthreads);
+	expr_program *prog = expr_program_new((char *)exp_str);
+	expr_context *ctx = expr_context_new();
+	worker_data_t datas[MAX_THREADS];
+	void *usrdatas[MAX_THREADS];
+	unsigned char *buf = (unsigned char *)malloc((ROWS+7)/8 + 128);
+	unsigned char *bitmap = buf + offset;
+	unsigned char *batch_bitmap = (unsigned char *)malloc((ROWS+7)/8);
+	expr_column_t columns[2];
+	row_ctx_t row_ctx;
+	size_t i, total = 0;
+	int n, result;
+
+	assert(pool && prog && ctx && buf && batch_bitmap);
+	assert(expr_pool_threads(pool) == nthreads);
+	assert(expr_program_var_count(prog) == 2);
+	assert(strcmp(expr_program_var_name(prog, 0), "a") == 0);
+
+	/* 逐行执行 */
+	memset(buf, 0xee, (ROWS+7)/8 + 128);
+	for(n=0; n<nthreads; ++n) {
+		datas[n] = *src;
+		usrdatas[n] = &datas[n];
+	}
+	assert(expr_pool_execute(pool, prog, ROWS, get_row_value, usrdatas, bitmap) == 0);
+	row_ctx.data = src;
+	for(i=0; i<ROWS; ++i) {
+		row_ctx.row = i;
+		assert(expr_program_execute_slot(prog, ctx, &result, get_slot_value, &row_ctx) == 0);
+		assert(get_bit(bitmap, i) == (result != 0));
+	}
+	assert(bitmap[(ROWS+7)/8] == 0xee);
+	assert(0 == offset || bitmap[-1] == 0xee);
+	for(n=0; n<nthreads; ++n) {
+		total += datas[n].rows;
+	}
+	assert(total >= ROWS);
+
+	/* 批量执行 */
+	memset(columns, 0x00, sizeof(columns));
+	columns[0].type = EXPR_COLUMN_INT64;
+	columns[0].i64 = src->a;
+	columns[1].type = EXPR_COLUMN_DOUBLE;
+	columns[1].f64 = src->b;
+	memset(buf, 0xee, (ROWS+7)/8 + 128);
+	assert(expr_program_execute_batch(prog, columns, 2, ROWS, batch_bitmap) == 0);
+	assert(expr_pool_execute_batch(pool, prog, columns, 2, ROWS, bitmap) == 0);
+	assert(memcmp(bitmap, batch_bitmap, (ROWS+7)/8) == 0);
+	assert(bitmap[(ROWS+7)/8] == 0xee);
+
+	/* 出错时整体失败 */
+	for(n=0; n<nthreads; ++n) {
+		datas[n].fail_row = ROWS / 3;
+	}
+	assert(expr_pool_execute(pool, prog, ROWS, get_row_value, usrdatas, bitmap) < 0);
+	assert(expr_pool_execute(pool, prog, 0, get_row_value, usrdatas, bitmap) == 0);
+
+	expr_context_delete(ctx);
+	expr_program_delete(prog);
+	expr_pool_delete(pool);
+	free(buf);
+	free(batch_bitmap);
+}
+
+void test_pool() {
+	int64_t *a = (int64_t *)malloc(sizeof(int64_t) * ROWS);
+	double *b = (double *)malloc(sizeof(double) * ROWS);
+	worker_data_t src;
+	expr_pool *pool = 0;
+	size_t i;
+	int n;
+
+	for(i=0; i<ROWS; ++i) {
+		a[i] = (int64_t)((i * 2654435761u) % 1000);
+		b[i] = (double)((i * 40503u) % 977) / 977;
+	}
+	memset(&src, 0x00, sizeof(src));
+	src.a = a;
+	src.b = b;
+	src.fail_row = ROWS;
+
+	for(n=1; n<=MAX_THREADS; ++n) {
+		check_pool(n, "$a > 500 && $b <= 0.5", &src, 0);
+		check_pool(n, "!($a == 7) || $b > 0.9", &src, 3);
+		check_pool(n, "($a < 100 || $a >= 900) && !($b < 0.25)", &src, 65);
+	}
+
+	pool = expr_pool_new(0);
+	assert(pool && expr_pool_threads(pool) >= 1);
+	expr_pool_delete(pool);
+
+	free(a);
+	free(b);
+	printf("test_pool ok\n");
+}
+
+int main() {
+	test_pool();
+	return 0;
+}
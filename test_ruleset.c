@@ -0,0 +1,131 @@
+#include "expr_ruleset.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+typedef struct event_t {
+	char *method;
+	int64_t status;
+	double ratio;
+} event_t;
+
+int get_event_value(char *varname, expr_value_t *value, void *usrdata) {
+	event_t *ev = (event_t *)usrdata;
+	if(strcmp(varname, "method") == 0) {
+		expr_value_set_str(value, ev->method, strlen(ev->method));
+	}
+	else if(strcmp(varname, "status") == 0) {
+		expr_value_set_int(value, ev->status);
+	}
+	else if(strcmp(varname, "ratio") == 0) {
+		expr_value_set_double(value, ev->ratio);
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static int has_id(array_t *ids, int id) {
+	size_t i;
+	for(i=0; i<array_size(ids); ++i) {
+		if(((int *)ids->_data)[i] == id) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void test_ruleset() {
+	char exp_str[128];
+	event_t ev;
+	array_t ids;
+	uint64_t evals;
+	int i;
+	expr_ruleset *rs = expr_ruleset_new();
+	assert(rs);
+	array_init(&ids, sizeof(int));
+
+	/* 10000 条按状态码索引的规则 */
+	for(i=0; i<10000; ++i) {
+		sprintf(exp_str, "$status == %d && $ratio > 0.5", i);
+		assert(expr_ruleset_add(rs, i, exp_str) == 0);
+	}
+	assert(expr_ruleset_add(rs, 20000, "$ratio > 0.5 && 'GET' -se $method") == 0);
+	assert(expr_ruleset_add(rs, 20001, "$method -se 'POST' || $status == 7") == 0);
+	assert(expr_ruleset_add(rs, 20002, "$status == 7.0 && $method -ce 'get'") == 0);
+	assert(expr_ruleset_add(rs, 20003, "$ratio == 0.75") == 0);
+	assert(expr_ruleset_add(rs, 20004, "$nosuchvar -se 'x' && true") == 0);
+	assert(expr_ruleset_add(rs, 20005, "1 ==") < 0);
+	assert(expr_ruleset_size(rs) == 10005);
+	assert(expr_ruleset_unindexed(rs) == 1);
+
+	ev.method = "GET";
+	ev.status = 7;
+	ev.ratio = 0.75;
+	assert(expr_ruleset_match(rs, get_event_value, &ev, &ids) == 0);
+	assert(array_size(&ids) == 5);
+	assert(has_id(&ids, 7));
+	assert(has_id(&ids, 20000));
+	assert(has_id(&ids, 20001));
+	assert(has_id(&ids, 20002));
+	assert(has_id(&ids, 20003));
+	/* 只执行候选规则: status==7 的两条, method的一条, ratio的一条, 加上未索引的一条 */
+	evals = expr_ruleset_eval_count(rs);
+	assert(evals == 5);
+
+	ev.method = "PUT";
+	ev.status = 12345;
+	ev.ratio = 0.25;
+	assert(expr_ruleset_match(rs, get_event_value, &ev, &ids) == 0);
+	assert(array_size(&ids) == 0);
+	assert(expr_ruleset_eval_count(rs) - evals == 1);
+
+	array_uinit(&ids);
+	expr_ruleset_delete(rs);
+	printf("test_ruleset ok\n");
+}
+
+/*
+ * 很长的 && 链, 可索引的条件在最后, 查找时不能递归过深
+ */
+void test_long_chain() {
+	size_t i, n = 500000;
+	char *exp_str = (char *)malloc(n * 20 + 32);
+	char *p = exp_str;
+	event_t ev;
+	array_t ids;
+	expr_ruleset *rs = expr_ruleset_new();
+	assert(rs && exp_str);
+	array_init(&ids, sizeof(int));
+
+	for(i=0; i<n; ++i) {
+		p += sprintf(p, "$ratio > 0.%lu && ", (unsigned long)(i % 5));
+	}
+	sprintf(p, "$status == 404");
+	assert(expr_ruleset_add(rs, 1, exp_str) == 0);
+	assert(expr_ruleset_unindexed(rs) == 0);
+
+	ev.method = "GET";
+	ev.status = 404;
+	ev.ratio = 0.75;
+	assert(expr_ruleset_match(rs, get_event_value, &ev, &ids) == 0);
+	assert(array_size(&ids) == 1 && has_id(&ids, 1));
+	ev.status = 200;
+	assert(expr_ruleset_match(rs, get_event_value, &ev, &ids) == 0);
+	assert(array_size(&ids) == 0);
+	assert(expr_ruleset_eval_count(rs) == 1);
+
+	free(exp_str);
+	array_uinit(&ids);
+	expr_ruleset_delete(rs);
+	printf("test_long_chain ok\n");
+}
+
+int main()
+{
+	test_ruleset();
+	test_long_chain();
+	return 0;
+}
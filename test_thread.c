@@ -0,0 +1,168 @@
+/**
+ * author: jason886
+ * link: https://github.com/Jason886/expr_parser.git
+ *
+ * 多线程压力测试: 多个线程同时创建解析器, 并共享同一批编译好的程序各自执行.
+ * 用 ./build.sh tsan 编译后在 ThreadSanitizer 下运行.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include "expr_parser.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define THREADS	8
+#define ROUNDS	2000
+#define ROWS	300
+
+typedef struct row_t {
+	int64_t a;
+	double b;
+	char *s;
+} row_t;
+
+static char *strs[] = {"abc", "ABC", "xyz", ""};
+
+static char *exps[] = {
+	"$a > 500 && $b <= 0.5",
+	"!($a == 7) || $s -se 'abc'",
+	"($a < 100 || $a >= 900) && $s -cne 'ABC'"
+};
+
+#define NEXPS (sizeof(exps)/sizeof(exps[0]))
+
+static expr_program *progs[NEXPS];
+
+static int expect(size_t k, row_t *row) {
+	switch(k) {
+	case 0: return row->a > 500 && row->b <= 0.5;
+	case 1: return !(row->a == 7) || strcmp(row->s, "abc") == 0;
+	default: return (row->a < 100 || row->a >= 900) && strcmp(row->s, "abc") != 0 \
+			 && strcmp(row->s, "ABC") != 0;
+	}
+}
+
+static void make_row(row_t *row, unsigned int seed) {
+	seed = seed * 1103515245u + 12345u;
+	row->a = (seed >> 8) % 1000;
+	row->b = (double)((seed >> 4) % 100) / 100;
+	row->s = strs[seed % 4];
+}
+
+static int get_value(char *varname, expr_value_t *value, void *usrdata) {
+	row_t *row = (row_t *)usrdata;
+	if(strcmp(varname, "a") == 0) {
+		expr_value_set_int(value, row->a);
+	}
+	else if(strcmp(varname, "b") == 0) {
+		expr_value_set_double(value, row->b);
+	}
+	else if(strcmp(varname, "s") == 0) {
+		expr_value_set_str(value, row->s, strlen(row->s));
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static int get_slot_value(int slot, expr_value_t *value, void *usrdata) {
+	return get_value(0 == slot ? "a" : (1 == slot ? "b" : "s"), value, usrdata);
+}
+
+static void * worker(void *arg) {
+	unsigned int id = (unsigned int)(size_t)arg;
+	expr_context *ctx = expr_context_new();
+	unsigned char bitmap[(ROWS+7)/8];
+	int64_t as[ROWS];
+	double bs[ROWS];
+	expr_column_t columns[2];
+	size_t i, k;
+	int r, result;
+
+	assert(ctx);
+	for(r=0; r<ROUNDS; ++r) {
+		row_t row;
+
+		/* 并发创建解析器和程序, 运算符表不能有初始化竞争 */
+		if(r % 100 == 0) {
+			expr_parser *parser = expr_parser_new();
+			expr_program *prog = expr_program_new(exps[r % NEXPS]);
+			make_row(&row, id * ROUNDS + r);
+			assert(parser && prog);
+			assert(expr_parser_parse(parser, exps[r % NEXPS]) == 0);
+			assert(expr_parser_execute(parser, &result, get_value, &row) == 0);
+			assert(result == expect(r % NEXPS, &row));
+			assert(expr_program_execute(prog, ctx, &result, get_value, &row) == 0);
+			assert(result == expect(r % NEXPS, &row));
+			expr_program_delete(prog);
+			expr_parser_delete(parser);
+		}
+
+		/* 共享的程序, 每个线程用自己的上下文 */
+		make_row(&row, id * ROUNDS + r);
+		for(k=0; k<NEXPS; ++k) {
+			assert(expr_program_execute(progs[k], ctx, &result, get_value, &row) == 0);
+			assert(result == expect(k, &row));
+			assert(expr_program_execute_slot(progs[k], ctx, &result, get_slot_value, &row) == 0);
+			assert(result == expect(k, &row));
+		}
+	}
+
+	/* 共享的程序做批量执行 */
+	for(i=0; i<ROWS; ++i) {
+		row_t row;
+		make_row(&row, id * ROWS + (unsigned int)i);
+		as[i] = row.a;
+		bs[i] = row.b;
+	}
+	memset(columns, 0x00, sizeof(columns));
+	columns[0].type = EXPR_COLUMN_INT64;
+	columns[0].i64 = as;
+	columns[1].type = EXPR_COLUMN_DOUBLE;
+	columns[1].f64 = bs;
+	assert(expr_program_execute_batch(progs[0], columns, 2, ROWS, bitmap) == 0);
+	for(i=0; i<ROWS; ++i) {
+		row_t row;
+		make_row(&row, id * ROWS + (unsigned int)i);
+		assert(((bitmap[i/8] >> (i%8)) & 1) == expect(0, &row));
+	}
+
+	expr_context_delete(ctx);
+	return 0;
+}
+
+void test_thread() {
+	pthread_t threads[THREADS];
+	size_t i, k, v;
+
+	for(k=0; k<NEXPS; ++k) {
+		progs[k] = expr_program_new(exps[k]);
+		assert(progs[k]);
+		/* 绑定槽位要在共享之前完成 */
+		for(v=0; v<expr_program_var_count(progs[k]); ++v) {
+			char *name = expr_program_var_name(progs[k], v);
+			assert(expr_program_bind_var(progs[k], v, \
+						name[0] == 'a' ? 0 : (name[0] == 'b' ? 1 : 2)) == 0);
+		}
+	}
+
+	for(i=0; i<THREADS; ++i) {
+		assert(pthread_create(&threads[i], 0, worker, (void *)i) == 0);
+	}
+	for(i=0; i<THREADS; ++i) {
+		assert(pthread_join(threads[i], 0) == 0);
+	}
+
+	for(k=0; k<NEXPS; ++k) {
+		expr_program_delete(progs[k]);
+	}
+	printf("test_thread ok\n");
+}
+
+int main() {
+	test_thread();
+	return 0;
+}